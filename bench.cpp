@@ -0,0 +1,1325 @@
+#include "concurrent_trie.h"
+#include "persistent_trie.h"
+#include "trie.h"
+#include "trie_backend.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <regex>
+#include <set>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ###### allocation accounting ######
+
+static std::size_t allocated_bytes = 0;
+static std::size_t allocation_count = 0;
+
+void *operator new(std::size_t size) {
+  void *ptr = std::malloc(size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  allocated_bytes += malloc_usable_size(ptr);
+  ++allocation_count;
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr == nullptr)
+    return;
+  allocated_bytes -= malloc_usable_size(ptr);
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+// ###### helpers ######
+
+template <typename _Function> double seconds(_Function function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+std::vector<std::string> random_keys(std::size_t count,
+                                     unsigned int seed = 42) {
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> length(4, 16);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    std::string key(length(generator), ' ');
+    for (auto &c : key)
+      c = static_cast<char>(letter(generator));
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+std::vector<std::string> random_urls(std::size_t count,
+                                     unsigned int seed = 42) {
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> host(0, 49);
+  std::uniform_int_distribution<int> segments(1, 4);
+  auto words = random_keys(1000, seed + 1);
+  std::uniform_int_distribution<std::size_t> word(0, words.size() - 1);
+  std::vector<std::string> urls;
+  urls.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    std::string url = "https://host" + std::to_string(host(generator)) + ".com";
+    for (int s = segments(generator); s > 0; --s)
+      url += "/" + words[word(generator)];
+    url += "?id=" + std::to_string(generator());
+    urls.push_back(url);
+  }
+  return urls;
+}
+
+// Hardware cache misses in user space while function runs, or -1 where the
+// counter cannot be opened (no PMU in a virtual machine, perf_event_paranoid).
+template <typename _Function> long long cache_misses(_Function function) {
+  perf_event_attr attributes;
+  std::memset(&attributes, 0, sizeof(attributes));
+  attributes.size = sizeof(attributes);
+  attributes.type = PERF_TYPE_HARDWARE;
+  attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  int fd = static_cast<int>(
+      syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+  if (fd < 0) {
+    function();
+    return -1;
+  }
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  function();
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  long long count = -1;
+  if (read(fd, &count, sizeof(count)) != sizeof(count))
+    count = -1;
+  close(fd);
+  return count;
+}
+
+void report(const std::string &name, double value, const std::string &unit) {
+  std::cout << name << ": " << static_cast<unsigned long long>(value) << " "
+            << unit << std::endl;
+}
+
+// The std::set child layout trie_node used before the adaptive containers,
+// kept here as the reference point.
+struct set_trie_node {
+  struct compare {
+    bool operator()(const set_trie_node *a, const set_trie_node *b) const {
+      return a->key < b->key;
+    }
+  };
+
+  char key;
+  std::optional<int> value;
+  set_trie_node *parent;
+  std::set<set_trie_node *, compare> children;
+
+  set_trie_node(char k, set_trie_node *p = nullptr) : key(k), parent(p) {}
+  ~set_trie_node() {
+    for (auto child : children)
+      delete child;
+  }
+
+  set_trie_node *get_child(char k) const {
+    auto item =
+        std::find_if(children.begin(), children.end(),
+                     [&k](const set_trie_node *n) { return n->key == k; });
+    return item != children.end() ? *item : nullptr;
+  }
+
+  void insert(const std::string &full_key, int v) {
+    set_trie_node *current = this;
+    for (char c : full_key) {
+      set_trie_node *next = current->get_child(c);
+      if (next == nullptr) {
+        next = new set_trie_node(c, current);
+        current->children.insert(next);
+      }
+      current = next;
+    }
+    current->value = v;
+  }
+
+  const set_trie_node *find(const std::string &full_key) const {
+    const set_trie_node *current = this;
+    for (char c : full_key) {
+      current = current->get_child(c);
+      if (current == nullptr)
+        return nullptr;
+    }
+    return current;
+  }
+};
+
+// ###### benchmarks ######
+
+void bench_node_layout(std::size_t key_count) {
+  std::cout << "### start of bench_node_layout ###" << std::endl << std::endl;
+
+  auto keys = random_keys(key_count);
+
+  std::size_t before = allocated_bytes;
+  auto *legacy = new set_trie_node('\0');
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    legacy->insert(keys[i], static_cast<int>(i));
+  std::size_t legacy_bytes = allocated_bytes - before;
+
+  before = allocated_bytes;
+  auto *adaptive = new trie<int>();
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    adaptive->insert(keys[i], static_cast<int>(i));
+  std::size_t adaptive_bytes = allocated_bytes - before;
+
+  std::size_t hits = 0;
+  double legacy_time = seconds([&] {
+    for (const auto &key : keys)
+      hits += legacy->find(key) != nullptr;
+  });
+  double adaptive_time = seconds([&] {
+    for (const auto &key : keys)
+      hits += adaptive->contains(key);
+  });
+
+  report("std::set bytes/key", double(legacy_bytes) / keys.size(), "B");
+  report("adaptive bytes/key", double(adaptive_bytes) / keys.size(), "B");
+  report("std::set lookups/sec", keys.size() / legacy_time, "");
+  report("adaptive lookups/sec", keys.size() / adaptive_time, "");
+  assert(hits == 2 * keys.size());
+
+  delete legacy;
+  delete adaptive;
+
+  std::cout << std::endl << "### end of bench_node_layout ###" << std::endl;
+}
+
+void bench_fanout_lookup() {
+  std::cout << "### start of bench_fanout_lookup ###" << std::endl
+            << std::endl;
+
+  for (int fanout : {2, 4, 8, 16, 32, 48, 64, 128, 256}) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < fanout; ++i)
+      for (int j = 0; j < fanout; ++j)
+        keys.push_back({static_cast<char>(i * 256 / fanout),
+                        static_cast<char>(j * 256 / fanout)});
+
+    set_trie_node legacy('\0');
+    trie<int> adaptive;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      legacy.insert(keys[i], static_cast<int>(i));
+      adaptive.insert(keys[i], static_cast<int>(i));
+    }
+
+    std::size_t rounds = 2000000 / keys.size() + 1;
+    std::size_t hits = 0;
+    double legacy_time = seconds([&] {
+      for (std::size_t r = 0; r < rounds; ++r)
+        for (const auto &key : keys)
+          hits += legacy.find(key) != nullptr;
+    });
+    double adaptive_time = seconds([&] {
+      for (std::size_t r = 0; r < rounds; ++r)
+        for (const auto &key : keys)
+          hits += adaptive.contains(key);
+    });
+    assert(hits == 2 * rounds * keys.size());
+
+    std::string prefix = "fan-out " + std::to_string(fanout);
+    report(prefix + " std::set finds/sec", rounds * keys.size() / legacy_time,
+           "");
+    report(prefix + " adaptive finds/sec",
+           rounds * keys.size() / adaptive_time, "");
+  }
+
+  std::cout << std::endl
+            << "### end of bench_fanout_lookup ###" << std::endl;
+}
+
+void bench_path_compression(std::size_t key_count) {
+  std::cout << "### start of bench_path_compression ###" << std::endl
+            << std::endl;
+
+  auto urls = random_urls(key_count);
+  for (bool compressed : {false, true}) {
+    std::size_t before = allocated_bytes;
+    auto *url_trie = new trie<int>(compressed);
+    for (std::size_t i = 0; i < urls.size(); ++i)
+      url_trie->insert(urls[i], static_cast<int>(i));
+    std::size_t bytes = allocated_bytes - before;
+
+    std::size_t hits = 0;
+    double lookup_time = seconds([&] {
+      for (const auto &url : urls)
+        hits += url_trie->contains(url);
+    });
+    assert(hits == urls.size());
+
+    std::string prefix = compressed ? "compressed" : "plain";
+    report(prefix + " nodes", url_trie->node_count(), "");
+    report(prefix + " bytes/key", double(bytes) / urls.size(), "B");
+    report(prefix + " lookups/sec", urls.size() / lookup_time, "");
+    delete url_trie;
+  }
+
+  std::cout << std::endl
+            << "### end of bench_path_compression ###" << std::endl;
+}
+
+trie_node<int> *build_node_tree(const std::vector<std::string> &keys,
+                                trie_arena *arena) {
+  auto root = trie_node<int>::create('\0', std::nullopt, arena);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    auto current = root;
+    for (char c : keys[i]) {
+      auto next = current->get_child(c);
+      if (next == nullptr)
+        next = current->insert_child(c, std::nullopt, arena);
+      current = next;
+    }
+    current->assign_value(static_cast<int>(i));
+  }
+  return root;
+}
+
+void bench_arena(std::size_t key_count) {
+  std::cout << "### start of bench_arena ###" << std::endl << std::endl;
+
+  auto keys = random_keys(key_count);
+
+  trie_node<int> *heap_root = nullptr;
+  double heap_build =
+      seconds([&] { heap_root = build_node_tree(keys, trie_arena::heap()); });
+  double heap_teardown = seconds([&] { delete heap_root; });
+
+  trie_arena arena;
+  double arena_build = seconds([&] { build_node_tree(keys, &arena); });
+  double arena_teardown = seconds([&] { arena.release(); });
+
+  trie<int> *arena_trie = new trie<int>();
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    arena_trie->insert(keys[i], static_cast<int>(i));
+  double trie_clear = seconds([&] { arena_trie->clear(); });
+  delete arena_trie;
+
+  report("per-node new build ms", heap_build * 1000, "");
+  report("per-node delete teardown ms", heap_teardown * 1000, "");
+  report("arena build ms", arena_build * 1000, "");
+  report("arena release ms", arena_teardown * 1000, "");
+  report("trie<int>::clear ms", trie_clear * 1000, "");
+
+  std::cout << std::endl << "### end of bench_arena ###" << std::endl;
+}
+
+void bench_prefix_range(std::size_t key_count) {
+  std::cout << "### start of bench_prefix_range ###" << std::endl
+            << std::endl;
+
+  auto keys = random_keys(key_count);
+  trie<int> prefix_trie;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    prefix_trie.insert(keys[i], static_cast<int>(i));
+
+  std::vector<std::string> prefixes;
+  for (std::size_t i = 0; i < 20; ++i)
+    prefixes.push_back(keys[i].substr(0, 3));
+
+  std::size_t scanned = 0;
+  double scan_time = seconds([&] {
+    for (const auto &prefix : prefixes)
+      for (auto it = prefix_trie.begin(); it != prefix_trie.end(); ++it)
+        scanned += (*it).get_key().compare(1, prefix.length(), prefix) == 0;
+  });
+  std::size_t ranged = 0;
+  double range_time = seconds([&] {
+    for (const auto &prefix : prefixes) {
+      auto range = prefix_trie.prefix_range(prefix);
+      for (auto it = range.first; it != range.second; ++it)
+        ++ranged;
+    }
+  });
+  assert(scanned == ranged);
+
+  report("full scan queries/sec", prefixes.size() / scan_time, "");
+  report("prefix_range queries/sec", prefixes.size() / range_time, "");
+
+  std::cout << std::endl
+            << "### end of bench_prefix_range ###" << std::endl;
+}
+
+void bench_iteration(std::size_t key_count) {
+  std::cout << "### start of bench_iteration ###" << std::endl << std::endl;
+
+  auto keys = random_keys(key_count);
+  trie<int> scan_trie;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    scan_trie.insert(keys[i], static_cast<int>(i));
+
+  std::size_t visited = 0;
+  std::size_t allocations = allocation_count;
+  double forward_time = seconds([&] {
+    for (auto it = scan_trie.cbegin(); it != scan_trie.cend(); ++it)
+      ++visited;
+  });
+  std::size_t forward_allocations = allocation_count - allocations;
+
+  allocations = allocation_count;
+  double reverse_time = seconds([&] {
+    for (auto it = scan_trie.crbegin(); it != scan_trie.crend(); ++it)
+      ++visited;
+  });
+  std::size_t reverse_allocations = allocation_count - allocations;
+  assert(visited == 2 * scan_trie.size());
+
+  report("forward keys/sec", scan_trie.size() / forward_time, "");
+  report("forward allocations", forward_allocations, "");
+  report("reverse keys/sec", scan_trie.size() / reverse_time, "");
+  report("reverse allocations", reverse_allocations, "");
+
+  std::cout << std::endl << "### end of bench_iteration ###" << std::endl;
+}
+
+void bench_key_export(std::size_t key_count) {
+  std::cout << "### start of bench_key_export ###" << std::endl << std::endl;
+
+  auto urls = random_urls(key_count);
+  trie<int> export_trie;
+  for (std::size_t i = 0; i < urls.size(); ++i)
+    export_trie.insert(urls[i], static_cast<int>(i));
+
+  std::size_t walked_bytes = 0;
+  double walk_time = seconds([&] {
+    for (auto it = export_trie.cbegin(); it != export_trie.cend(); ++it)
+      walked_bytes += (*it).get_key().length() - 1;
+  });
+  std::size_t tracked_bytes = 0;
+  double tracked_time = seconds([&] {
+    for (auto it = export_trie.cbegin(); it != export_trie.cend(); ++it)
+      tracked_bytes += it.key().length();
+  });
+  assert(walked_bytes == tracked_bytes);
+
+  report("get_key() keys/sec", export_trie.size() / walk_time, "");
+  report("iterator key() keys/sec", export_trie.size() / tracked_time, "");
+
+  std::cout << std::endl << "### end of bench_key_export ###" << std::endl;
+}
+
+// 1 KiB value that counts how often it is copied.
+struct heavy_value {
+  static std::size_t copies;
+
+  heavy_value() noexcept : bytes{} {}
+  explicit heavy_value(char fill) noexcept { std::memset(bytes, fill, 1024); }
+  heavy_value(const heavy_value &other) noexcept {
+    std::memcpy(bytes, other.bytes, sizeof(bytes));
+    ++copies;
+  }
+  heavy_value(heavy_value &&other) noexcept = default;
+  heavy_value &operator=(const heavy_value &other) noexcept {
+    std::memcpy(bytes, other.bytes, sizeof(bytes));
+    ++copies;
+    return *this;
+  }
+  heavy_value &operator=(heavy_value &&other) noexcept = default;
+
+  char bytes[1024];
+};
+
+std::size_t heavy_value::copies = 0;
+
+void bench_heavy_value(std::size_t key_count) {
+  std::cout << "### start of bench_heavy_value ###" << std::endl << std::endl;
+
+  auto keys = random_keys(key_count / 10);
+
+  trie<heavy_value> copy_trie;
+  heavy_value::copies = 0;
+  double copy_time = seconds([&] {
+    heavy_value value('c');
+    for (const auto &key : keys)
+      copy_trie.insert(key, value);
+  });
+  double copy_copies = static_cast<double>(heavy_value::copies);
+
+  trie<heavy_value> move_trie;
+  heavy_value::copies = 0;
+  double move_time = seconds([&] {
+    for (auto key : keys)
+      move_trie.insert(std::move(key), heavy_value('m'));
+  });
+  double move_copies = static_cast<double>(heavy_value::copies);
+
+  trie<heavy_value> emplace_trie;
+  heavy_value::copies = 0;
+  double emplace_time = seconds([&] {
+    for (const auto &key : keys)
+      emplace_trie.emplace(key, 'e');
+  });
+  double emplace_copies = static_cast<double>(heavy_value::copies);
+
+  report("insert(const &) inserts/sec", keys.size() / copy_time, "");
+  report("insert(const &) copies per 1000 inserts",
+         1000 * copy_copies / keys.size(), "");
+  report("insert(&&) inserts/sec", keys.size() / move_time, "");
+  report("insert(&&) copies per 1000 inserts",
+         1000 * move_copies / keys.size(), "");
+  report("emplace inserts/sec", keys.size() / emplace_time, "");
+  report("emplace copies per 1000 inserts",
+         1000 * emplace_copies / keys.size(), "");
+
+  std::cout << std::endl << "### end of bench_heavy_value ###" << std::endl;
+}
+
+// Lookups keyed by slices of one request buffer, as a parser would issue
+// them, against the same lookups through a temporary std::string.
+void bench_view_lookup(std::size_t key_count) {
+  std::cout << "### start of bench_view_lookup ###" << std::endl << std::endl;
+
+  auto urls = random_urls(key_count);
+  trie<int> url_trie(true);
+  std::string buffer;
+  std::vector<std::pair<std::size_t, std::size_t>> slices;
+  for (std::size_t i = 0; i < urls.size(); ++i) {
+    url_trie.insert(urls[i], static_cast<int>(i));
+    slices.emplace_back(buffer.length(), urls[i].length());
+    buffer += urls[i];
+  }
+
+  std::size_t found = 0;
+  std::size_t allocations = allocation_count;
+  double string_time = seconds([&] {
+    for (const auto &slice : slices)
+      found += url_trie.contains(buffer.substr(slice.first, slice.second));
+  });
+  std::size_t string_allocations = allocation_count - allocations;
+
+  allocations = allocation_count;
+  double view_time = seconds([&] {
+    std::string_view view(buffer);
+    for (const auto &slice : slices)
+      found += url_trie.contains(view.substr(slice.first, slice.second));
+  });
+  std::size_t view_allocations = allocation_count - allocations;
+  assert(found == 2 * slices.size());
+
+  report("std::string lookups/sec", slices.size() / string_time, "");
+  report("std::string allocations", string_allocations, "");
+  report("string_view lookups/sec", slices.size() / view_time, "");
+  report("string_view allocations", view_allocations, "");
+
+  std::cout << std::endl << "### end of bench_view_lookup ###" << std::endl;
+}
+
+void bench_build_sorted(std::size_t key_count) {
+  std::cout << "### start of bench_build_sorted ###" << std::endl
+            << std::endl;
+
+  auto keys = random_urls(key_count);
+  std::sort(keys.begin(), keys.end());
+  std::vector<std::pair<std::string, int>> entries;
+  entries.reserve(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    entries.emplace_back(keys[i], static_cast<int>(i));
+
+  for (bool compressed : {false, true}) {
+    std::string mode = compressed ? "compressed " : "";
+
+    auto *insert_trie = new trie<int>(compressed);
+    double insert_time = seconds([&] {
+      for (const auto &entry : entries)
+        insert_trie->insert(entry.first, entry.second);
+    });
+    std::size_t inserted = insert_trie->size();
+    delete insert_trie;
+
+    auto *built_trie = new trie<int>(compressed);
+    double build_time = seconds(
+        [&] { built_trie->build_sorted(entries.cbegin(), entries.cend()); });
+    assert(built_trie->size() == inserted);
+    delete built_trie;
+
+    report(mode + "insert keys/sec", entries.size() / insert_time, "");
+    report(mode + "build_sorted keys/sec", entries.size() / build_time, "");
+  }
+
+  std::cout << std::endl
+            << "### end of bench_build_sorted ###" << std::endl;
+}
+
+void bench_build_parallel(std::size_t key_count) {
+  std::cout << "### start of bench_build_parallel ###" << std::endl
+            << std::endl;
+
+  auto keys = random_keys(key_count);
+  std::vector<std::pair<std::string, std::uint64_t>> entries;
+  entries.reserve(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    entries.emplace_back(keys[i], i);
+
+  unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    auto *parallel_trie = new trie<std::uint64_t>();
+    double build_time = seconds([&] {
+      parallel_trie->build_parallel(entries.cbegin(), entries.cend(), threads);
+    });
+    report(std::to_string(threads) + " threads keys/sec",
+           entries.size() / build_time, "");
+    delete parallel_trie;
+  }
+
+  std::cout << std::endl
+            << "### end of bench_build_parallel ###" << std::endl;
+}
+
+// Read throughput of concurrent_trie against a trie behind one mutex, with
+// the lookups split evenly over the threads.
+void bench_concurrent_read(std::size_t key_count) {
+  std::cout << "### start of bench_concurrent_read ###" << std::endl
+            << std::endl;
+
+  auto keys = random_keys(key_count);
+  concurrent_trie<int> shared_trie;
+  trie<int> locked_trie;
+  std::mutex lock;
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    shared_trie.insert(keys[i], static_cast<int>(i));
+    locked_trie.insert(keys[i], static_cast<int>(i));
+  }
+
+  auto run = [&](unsigned int threads, auto lookup) {
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> found(0);
+    double elapsed = seconds([&] {
+      for (unsigned int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          std::size_t local = 0;
+          for (std::size_t i = t; i < keys.size(); i += threads)
+            local += lookup(keys[i]);
+          found += local;
+        });
+      }
+      for (auto &worker : workers)
+        worker.join();
+    });
+    assert(found == keys.size());
+    return keys.size() / elapsed;
+  };
+
+  unsigned int max_threads = std::max(4u, std::thread::hardware_concurrency());
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    std::string name = std::to_string(threads) + " threads ";
+    report(name + "mutex lookups/sec",
+           run(threads,
+               [&](const std::string &key) {
+                 std::lock_guard<std::mutex> guard(lock);
+                 return locked_trie.contains(key);
+               }),
+           "");
+    report(name + "concurrent_trie lookups/sec",
+           run(threads,
+               [&](const std::string &key) {
+                 return shared_trie.contains(key);
+               }),
+           "");
+  }
+
+  std::cout << std::endl
+            << "### end of bench_concurrent_read ###" << std::endl;
+}
+
+// Concurrent writers inserting, then erasing, disjoint shares of the keys.
+void bench_concurrent_write(std::size_t key_count) {
+  std::cout << "### start of bench_concurrent_write ###" << std::endl
+            << std::endl;
+
+  auto keys = random_keys(key_count);
+  auto run = [&](unsigned int threads, auto operation) {
+    std::vector<std::thread> workers;
+    double elapsed = seconds([&] {
+      for (unsigned int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          for (std::size_t i = t; i < keys.size(); i += threads)
+            operation(keys[i], i);
+        });
+      }
+      for (auto &worker : workers)
+        worker.join();
+    });
+    return keys.size() / elapsed;
+  };
+
+  for (unsigned int threads = 1; threads <= 64; threads *= 2) {
+    concurrent_trie<int> shared_trie;
+    std::string name = std::to_string(threads) + " threads ";
+    report(name + "inserts/sec",
+           run(threads,
+               [&](const std::string &key, std::size_t i) {
+                 shared_trie.insert(key, static_cast<int>(i));
+               }),
+           "");
+    report(name + "erases/sec",
+           run(threads,
+               [&](const std::string &key, std::size_t) {
+                 shared_trie.erase(key);
+               }),
+           "");
+    assert(shared_trie.empty());
+  }
+
+  std::cout << std::endl
+            << "### end of bench_concurrent_write ###" << std::endl;
+}
+
+// Snapshot cost of the persistent trie against a deep copy of trie<int>, and
+// how much memory a snapshot keeps alive after the live version moves on.
+void bench_persistent_snapshot(std::size_t key_count) {
+  std::cout << "### start of bench_persistent_snapshot ###" << std::endl
+            << std::endl;
+
+  auto keys = random_keys(key_count);
+  trie<int> mutable_trie;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    mutable_trie.insert(keys[i], static_cast<int>(i));
+  std::size_t before = allocated_bytes;
+  trie<int> *copy = nullptr;
+  double copy_time = seconds([&] { copy = new trie<int>(mutable_trie); });
+  report("trie<int> copy us", copy_time * 1e6, "");
+  report("trie<int> copy bytes", allocated_bytes - before, "");
+  delete copy;
+
+  before = allocated_bytes;
+  persistent_trie<int> live;
+  double build = seconds([&] {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      live.insert(keys[i], static_cast<int>(i));
+  });
+  report("persistent inserts/sec", keys.size() / build, "");
+  report("persistent bytes", allocated_bytes - before, "");
+
+  const std::size_t rounds = 1000;
+  std::vector<persistent_trie<int>> snapshots;
+  snapshots.reserve(rounds);
+  double snapshot_time = seconds([&] {
+    for (std::size_t i = 0; i < rounds; ++i)
+      snapshots.push_back(live.snapshot());
+  });
+  report("snapshot ns", snapshot_time / rounds * 1e9, "");
+  snapshots.clear();
+
+  auto first = live.snapshot();
+  for (std::size_t updates = 10; updates <= keys.size(); updates *= 10) {
+    auto base = live.snapshot();
+    before = allocated_bytes;
+    for (std::size_t i = 0; i < updates; ++i)
+      live.insert_or_assign(keys[i * 7919 % keys.size()], static_cast<int>(i));
+    std::string name = "after " + std::to_string(updates) + " updates ";
+    report(name + "nodes", live.node_count(), "");
+    report(name + "shared with previous", live.shared_node_count(base), "");
+    report(name + "new bytes", allocated_bytes - before, "");
+  }
+  report("shared with first snapshot", live.shared_node_count(first), "");
+
+  std::cout << std::endl
+            << "### end of bench_persistent_snapshot ###" << std::endl;
+}
+
+// Cold start from a saved image against rebuilding the trie from its keys.
+// The image is still in the page cache here, so the first lookups measure
+// page faults rather than disk reads.
+void bench_save_load(std::size_t key_count) {
+  std::cout << "### start of bench_save_load ###" << std::endl << std::endl;
+
+  const std::string path = "bench_save_load.img";
+  auto urls = random_urls(key_count);
+  trie<int> *url_trie = new trie<int>(true);
+  double rebuild = seconds([&] {
+    for (std::size_t i = 0; i < urls.size(); ++i)
+      url_trie->insert(urls[i], static_cast<int>(i));
+  });
+  double save = seconds([&] { url_trie->save(path); });
+
+  std::size_t allocations = allocation_count;
+  mapped_trie<int> *image = nullptr;
+  double load =
+      seconds([&] { image = new mapped_trie<int>(trie<int>::load(path)); });
+  std::size_t load_allocations = allocation_count - allocations - 1;
+
+  std::size_t found = 0;
+  double first_lookup = seconds([&] { found += image->contains(urls[0]); });
+  double image_time = seconds([&] {
+    for (const auto &url : urls)
+      found += image->contains(url);
+  });
+  double trie_time = seconds([&] {
+    for (const auto &url : urls)
+      found += url_trie->contains(url);
+  });
+  assert(found == 2 * urls.size() + 1);
+
+  report("rebuild from keys ms", rebuild * 1000, "");
+  report("save ms", save * 1000, "");
+  report("image bytes", image->image_size(), "");
+  report("load us", load * 1e6, "");
+  report("load allocations", load_allocations, "");
+  report("first lookup us", first_lookup * 1e6, "");
+  report("mapped lookups/sec", urls.size() / image_time, "");
+  report("trie lookups/sec", urls.size() / trie_time, "");
+
+  delete image;
+  delete url_trie;
+  std::remove(path.c_str());
+
+  std::cout << std::endl << "### end of bench_save_load ###" << std::endl;
+}
+
+// Size and lookup speed of the LOUDS copy against the uncompressed trie it
+// was frozen from. Sizes leave the int values out and are spread over the
+// nodes of the uncompressed trie, which the frozen one partly keeps as
+// tails.
+void bench_freeze(std::size_t key_count) {
+  std::cout << "### start of bench_freeze ###" << std::endl << std::endl;
+
+  auto urls = random_urls(key_count);
+  std::size_t before = allocated_bytes;
+  auto *url_trie = new trie<int>();
+  for (std::size_t i = 0; i < urls.size(); ++i)
+    url_trie->insert(urls[i], static_cast<int>(i));
+  std::size_t trie_bytes = allocated_bytes - before;
+  std::size_t nodes = url_trie->node_count();
+
+  frozen_trie<int> *frozen = nullptr;
+  double freeze = seconds([&] {
+    frozen = new frozen_trie<int>(url_trie->freeze());
+  });
+  std::size_t frozen_bytes = frozen->memory_usage() - urls.size() * sizeof(int);
+
+  std::size_t hits = 0;
+  double trie_time = seconds([&] {
+    for (const auto &url : urls)
+      hits += url_trie->contains(url);
+  });
+  double frozen_time = seconds([&] {
+    for (const auto &url : urls)
+      hits += frozen->contains(url);
+  });
+  std::size_t visited = 0;
+  double walk = seconds([&] {
+    frozen->for_each([&](std::string_view, int) { ++visited; });
+  });
+  assert(hits == 2 * urls.size() && visited == urls.size());
+
+  report("trie nodes", nodes, "");
+  report("frozen nodes", frozen->node_count(), "");
+  report("trie bits/trie node", 8.0 * trie_bytes / nodes, "");
+  report("frozen bits/trie node", 8.0 * frozen_bytes / nodes, "");
+  report("freeze ms", freeze * 1000, "");
+  report("trie lookups/sec", urls.size() / trie_time, "");
+  report("frozen lookups/sec", urls.size() / frozen_time, "");
+  report("frozen ordered walk ms", walk * 1000, "");
+
+  delete frozen;
+  delete url_trie;
+
+  std::cout << std::endl << "### end of bench_freeze ###" << std::endl;
+}
+
+// Exact-match lookups in random order on the node backend and the double
+// array, before and after compact(). Pass a larger key count, e.g. 10000000,
+// for the full-size URL set.
+void bench_double_array(std::size_t key_count) {
+  std::cout << "### start of bench_double_array ###" << std::endl
+            << std::endl;
+
+  auto urls = random_urls(key_count);
+  std::vector<std::string> probes(urls);
+  std::shuffle(probes.begin(), probes.end(), std::mt19937(42));
+
+  auto measure = [&](const std::string &name, auto &lookup_trie,
+                     std::size_t bytes) {
+    std::size_t hits = 0;
+    double lookup_time = 0;
+    long long misses = cache_misses([&] {
+      lookup_time = seconds([&] {
+        for (const auto &probe : probes)
+          hits += lookup_trie.contains(probe);
+      });
+    });
+    assert(hits == probes.size());
+    report(name + " bytes/key", double(bytes) / urls.size(), "B");
+    report(name + " lookups/sec", probes.size() / lookup_time, "");
+    if (misses < 0)
+      std::cout << name << " cache misses/lookup: unavailable" << std::endl;
+    else
+      report(name + " cache misses/lookup x100",
+             100.0 * misses / probes.size(), "");
+  };
+
+  for (bool compressed : {false, true}) {
+    std::size_t before = allocated_bytes;
+    auto *node_trie = new basic_trie<int, node_backend>(compressed);
+    double build = seconds([&] {
+      for (std::size_t i = 0; i < urls.size(); ++i)
+        node_trie->insert(urls[i], static_cast<int>(i));
+    });
+    std::string name = compressed ? "compressed nodes" : "nodes";
+    report(name + " build ms", build * 1000, "");
+    measure(name, *node_trie, allocated_bytes - before);
+    delete node_trie;
+  }
+
+  auto *da_trie = new basic_trie<int, double_array_backend>();
+  double build = seconds([&] {
+    for (std::size_t i = 0; i < urls.size(); ++i)
+      da_trie->insert(urls[i], static_cast<int>(i));
+  });
+  report("double array build ms", build * 1000, "");
+  report("double array slots/key", double(da_trie->slot_count()) / urls.size(),
+         "");
+  measure("double array", *da_trie, da_trie->memory_usage());
+  double compact = seconds([&] { da_trie->compact(); });
+  report("compact ms", compact * 1000, "");
+  report("compacted slots/key", double(da_trie->slot_count()) / urls.size(),
+         "");
+  measure("compacted", *da_trie, da_trie->memory_usage());
+  delete da_trie;
+
+  std::cout << std::endl
+            << "### end of bench_double_array ###" << std::endl;
+}
+
+// contains() one key at a time against contains_batch() over the same
+// shuffled probes, for batch sizes from 8 to 1024.
+void bench_find_batch(std::size_t key_count) {
+  std::cout << "### start of bench_find_batch ###" << std::endl << std::endl;
+
+  auto urls = random_urls(key_count);
+  auto *url_trie = new trie<int>(true);
+  for (std::size_t i = 0; i < urls.size(); ++i)
+    url_trie->insert(urls[i], static_cast<int>(i));
+  std::vector<std::string_view> probes(urls.begin(), urls.end());
+  std::shuffle(probes.begin(), probes.end(), std::mt19937(42));
+  std::unique_ptr<bool[]> present(new bool[probes.size()]);
+
+  std::size_t hits = 0;
+  double single = seconds([&] {
+    for (const auto &probe : probes)
+      hits += url_trie->contains(probe);
+  });
+  report("single lookups/sec", probes.size() / single, "");
+  for (std::size_t batch = 8; batch <= 1024; batch *= 2) {
+    double batched = seconds([&] {
+      for (std::size_t first = 0; first < probes.size(); first += batch)
+        url_trie->contains_batch(probes.data() + first,
+                                 std::min(batch, probes.size() - first),
+                                 present.get() + first);
+    });
+    hits += std::count(present.get(), present.get() + probes.size(), true);
+    report("batch " + std::to_string(batch) + " lookups/sec",
+           probes.size() / batched, "");
+  }
+  assert(hits == 9 * probes.size());
+  delete url_trie;
+
+  std::cout << std::endl << "### end of bench_find_batch ###" << std::endl;
+}
+
+// Longest matching route for full URLs: one longest_prefix_of() walk
+// against find() on every prefix length, longest first, until one holds a
+// value.
+void bench_longest_prefix(std::size_t key_count) {
+  std::cout << "### start of bench_longest_prefix ###" << std::endl
+            << std::endl;
+
+  auto urls = random_urls(key_count);
+  trie<int> routes(true);
+  for (std::size_t i = 0; i < urls.size(); i += 4) {
+    std::size_t slash = urls[i].find('/', 8);
+    for (; slash != std::string::npos; slash = urls[i].find('/', slash + 1))
+      routes.insert(std::string_view(urls[i]).substr(0, slash),
+                    static_cast<int>(i));
+  }
+
+  std::size_t matched = 0;
+  std::size_t repeated_matched = 0;
+  std::size_t allocations = allocation_count;
+  double walk = seconds([&] {
+    for (const auto &url : urls)
+      matched += routes.longest_prefix_of(url) != routes.end();
+  });
+  std::size_t walk_allocations = allocation_count - allocations;
+  double repeated = seconds([&] {
+    for (const auto &url : urls) {
+      std::string_view view(url);
+      for (std::size_t length = view.length(); length > 0; --length) {
+        auto it = routes.find(view.substr(0, length));
+        if (it != routes.end() && it->get_value() != std::nullopt) {
+          ++repeated_matched;
+          break;
+        }
+      }
+    }
+  });
+  assert(matched == repeated_matched);
+
+  report("routes", routes.size(), "");
+  report("longest_prefix_of lookups/sec", urls.size() / walk, "");
+  report("longest_prefix_of allocations", walk_allocations, "");
+  report("repeated find lookups/sec", urls.size() / repeated, "");
+
+  std::cout << std::endl
+            << "### end of bench_longest_prefix ###" << std::endl;
+}
+
+std::size_t edit_distance(std::string_view a, std::string_view b) {
+  std::vector<std::size_t> row(b.length() + 1);
+  for (std::size_t j = 0; j <= b.length(); ++j)
+    row[j] = j;
+  for (std::size_t i = 1; i <= a.length(); ++i) {
+    std::size_t diagonal = row[0];
+    row[0] = i;
+    for (std::size_t j = 1; j <= b.length(); ++j) {
+      std::size_t above = row[j];
+      row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                         diagonal + (a[i - 1] != b[j - 1])});
+      diagonal = above;
+    }
+  }
+  return row[b.length()];
+}
+
+// Spelling suggestions for misspelt dictionary words: fuzzy_find() against
+// computing the distance to every key from begin() to end().
+void bench_fuzzy_find(std::size_t key_count) {
+  std::cout << "### start of bench_fuzzy_find ###" << std::endl << std::endl;
+
+  auto words = random_keys(key_count);
+  trie<int> dictionary;
+  for (std::size_t i = 0; i < words.size(); ++i)
+    dictionary.insert(words[i], static_cast<int>(i));
+  std::mt19937 generator(7);
+  std::vector<std::string> queries;
+  for (std::size_t i = 0; i < 200; ++i) {
+    std::string query = words[generator() % words.size()];
+    query[generator() % query.length()] = static_cast<char>('a' + i % 26);
+    queries.push_back(query);
+  }
+
+  for (std::size_t distance = 1; distance <= 2; ++distance) {
+    std::size_t matches = 0;
+    double fuzzy = seconds([&] {
+      for (const auto &query : queries)
+        matches += dictionary.fuzzy_find(query, distance).size();
+    });
+    const std::size_t scanned_queries = 5;
+    std::size_t scanned_matches = 0;
+    double scan = seconds([&] {
+      for (std::size_t q = 0; q < scanned_queries; ++q)
+        for (auto it = dictionary.cbegin(); it != dictionary.cend(); ++it)
+          scanned_matches += edit_distance(it.key(), queries[q]) <= distance;
+    });
+    std::string name = "distance " + std::to_string(distance) + " ";
+    report(name + "fuzzy_find us/query", fuzzy / queries.size() * 1e6, "");
+    report(name + "linear scan us/query", scan / scanned_queries * 1e6, "");
+    report(name + "matches/query", double(matches) / queries.size(), "");
+    assert(scanned_matches >= scanned_queries);
+  }
+
+  std::cout << std::endl << "### end of bench_fuzzy_find ###" << std::endl;
+}
+
+// Patterns go from a literal prefix, which match() follows edge by edge, to
+// a leading star, which leaves it nothing to prune. The scan is the full
+// iteration with a std::regex check that match() replaces.
+void bench_match(std::size_t key_count) {
+  std::cout << "### start of bench_match ###" << std::endl << std::endl;
+
+  auto words = random_keys(key_count);
+  trie<int> dictionary;
+  for (std::size_t i = 0; i < words.size(); ++i)
+    dictionary.insert(words[i], static_cast<int>(i));
+  std::vector<std::pair<std::string, std::string>> patterns = {
+      {"ab?d*", "ab.d.*"},
+      {"q[a-e]?[!x]z*", "q[a-e].[^x]z.*"},
+      {"??????????????xy", ".{14}xy"},
+      {"*qqq", ".*qqq"}};
+
+  for (const auto &[glob, expression] : patterns) {
+    std::size_t matches = 0;
+    double matched = seconds([&] {
+      auto [it, last] = dictionary.match(glob);
+      for (; it != last; ++it)
+        ++matches;
+    });
+    std::regex regex(expression);
+    std::size_t scanned_matches = 0;
+    double scan = seconds([&] {
+      for (auto it = dictionary.cbegin(); it != dictionary.cend(); ++it)
+        scanned_matches += std::regex_match(it.key().begin(), it.key().end(),
+                                            regex);
+    });
+    std::size_t first_matches = 0;
+    double first = seconds([&] {
+      auto [it, last] = dictionary.match(glob);
+      for (; it != last && first_matches < 10; ++it)
+        ++first_matches;
+    });
+    assert(matches == scanned_matches);
+    report(glob + " match us", matched * 1e6, "");
+    report(glob + " first 10 us", first * 1e6, "");
+    report(glob + " regex scan us", scan * 1e6, "");
+    report(glob + " matches", double(matches), "");
+  }
+
+  std::cout << std::endl << "### end of bench_match ###" << std::endl;
+}
+
+// Keys over four letters, so each one-letter prefix has a quarter of the
+// keys below it. Latencies are per query, the scan being the subtree walk
+// and partial sort that top_k() falls back to without max scores.
+void bench_top_k(std::size_t key_count) {
+  std::cout << "### start of bench_top_k ###" << std::endl << std::endl;
+
+  auto keys = random_keys(key_count);
+  std::mt19937 generator(8);
+  std::vector<int> scores;
+  for (auto &key : keys) {
+    for (auto &c : key)
+      c = static_cast<char>('a' + c % 4);
+    scores.push_back(static_cast<int>(generator() % 1000000));
+  }
+  trie<int> plain;
+  double plain_build = seconds([&] {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      plain.insert_or_assign(keys[i], scores[i]);
+  });
+  trie<int> scored;
+  scored.enable_max_scores();
+  double scored_build = seconds([&] {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      scored.insert_or_assign(keys[i], scores[i]);
+  });
+  report("inserts/sec without scores", keys.size() / plain_build, "");
+  report("inserts/sec with scores", keys.size() / scored_build, "");
+  report("completions under \"a\"", plain.count_prefix("a"), "");
+
+  const std::size_t k = 10;
+  const std::string prefixes[] = {"", "a", "b", "c", "d"};
+  auto latencies = [&](trie<int> &dictionary, std::size_t queries) {
+    std::vector<double> times;
+    std::size_t found = 0;
+    for (std::size_t q = 0; q < queries; ++q) {
+      const auto &prefix = prefixes[q % 5];
+      times.push_back(
+          seconds([&] { found += dictionary.top_k(prefix, k).size(); }));
+    }
+    assert(found == queries * k);
+    std::sort(times.begin(), times.end());
+    return std::make_pair(times[times.size() / 2],
+                          times[times.size() * 99 / 100]);
+  };
+  auto best_first = latencies(scored, 2000);
+  auto scan = latencies(plain, 25);
+  report("best first p50 us", best_first.first * 1e6, "");
+  report("best first p99 us", best_first.second * 1e6, "");
+  report("subtree scan p50 us", scan.first * 1e6, "");
+  report("subtree scan p99 us", scan.second * 1e6, "");
+  for (const auto &prefix : prefixes) {
+    auto fast = scored.top_k(prefix, k);
+    auto slow = plain.top_k(prefix, k);
+    for (std::size_t i = 0; i < k; ++i)
+      assert(*fast[i]->get_value() == *slow[i]->get_value());
+  }
+
+  std::vector<std::string> updates(keys.begin(),
+                                   keys.begin() + keys.size() / 10);
+  double plain_updates = seconds([&] {
+    for (const auto &key : updates)
+      plain.insert_or_assign(key, static_cast<int>(generator() % 1000000));
+  });
+  double scored_updates = seconds([&] {
+    for (const auto &key : updates)
+      scored.insert_or_assign(key, static_cast<int>(generator() % 1000000));
+  });
+  report("updates/sec without scores", updates.size() / plain_updates, "");
+  report("updates/sec with scores", updates.size() / scored_updates, "");
+
+  std::cout << std::endl << "### end of bench_top_k ###" << std::endl;
+}
+
+// 200k keywords against text made of words that are keywords or, nine
+// times in ten, cut-off keywords, so that lookups get deep before they
+// fail. The baseline is the find() at every offset that scan() replaces,
+// extended one character at a time while the prefix is in the trie, on a
+// slice of the text.
+void bench_scan(std::size_t key_count) {
+  std::cout << "### start of bench_scan ###" << std::endl << std::endl;
+
+  auto keywords = random_keys(std::min<std::size_t>(key_count, 200000), 9);
+  trie<int> dictionary;
+  for (std::size_t i = 0; i < keywords.size(); ++i)
+    dictionary.insert(keywords[i], static_cast<int>(i));
+  double compile = seconds([&] { dictionary.compile(); });
+  report("compile ms", compile * 1e3, "");
+
+  std::mt19937 generator(10);
+  std::string text;
+  const std::size_t text_size = std::size_t(32) << 20;
+  text.reserve(text_size + 16);
+  while (text.size() < text_size) {
+    const auto &keyword = keywords[generator() % keywords.size()];
+    if (generator() % 10 == 0)
+      text += keyword;
+    else
+      text.append(keyword, 0, generator() % keyword.length());
+    text += ' ';
+  }
+
+  std::size_t matches = 0;
+  double scan = seconds([&] {
+    dictionary.scan(text, [&matches](std::string_view, int) { ++matches; });
+  });
+  report("scan MB/s", text.size() / scan / 1e6, "");
+  report("matches", double(matches), "");
+
+  std::string_view slice(text.data(), std::size_t(1) << 20);
+  std::size_t slice_matches = 0;
+  double naive = seconds([&] {
+    for (std::size_t i = 0; i < slice.length(); ++i)
+      for (std::size_t length = 1; length <= 16 && i + length <= slice.length();
+           ++length) {
+        auto it = dictionary.find(slice.substr(i, length));
+        if (it == dictionary.end())
+          break;
+        slice_matches += it->get_value() != std::nullopt;
+      }
+  });
+  std::size_t scanned_matches = 0;
+  dictionary.scan(slice, [&scanned_matches](std::string_view, int) {
+    ++scanned_matches;
+  });
+  assert(slice_matches == scanned_matches);
+  report("find at every offset MB/s", slice.size() / naive / 1e6, "");
+
+  std::cout << std::endl << "### end of bench_scan ###" << std::endl;
+}
+
+// Inserts, looks up and measures a path-compressed trie<int, _Key> of keys.
+template <typename _Key>
+void bench_symbol_type(const std::string &name, const std::vector<_Key> &keys) {
+  std::size_t before = allocated_bytes;
+  trie<int, _Key> symbols(true);
+  double insert = seconds([&] {
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      symbols.insert(keys[i], static_cast<int>(i));
+  });
+  std::size_t bytes = allocated_bytes - before;
+  std::size_t found = 0;
+  double lookup = seconds([&] {
+    for (const auto &key : keys)
+      found += symbols.contains(key);
+  });
+  assert(found == keys.size());
+
+  report(name + " inserts/sec", keys.size() / insert, "");
+  report(name + " lookups/sec", keys.size() / lookup, "");
+  report(name + " bytes/key", double(bytes) / symbols.size(), "B");
+}
+
+void bench_symbol_types(std::size_t key_count) {
+  std::cout << "### start of bench_symbol_types ###" << std::endl
+            << std::endl;
+
+  std::mt19937 generator(11);
+  std::vector<std::uint32_t> addresses(key_count);
+  for (auto &address : addresses)
+    address = static_cast<std::uint32_t>(generator());
+  auto encode = [&addresses](auto symbol, int width) {
+    using key_type = trie_string<decltype(symbol)>;
+    std::vector<key_type> keys;
+    keys.reserve(addresses.size());
+    for (std::uint32_t address : addresses) {
+      key_type key;
+      for (int shift = 32 - width; shift >= 0; shift -= width)
+        key += static_cast<decltype(symbol)>((address >> shift) &
+                                             ((1u << width) - 1));
+      keys.push_back(key);
+    }
+    return keys;
+  };
+  bench_symbol_type("ipv4 as char", encode(char(), 8));
+  bench_symbol_type("ipv4 as unsigned char",
+                    encode(static_cast<unsigned char>(0), 8));
+  bench_symbol_type("ipv4 as trie_nibble", encode(trie_nibble(), 4));
+  bench_symbol_type("ipv4 as trie_bit", encode(trie_bit(), 1));
+
+  // Token phrases with a heavy head, as 32-bit symbols and as the same
+  // tokens spelled in four big-endian bytes each.
+  std::vector<trie_string<std::uint32_t>> phrases(key_count);
+  std::vector<std::string> spelled(key_count);
+  for (std::size_t i = 0; i < key_count; ++i) {
+    for (int length = 2 + generator() % 7; length > 0; --length) {
+      std::uint32_t token = generator() % (generator() % 50000 + 1);
+      phrases[i] += token;
+      for (int shift = 24; shift >= 0; shift -= 8)
+        spelled[i] += static_cast<char>(token >> shift);
+    }
+  }
+  bench_symbol_type("tokens as uint32_t", phrases);
+  bench_symbol_type("tokens as bytes", spelled);
+
+  std::cout << std::endl
+            << "### end of bench_symbol_types ###" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::size_t key_count =
+      argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  bench_node_layout(key_count);
+  bench_fanout_lookup();
+  bench_path_compression(key_count);
+  bench_arena(key_count);
+  bench_prefix_range(key_count);
+  bench_iteration(key_count);
+  bench_key_export(key_count);
+  bench_heavy_value(key_count);
+  bench_view_lookup(key_count);
+  bench_build_sorted(key_count);
+  bench_build_parallel(key_count);
+  bench_concurrent_read(key_count);
+  bench_concurrent_write(key_count);
+  bench_persistent_snapshot(key_count);
+  bench_save_load(key_count);
+  bench_freeze(key_count);
+  bench_double_array(key_count);
+  bench_find_batch(key_count);
+  bench_longest_prefix(key_count);
+  bench_fuzzy_find(key_count);
+  bench_match(key_count);
+  bench_top_k(key_count);
+  bench_scan(key_count);
+  bench_symbol_types(key_count);
+
+  return 0;
+}
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "trie_epoch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Trie for concurrent readers and writers. Readers never lock or wait: a
+// node's children live in an immutable sorted table that writers replace as
+// a whole and publish with a release store, and values sit behind an atomic
+// pointer that is swapped the same way. Writers lock only the nodes they
+// change, through a per-node version lock taken optimistically: the version
+// seen on the way down must still be current when the lock is taken, or the
+// operation starts over. Erase locks parent before child. Everything
+// unlinked is retired through trie_epoch and freed once no reader can still
+// hold it. Nodes come from the heap rather than a trie_arena so that each can
+// be freed on its own, and keys are not path compressed. Readers get values
+// by copy; there are no iterators.
+template <typename _Value> class concurrent_trie {
+public:
+  using key_type = std::string;
+  using value_type = _Value;
+  using size_type = std::size_t;
+
+  concurrent_trie() noexcept;
+  concurrent_trie(const concurrent_trie<_Value> &other_trie) = delete;
+  concurrent_trie<_Value> &
+  operator=(const concurrent_trie<_Value> &other_trie) = delete;
+  ~concurrent_trie() noexcept;
+
+  // ###### Element access ######
+  _Value at(std::string_view key) const;
+
+  // ###### Capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+
+  // ###### Modifiers ######
+  void clear() noexcept;
+  bool insert(std::string_view key, const _Value &value);
+  bool insert_or_assign(std::string_view key, const _Value &value);
+  size_type erase(std::string_view key) noexcept;
+
+  // ###### Lookup ######
+  std::optional<_Value> find(std::string_view key) const;
+  size_type count(std::string_view key) const noexcept;
+  bool contains(std::string_view key) const noexcept;
+
+private:
+  struct node;
+
+  // Published tables are never written again. The child pointers are
+  // followed by the keys, sorted like signed chars.
+  struct alignas(sizeof(void *)) child_table {
+    std::uint32_t size;
+
+    node **children() noexcept { return reinterpret_cast<node **>(this + 1); }
+    char *keys() noexcept {
+      return reinterpret_cast<char *>(children() + size);
+    }
+  };
+
+  // version holds a lock bit, an obsolete bit for unlinked nodes and a
+  // counter bumped by every unlock.
+  struct node {
+    std::atomic<child_table *> children;
+    std::atomic<_Value *> value;
+    std::atomic<std::uint64_t> version;
+    node *parent;
+    char key;
+
+    node(char node_key, node *parent_node) noexcept
+        : children(nullptr), value(nullptr), version(0), parent(parent_node),
+          key(node_key) {}
+  };
+
+  // Where a writer's descent stopped: the deepest node on key's path and its
+  // parent, with the versions read before their child tables.
+  struct cursor {
+    node *parent;
+    std::uint64_t parent_version;
+    node *current;
+    std::uint64_t version;
+    std::size_t depth;
+  };
+
+  static constexpr std::uint64_t locked = 1;
+  static constexpr std::uint64_t obsolete = 2;
+  static constexpr std::uint64_t step = 4;
+
+  node *_base_node;
+  std::atomic<size_type> _size;
+
+  bool emplacer(std::string_view key, const _Value &value, bool assign);
+  node *find_node(std::string_view key) const noexcept;
+  bool descend(std::string_view key, cursor &at) const noexcept;
+  void prune(node *current_node) noexcept;
+  size_type retire_subtree(node *current_node) noexcept;
+
+  // ###### Utilities ######
+  static bool stable_version(node *current_node,
+                             std::uint64_t &version) noexcept;
+  static bool try_lock(node *current_node, std::uint64_t version) noexcept;
+  static void unlock(node *current_node, std::uint64_t version) noexcept;
+  static void unlock_obsolete(node *current_node,
+                              std::uint64_t version) noexcept;
+  static node *find_child(child_table *table, char key) noexcept;
+  static child_table *make_table(std::uint32_t size);
+  static child_table *with_child(child_table *table, node *child);
+  static child_table *without_child(child_table *table, char key);
+  static void free_table(void *table) noexcept;
+  static void free_value(void *value) noexcept;
+  static void free_node(void *current_node) noexcept;
+  static void free_subtree(void *current_node) noexcept;
+};
+
+// ###### concurrent_trie ######
+
+template <typename _Value>
+concurrent_trie<_Value>::concurrent_trie() noexcept
+    : _base_node(new node('\0', nullptr)), _size(0) {}
+
+// No reader or writer may be inside the trie any more, so nothing needs
+// retiring.
+template <typename _Value>
+concurrent_trie<_Value>::~concurrent_trie() noexcept {
+  free_subtree(_base_node);
+}
+
+// ###### Element access ######
+
+template <typename _Value>
+_Value concurrent_trie<_Value>::at(std::string_view key) const {
+  auto value = find(key);
+  if (value == std::nullopt)
+    throw std::out_of_range("");
+  return std::move(value.value());
+}
+
+// ###### Capacity ######
+
+template <typename _Value>
+bool concurrent_trie<_Value>::empty() const noexcept {
+  return size() == 0;
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::size_type
+concurrent_trie<_Value>::size() const noexcept {
+  return _size.load(std::memory_order_relaxed);
+}
+
+// ###### Modifiers ######
+
+// Clearing is not atomic with respect to writers already inside the trie:
+// the detached subtrees are marked obsolete node by node, and anything a
+// writer finished there first is counted out of size() as well.
+template <typename _Value> void concurrent_trie<_Value>::clear() noexcept {
+  trie_epoch::guard guard;
+  std::uint64_t version;
+  while (!stable_version(_base_node, version) ||
+         !try_lock(_base_node, version))
+    std::this_thread::yield();
+  auto table = _base_node->children.load(std::memory_order_relaxed);
+  _base_node->children.store(nullptr, std::memory_order_release);
+  unlock(_base_node, version);
+  if (table == nullptr)
+    return;
+
+  size_type removed = 0;
+  for (std::uint32_t i = 0; i < table->size; ++i)
+    removed += retire_subtree(table->children()[i]);
+  trie_epoch::retire(table, free_table);
+  _size.fetch_sub(removed, std::memory_order_relaxed);
+}
+
+template <typename _Value>
+bool concurrent_trie<_Value>::insert(std::string_view key,
+                                     const _Value &value) {
+  return emplacer(key, value, false);
+}
+
+template <typename _Value>
+bool concurrent_trie<_Value>::insert_or_assign(std::string_view key,
+                                               const _Value &value) {
+  return emplacer(key, value, true);
+}
+
+// Only the value is cleared under the node's own lock; unlinking nodes left
+// empty is up to prune(), which locks parent and child.
+template <typename _Value>
+typename concurrent_trie<_Value>::size_type
+concurrent_trie<_Value>::erase(std::string_view key) noexcept {
+  if (key.empty())
+    return 0;
+  trie_epoch::guard guard;
+  for (;;) {
+    cursor at;
+    if (!descend(key, at)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (at.depth != key.length() ||
+        at.current->value.load(std::memory_order_acquire) == nullptr)
+      return 0;
+    if (!try_lock(at.current, at.version)) {
+      std::this_thread::yield();
+      continue;
+    }
+    auto old_value =
+        at.current->value.exchange(nullptr, std::memory_order_acq_rel);
+    _size.fetch_sub(1, std::memory_order_relaxed);
+    unlock(at.current, at.version);
+    trie_epoch::retire(old_value, free_value);
+    prune(at.current);
+    return 1;
+  }
+}
+
+// Takes the lock on the deepest existing node of key's path. Missing nodes
+// are linked up privately and published with a single store there.
+template <typename _Value>
+bool concurrent_trie<_Value>::emplacer(std::string_view key,
+                                       const _Value &value, bool assign) {
+  if (key.empty())
+    return false;
+  auto fresh = new _Value(value);
+  trie_epoch::guard guard;
+  cursor at;
+  for (;;) {
+    if (descend(key, at)) {
+      if (!assign && at.depth == key.length() &&
+          at.current->value.load(std::memory_order_acquire) != nullptr) {
+        delete fresh;
+        return false;
+      }
+      if (try_lock(at.current, at.version))
+        break;
+    }
+    std::this_thread::yield();
+  }
+
+  auto current_node = at.current;
+  bool inserted = true;
+  if (at.depth == key.length()) {
+    auto old_value = current_node->value.load(std::memory_order_relaxed);
+    inserted = old_value == nullptr;
+    if (inserted || assign) {
+      current_node->value.store(fresh, std::memory_order_release);
+      fresh = nullptr;
+      if (old_value != nullptr)
+        trie_epoch::retire(old_value, free_value);
+    }
+  } else {
+    node *head = new node(key[at.depth], current_node);
+    node *tail = head;
+    for (std::size_t position = at.depth + 1; position < key.length();
+         ++position) {
+      auto child = new node(key[position], tail);
+      tail->children.store(with_child(nullptr, child),
+                           std::memory_order_relaxed);
+      tail = child;
+    }
+    tail->value.store(fresh, std::memory_order_relaxed);
+    fresh = nullptr;
+
+    auto table = current_node->children.load(std::memory_order_relaxed);
+    current_node->children.store(with_child(table, head),
+                                 std::memory_order_release);
+    if (table != nullptr)
+      trie_epoch::retire(table, free_table);
+  }
+  if (inserted)
+    _size.fetch_add(1, std::memory_order_relaxed);
+  unlock(current_node, at.version);
+  delete fresh;
+  return inserted;
+}
+
+// Unlinks current_node and then each ancestor while they are left without
+// value and children.
+template <typename _Value>
+void concurrent_trie<_Value>::prune(node *current_node) noexcept {
+  while (current_node != _base_node) {
+    auto parent = current_node->parent;
+    std::uint64_t version, parent_version;
+    if (!stable_version(current_node, version) ||
+        current_node->value.load(std::memory_order_acquire) != nullptr ||
+        current_node->children.load(std::memory_order_acquire) != nullptr ||
+        !stable_version(parent, parent_version))
+      return;
+    if (!try_lock(parent, parent_version)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!try_lock(current_node, version)) {
+      unlock(parent, parent_version);
+      std::this_thread::yield();
+      continue;
+    }
+    auto table = parent->children.load(std::memory_order_relaxed);
+    parent->children.store(without_child(table, current_node->key),
+                           std::memory_order_release);
+    unlock_obsolete(current_node, version);
+    unlock(parent, parent_version);
+    trie_epoch::retire(table, free_table);
+    trie_epoch::retire(current_node, free_node);
+    current_node = parent;
+  }
+}
+
+// Marks a detached subtree obsolete top-down and retires it node by node.
+// Returns the number of values it held.
+template <typename _Value>
+typename concurrent_trie<_Value>::size_type
+concurrent_trie<_Value>::retire_subtree(node *current_node) noexcept {
+  std::uint64_t version;
+  while (!stable_version(current_node, version) ||
+         !try_lock(current_node, version))
+    std::this_thread::yield();
+  size_type removed =
+      current_node->value.load(std::memory_order_relaxed) != nullptr;
+  auto table = current_node->children.load(std::memory_order_relaxed);
+  unlock_obsolete(current_node, version);
+
+  if (table != nullptr)
+    for (std::uint32_t i = 0; i < table->size; ++i)
+      removed += retire_subtree(table->children()[i]);
+  trie_epoch::retire(current_node, free_node);
+  return removed;
+}
+
+// ###### Lookup ######
+
+template <typename _Value>
+std::optional<_Value>
+concurrent_trie<_Value>::find(std::string_view key) const {
+  trie_epoch::guard guard;
+  auto current_node = find_node(key);
+  if (current_node == nullptr)
+    return std::nullopt;
+  auto value = current_node->value.load(std::memory_order_acquire);
+  if (value == nullptr)
+    return std::nullopt;
+  return *value;
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::size_type
+concurrent_trie<_Value>::count(std::string_view key) const noexcept {
+  trie_epoch::guard guard;
+  auto current_node = find_node(key);
+  return current_node != nullptr &&
+         current_node->value.load(std::memory_order_acquire) != nullptr;
+}
+
+template <typename _Value>
+bool concurrent_trie<_Value>::contains(std::string_view key) const noexcept {
+  return count(key);
+}
+
+// Readers must hold a trie_epoch::guard across the call and for as long as
+// they use the result.
+template <typename _Value>
+typename concurrent_trie<_Value>::node *
+concurrent_trie<_Value>::find_node(std::string_view key) const noexcept {
+  if (key.empty())
+    return nullptr;
+  node *current_node = _base_node;
+  for (char k : key) {
+    current_node = find_child(
+        current_node->children.load(std::memory_order_acquire), k);
+    if (current_node == nullptr)
+      return nullptr;
+  }
+  return current_node;
+}
+
+// Walks down key as far as it exists. Fails if it runs into an unlinked
+// node, in which case the caller starts over.
+template <typename _Value>
+bool concurrent_trie<_Value>::descend(std::string_view key,
+                                      cursor &at) const noexcept {
+  at.parent = nullptr;
+  at.parent_version = 0;
+  at.current = _base_node;
+  at.depth = 0;
+  if (!stable_version(_base_node, at.version))
+    return false;
+  while (at.depth < key.length()) {
+    auto child =
+        find_child(at.current->children.load(std::memory_order_acquire),
+                   key[at.depth]);
+    if (child == nullptr)
+      return true;
+    std::uint64_t child_version;
+    if (!stable_version(child, child_version))
+      return false;
+    at.parent = at.current;
+    at.parent_version = at.version;
+    at.current = child;
+    at.version = child_version;
+    ++at.depth;
+  }
+  return true;
+}
+
+// ###### Utilities ######
+
+// Waits out a writer holding the lock; false if the node has been unlinked.
+template <typename _Value>
+bool concurrent_trie<_Value>::stable_version(node *current_node,
+                                             std::uint64_t &version) noexcept {
+  for (;;) {
+    version = current_node->version.load(std::memory_order_acquire);
+    if (version & obsolete)
+      return false;
+    if (!(version & locked))
+      return true;
+    std::this_thread::yield();
+  }
+}
+
+// Succeeds only if nothing has touched the node since version was read.
+template <typename _Value>
+bool concurrent_trie<_Value>::try_lock(node *current_node,
+                                       std::uint64_t version) noexcept {
+  return current_node->version.compare_exchange_strong(
+      version, version | locked, std::memory_order_acquire,
+      std::memory_order_relaxed);
+}
+
+template <typename _Value>
+void concurrent_trie<_Value>::unlock(node *current_node,
+                                     std::uint64_t version) noexcept {
+  current_node->version.store(version + step, std::memory_order_release);
+}
+
+template <typename _Value>
+void concurrent_trie<_Value>::unlock_obsolete(node *current_node,
+                                              std::uint64_t version) noexcept {
+  current_node->version.store((version + step) | obsolete,
+                              std::memory_order_release);
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::node *
+concurrent_trie<_Value>::find_child(child_table *table, char key) noexcept {
+  if (table == nullptr)
+    return nullptr;
+  char *keys = table->keys();
+  if (table->size <= 16) {
+    for (std::uint32_t i = 0; i < table->size; ++i)
+      if (keys[i] == key)
+        return table->children()[i];
+    return nullptr;
+  }
+  char *position = std::lower_bound(keys, keys + table->size, key);
+  if (position == keys + table->size || *position != key)
+    return nullptr;
+  return table->children()[position - keys];
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::child_table *
+concurrent_trie<_Value>::make_table(std::uint32_t size) {
+  auto table = static_cast<child_table *>(::operator new(
+      sizeof(child_table) + size * (sizeof(node *) + sizeof(char))));
+  table->size = size;
+  return table;
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::child_table *
+concurrent_trie<_Value>::with_child(child_table *table, node *child) {
+  std::uint32_t size = table == nullptr ? 0 : table->size;
+  auto copy = make_table(size + 1);
+  std::uint32_t position = 0;
+  if (table != nullptr) {
+    char *keys = table->keys();
+    position = std::lower_bound(keys, keys + size, child->key) - keys;
+    std::memcpy(copy->children(), table->children(), position * sizeof(node *));
+    std::memcpy(copy->children() + position + 1, table->children() + position,
+                (size - position) * sizeof(node *));
+    std::memcpy(copy->keys(), keys, position);
+    std::memcpy(copy->keys() + position + 1, keys + position, size - position);
+  }
+  copy->children()[position] = child;
+  copy->keys()[position] = child->key;
+  return copy;
+}
+
+template <typename _Value>
+typename concurrent_trie<_Value>::child_table *
+concurrent_trie<_Value>::without_child(child_table *table, char key) {
+  if (table->size == 1)
+    return nullptr;
+  auto copy = make_table(table->size - 1);
+  std::uint32_t kept = 0;
+  for (std::uint32_t i = 0; i < table->size; ++i) {
+    if (table->keys()[i] == key)
+      continue;
+    copy->children()[kept] = table->children()[i];
+    copy->keys()[kept] = table->keys()[i];
+    ++kept;
+  }
+  return copy;
+}
+
+template <typename _Value>
+void concurrent_trie<_Value>::free_table(void *table) noexcept {
+  ::operator delete(table);
+}
+
+template <typename _Value>
+void concurrent_trie<_Value>::free_value(void *value) noexcept {
+  delete static_cast<_Value *>(value);
+}
+
+// Children are not followed; see free_subtree().
+template <typename _Value>
+void concurrent_trie<_Value>::free_node(void *current_node) noexcept {
+  auto retired = static_cast<node *>(current_node);
+  free_table(retired->children.load(std::memory_order_relaxed));
+  free_value(retired->value.load(std::memory_order_relaxed));
+  delete retired;
+}
+
+template <typename _Value>
+void concurrent_trie<_Value>::free_subtree(void *current_node) noexcept {
+  auto subtree = static_cast<node *>(current_node);
+  auto table = subtree->children.load(std::memory_order_relaxed);
+  if (table != nullptr)
+    for (std::uint32_t i = 0; i < table->size; ++i)
+      free_subtree(table->children()[i]);
+  free_node(subtree);
+}
@@ -0,0 +1,829 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Trie in a double array. Every node is a slot holding a base and a check:
+// the child of node s under code c sits in slot base[s] + c and is only
+// valid if its check is s, so a lookup step is one addition and one 8-byte
+// load instead of a child-table search and a pointer chase. Byte c is coded
+// as c + 129 taken as signed, which keeps codes in signed char order like
+// trie, and code 0 is a terminal child whose base is the index of the
+// node's value.
+//
+// Each slot also records its first child code and next sibling code, kept
+// apart from base and check, so children can be listed in order for
+// iteration and relocation. Free slots are linked through negative base and
+// check values. Inserting a child whose slot is taken moves all the
+// siblings to a base where every code fits; compact() lays the whole trie
+// out again and drops the free slots at the end.
+// What double_array_trie iterators point at: the value of one key, read and
+// written through get_value() as on a trie_node.
+template <typename _Value> class double_array_element {
+public:
+  std::optional<_Value> &get_value() noexcept { return _value; }
+  const std::optional<_Value> &get_value() const noexcept { return _value; }
+
+private:
+  std::optional<_Value> _value;
+};
+
+template <typename _Value> class double_array_trie {
+public:
+  using key_type = std::string;
+  using mapped_type = _Value;
+  using value_type = double_array_element<_Value>;
+  using size_type = std::size_t;
+
+  template <typename _IterValue> struct trie_iterator {
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = _IterValue;
+    using pointer = _IterValue *;
+    using reference = _IterValue &;
+    using trie_pointer =
+        std::conditional_t<std::is_const<_IterValue>::value,
+                           const double_array_trie<_Value> *,
+                           double_array_trie<_Value> *>;
+
+    trie_iterator(trie_pointer owner, std::int32_t slot)
+        : _trie(owner), _slot(slot), _key_valid(slot == end_slot) {}
+    reference operator*() const { return _trie->value_at(_slot); }
+    pointer operator->() const { return &_trie->value_at(_slot); }
+
+    // Key of the current element; an iterator returned by find() rebuilds
+    // it from the check chain on first use.
+    std::string_view key() const {
+      if (!_key_valid)
+        materialize_key();
+      return _key;
+    }
+
+    trie_iterator &operator++() {
+      key();
+      _slot = _trie->next_terminal(_slot, _key);
+      return *this;
+    }
+    trie_iterator operator++(int) {
+      trie_iterator t = *this;
+      ++(*this);
+      return t;
+    }
+    trie_iterator &operator--() {
+      key();
+      _slot = _trie->previous_terminal(_slot, _key);
+      return *this;
+    }
+    trie_iterator operator--(int) {
+      trie_iterator t = *this;
+      --(*this);
+      return t;
+    }
+
+    friend bool operator==(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1._slot == it2._slot;
+    };
+    friend bool operator!=(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1._slot != it2._slot;
+    };
+
+  private:
+    friend class double_array_trie<_Value>;
+
+    trie_pointer _trie;
+    std::int32_t _slot;
+    mutable std::string _key;
+    mutable bool _key_valid;
+
+    void materialize_key() const {
+      _key = _trie->key_of(_slot);
+      _key_valid = true;
+    }
+  };
+
+  using iterator = trie_iterator<value_type>;
+  using const_iterator = trie_iterator<const value_type>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  double_array_trie() noexcept;
+
+  // ###### Element access ######
+  std::optional<_Value> &at(std::string_view key);
+  const std::optional<_Value> &at(std::string_view key) const;
+  std::optional<_Value> &operator[](std::string_view key);
+
+  // ###### Iterators ######
+  iterator begin() noexcept;
+  iterator end() noexcept;
+  const_iterator cbegin() const noexcept;
+  const_iterator cend() const noexcept;
+  reverse_iterator rbegin() noexcept;
+  reverse_iterator rend() noexcept;
+  const_reverse_iterator crbegin() const noexcept;
+  const_reverse_iterator crend() const noexcept;
+
+  // ###### Capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t slot_count() const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+  // ###### Modifiers ######
+  void clear() noexcept;
+  std::pair<iterator, bool> insert(std::string_view key, const _Value &value);
+  std::pair<iterator, bool> insert(std::string_view key, _Value &&value);
+  std::pair<iterator, bool> insert_or_assign(std::string_view key,
+                                             const _Value &value);
+  std::pair<iterator, bool> insert_or_assign(std::string_view key,
+                                             _Value &&value);
+  iterator erase(iterator pos);
+  size_type erase(std::string_view key);
+  void compact();
+
+  // ###### Lookup ######
+  size_type count(std::string_view key) const noexcept;
+  const_iterator find(std::string_view key) const noexcept;
+  iterator find(std::string_view key) noexcept;
+  bool contains(std::string_view key) const noexcept;
+
+private:
+  static constexpr std::int32_t end_slot = -1;
+  static constexpr std::uint16_t none = 0xffff;
+  static constexpr std::int32_t codes = 257;
+
+  struct slot {
+    std::int32_t base;
+    std::int32_t check;
+  };
+
+  struct links {
+    std::uint16_t child;
+    std::uint16_t sibling;
+  };
+
+  std::vector<slot> _slots;
+  std::vector<links> _links;
+  std::vector<value_type> _values;
+  std::vector<std::int32_t> _free_values;
+  std::int32_t _free_head;
+  size_type _size;
+
+  template <typename _Arg>
+  std::pair<iterator, bool> emplacer(std::string_view key, _Arg &&value,
+                                     bool assign);
+  std::int32_t find_slot(std::string_view key) const noexcept;
+  std::int32_t add_child(std::int32_t node, std::uint16_t code);
+  void remove_terminal(std::int32_t terminal) noexcept;
+
+  // ###### Iteration ######
+  value_type &value_at(std::int32_t terminal) noexcept;
+  const value_type &value_at(std::int32_t terminal) const noexcept;
+  std::string key_of(std::int32_t node) const;
+  std::int32_t next_terminal(std::int32_t node, std::string &key) const;
+  std::int32_t previous_terminal(std::int32_t node, std::string &key) const;
+  std::int32_t last_descendant(std::int32_t node, std::string &key) const;
+
+  // ###### Slots ######
+  static std::uint16_t encode(char key) noexcept;
+  static char decode(std::uint16_t code) noexcept;
+  std::uint16_t code_of(std::int32_t node) const noexcept;
+  bool is_free(std::int32_t index) const noexcept;
+  void grow(std::size_t new_size);
+  void take_slot(std::int32_t index) noexcept;
+  void release_slot(std::int32_t index) noexcept;
+  std::int32_t find_base(const std::vector<std::uint16_t> &child_list);
+  void child_codes(std::int32_t node, std::vector<std::uint16_t> &out) const;
+  void link_child(std::int32_t node, std::uint16_t code) noexcept;
+  void unlink_child(std::int32_t node, std::uint16_t code) noexcept;
+  void relocate(std::int32_t node, std::int32_t new_base) noexcept;
+};
+
+// ###### double_array_trie ######
+
+template <typename _Value>
+double_array_trie<_Value>::double_array_trie() noexcept {
+  clear();
+}
+
+// ###### Element access ######
+
+template <typename _Value>
+std::optional<_Value> &double_array_trie<_Value>::at(std::string_view key) {
+  auto terminal = find_slot(key);
+  if (terminal == end_slot)
+    throw std::out_of_range("");
+  return value_at(terminal).get_value();
+}
+
+template <typename _Value>
+const std::optional<_Value> &
+double_array_trie<_Value>::at(std::string_view key) const {
+  auto terminal = find_slot(key);
+  if (terminal == end_slot)
+    throw std::out_of_range("");
+  return value_at(terminal).get_value();
+}
+
+// The empty key is never stored, so it throws like at() does.
+template <typename _Value>
+std::optional<_Value> &
+double_array_trie<_Value>::operator[](std::string_view key) {
+  if (key.empty())
+    throw std::out_of_range("");
+  auto terminal = find_slot(key);
+  if (terminal != end_slot)
+    return value_at(terminal).get_value();
+  return emplacer(key, _Value(), false).first->get_value();
+}
+
+// ###### Iterators ######
+
+template <typename _Value>
+typename double_array_trie<_Value>::iterator
+double_array_trie<_Value>::begin() noexcept {
+  iterator it(this, 0);
+  it._key_valid = true;
+  return ++it;
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::iterator
+double_array_trie<_Value>::end() noexcept {
+  return iterator(this, end_slot);
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::const_iterator
+double_array_trie<_Value>::cbegin() const noexcept {
+  const_iterator it(this, 0);
+  it._key_valid = true;
+  return ++it;
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::const_iterator
+double_array_trie<_Value>::cend() const noexcept {
+  return const_iterator(this, end_slot);
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::reverse_iterator
+double_array_trie<_Value>::rbegin() noexcept {
+  return reverse_iterator(end());
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::reverse_iterator
+double_array_trie<_Value>::rend() noexcept {
+  return reverse_iterator(begin());
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::const_reverse_iterator
+double_array_trie<_Value>::crbegin() const noexcept {
+  return const_reverse_iterator(cend());
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::const_reverse_iterator
+double_array_trie<_Value>::crend() const noexcept {
+  return const_reverse_iterator(cbegin());
+}
+
+// ###### Capacity ######
+
+template <typename _Value>
+bool double_array_trie<_Value>::empty() const noexcept {
+  return _size == 0;
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::size_type
+double_array_trie<_Value>::size() const noexcept {
+  return _size;
+}
+
+template <typename _Value>
+std::size_t double_array_trie<_Value>::slot_count() const noexcept {
+  return _slots.size();
+}
+
+template <typename _Value>
+std::size_t double_array_trie<_Value>::memory_usage() const noexcept {
+  return _slots.capacity() * sizeof(slot) +
+         _links.capacity() * sizeof(links) +
+         _values.capacity() * sizeof(value_type) +
+         _free_values.capacity() * sizeof(std::int32_t);
+}
+
+// ###### Modifiers ######
+
+template <typename _Value> void double_array_trie<_Value>::clear() noexcept {
+  _slots.assign(1, slot{0, 0});
+  _links.assign(1, links{none, none});
+  _values.clear();
+  _free_values.clear();
+  _free_head = 0;
+  _size = 0;
+}
+
+template <typename _Value>
+std::pair<typename double_array_trie<_Value>::iterator, bool>
+double_array_trie<_Value>::insert(std::string_view key, const _Value &value) {
+  return emplacer(key, value, false);
+}
+
+template <typename _Value>
+std::pair<typename double_array_trie<_Value>::iterator, bool>
+double_array_trie<_Value>::insert(std::string_view key, _Value &&value) {
+  return emplacer(key, std::move(value), false);
+}
+
+template <typename _Value>
+std::pair<typename double_array_trie<_Value>::iterator, bool>
+double_array_trie<_Value>::insert_or_assign(std::string_view key,
+                                            const _Value &value) {
+  return emplacer(key, value, true);
+}
+
+template <typename _Value>
+std::pair<typename double_array_trie<_Value>::iterator, bool>
+double_array_trie<_Value>::insert_or_assign(std::string_view key,
+                                            _Value &&value) {
+  return emplacer(key, std::move(value), true);
+}
+
+// Erasing never moves slots, so the iterator after pos stays valid.
+template <typename _Value>
+typename double_array_trie<_Value>::iterator
+double_array_trie<_Value>::erase(iterator pos) {
+  iterator next = pos;
+  ++next;
+  remove_terminal(pos._slot);
+  return next;
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::size_type
+double_array_trie<_Value>::erase(std::string_view key) {
+  auto terminal = find_slot(key);
+  if (terminal == end_slot)
+    return 0;
+  remove_terminal(terminal);
+  return 1;
+}
+
+// Rebuilds the arrays depth first: each node's children are placed once, at
+// the lowest base where all of them fit, and the nodes along one key end up
+// close together. Values are renumbered in key order. Iterators are
+// invalidated.
+template <typename _Value> void double_array_trie<_Value>::compact() {
+  double_array_trie<_Value> packed;
+  std::vector<std::pair<std::int32_t, std::int32_t>> stack;
+  std::vector<std::uint16_t> child_list;
+  stack.emplace_back(0, 0);
+  while (!stack.empty()) {
+    auto [old_node, new_node] = stack.back();
+    stack.pop_back();
+    child_codes(old_node, child_list);
+    if (child_list.empty())
+      continue;
+    std::int32_t new_base = packed.find_base(child_list);
+    packed._slots[new_node].base = new_base;
+    for (auto it = child_list.rbegin(); it != child_list.rend(); ++it) {
+      std::uint16_t code = *it;
+      std::int32_t old_child = _slots[old_node].base + code;
+      std::int32_t new_child = new_base + code;
+      packed.take_slot(new_child);
+      packed._slots[new_child] = slot{0, new_node};
+      packed._links[new_child] = _links[old_child];
+      if (code == 0) {
+        packed._slots[new_child].base =
+            static_cast<std::int32_t>(packed._values.size());
+        packed._values.push_back(std::move(_values[_slots[old_child].base]));
+      } else {
+        stack.emplace_back(old_child, new_child);
+      }
+    }
+    packed._links[new_node].child = child_list.front();
+  }
+
+  std::size_t used = packed._slots.size();
+  while (used > 1 && packed.is_free(static_cast<std::int32_t>(used - 1)))
+    --used;
+  std::vector<std::int32_t> free_slots;
+  for (std::size_t index = 1; index < used; ++index)
+    if (packed.is_free(static_cast<std::int32_t>(index)))
+      free_slots.push_back(static_cast<std::int32_t>(index));
+  packed._slots.resize(used);
+  packed._links.resize(used);
+  packed._slots.shrink_to_fit();
+  packed._links.shrink_to_fit();
+  packed._values.shrink_to_fit();
+  packed._free_head = 0;
+  for (auto index : free_slots)
+    packed.release_slot(index);
+  packed._size = _size;
+  *this = std::move(packed);
+}
+
+// ###### Lookup ######
+
+template <typename _Value>
+typename double_array_trie<_Value>::size_type
+double_array_trie<_Value>::count(std::string_view key) const noexcept {
+  return find_slot(key) != end_slot;
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::const_iterator
+double_array_trie<_Value>::find(std::string_view key) const noexcept {
+  return const_iterator(this, find_slot(key));
+}
+
+template <typename _Value>
+typename double_array_trie<_Value>::iterator
+double_array_trie<_Value>::find(std::string_view key) noexcept {
+  return iterator(this, find_slot(key));
+}
+
+template <typename _Value>
+bool double_array_trie<_Value>::contains(std::string_view key) const
+    noexcept {
+  return count(key);
+}
+
+// Like trie, the empty key is refused: nothing is inserted and end() comes
+// back with false.
+template <typename _Value>
+template <typename _Arg>
+std::pair<typename double_array_trie<_Value>::iterator, bool>
+double_array_trie<_Value>::emplacer(std::string_view key, _Arg &&value,
+                                    bool assign) {
+  if (key.empty())
+    return {end(), false};
+  std::int32_t node = 0;
+  for (char k : key) {
+    std::int32_t child = _slots[node].base + encode(k);
+    if (_slots[node].base == 0 ||
+        static_cast<std::size_t>(child) >= _slots.size() ||
+        _slots[child].check != node)
+      child = add_child(node, encode(k));
+    node = child;
+  }
+  std::int32_t terminal = _slots[node].base;
+  if (terminal != 0 && _slots[terminal].check == node) {
+    if (assign)
+      _values[_slots[terminal].base].get_value() = std::forward<_Arg>(value);
+    return {iterator(this, terminal), false};
+  }
+
+  terminal = add_child(node, 0);
+  std::int32_t index;
+  if (_free_values.empty()) {
+    index = static_cast<std::int32_t>(_values.size());
+    _values.emplace_back();
+  } else {
+    index = _free_values.back();
+    _free_values.pop_back();
+  }
+  _values[index].get_value().emplace(std::forward<_Arg>(value));
+  _slots[terminal].base = index;
+  ++_size;
+  return {iterator(this, terminal), true};
+}
+
+// Terminal slot of key, or end_slot.
+template <typename _Value>
+std::int32_t double_array_trie<_Value>::find_slot(std::string_view key) const
+    noexcept {
+  const slot *slots = _slots.data();
+  const std::size_t slot_count = _slots.size();
+  std::int32_t node = 0;
+  for (char k : key) {
+    std::int32_t child = slots[node].base + encode(k);
+    if (static_cast<std::size_t>(child) >= slot_count ||
+        slots[child].check != node)
+      return end_slot;
+    node = child;
+  }
+  std::int32_t terminal = slots[node].base;
+  if (terminal == 0 || slots[terminal].check != node)
+    return end_slot;
+  return terminal;
+}
+
+// Adds the child under code and returns its slot, moving the existing
+// children of node when the slot is taken.
+template <typename _Value>
+std::int32_t double_array_trie<_Value>::add_child(std::int32_t node,
+                                                  std::uint16_t code) {
+  if (_slots[node].base == 0) {
+    _slots[node].base = find_base({code});
+  } else {
+    std::int32_t target = _slots[node].base + code;
+    if (static_cast<std::size_t>(target) >= _slots.size())
+      grow(target + 1);
+    if (!is_free(target)) {
+      std::vector<std::uint16_t> child_list;
+      child_codes(node, child_list);
+      child_list.insert(std::lower_bound(child_list.begin(), child_list.end(),
+                                         code),
+                        code);
+      relocate(node, find_base(child_list));
+    }
+  }
+  std::int32_t child = _slots[node].base + code;
+  take_slot(child);
+  _slots[child] = slot{0, node};
+  _links[child] = links{none, none};
+  link_child(node, code);
+  return child;
+}
+
+// Frees the terminal and its value, then every ancestor left childless.
+template <typename _Value>
+void double_array_trie<_Value>::remove_terminal(
+    std::int32_t terminal) noexcept {
+  std::int32_t index = _slots[terminal].base;
+  _values[index].get_value().reset();
+  _free_values.push_back(index);
+  --_size;
+  std::int32_t node = terminal;
+  while (node != 0 && _links[node].child == none) {
+    std::int32_t parent = _slots[node].check;
+    unlink_child(parent, code_of(node));
+    release_slot(node);
+    node = parent;
+  }
+  if (node == 0 && _links[0].child == none)
+    _slots[0].base = 0;
+}
+
+// ###### Iteration ######
+
+template <typename _Value>
+typename double_array_trie<_Value>::value_type &
+double_array_trie<_Value>::value_at(std::int32_t terminal) noexcept {
+  return _values[_slots[terminal].base];
+}
+
+template <typename _Value>
+const typename double_array_trie<_Value>::value_type &
+double_array_trie<_Value>::value_at(std::int32_t terminal) const noexcept {
+  return _values[_slots[terminal].base];
+}
+
+template <typename _Value>
+std::string double_array_trie<_Value>::key_of(std::int32_t node) const {
+  std::string key;
+  for (; node != 0; node = _slots[node].check) {
+    std::uint16_t code = code_of(node);
+    if (code != 0)
+      key += decode(code);
+  }
+  return std::string(key.rbegin(), key.rend());
+}
+
+// Next terminal after node in key order, or end_slot; key follows the path.
+template <typename _Value>
+std::int32_t double_array_trie<_Value>::next_terminal(std::int32_t node,
+                                                      std::string &key) const {
+  for (;;) {
+    if (_links[node].child != none) {
+      std::uint16_t code = _links[node].child;
+      node = _slots[node].base + code;
+      if (code == 0)
+        return node;
+      key += decode(code);
+      continue;
+    }
+    for (;;) {
+      if (node == 0)
+        return end_slot;
+      std::int32_t parent = _slots[node].check;
+      if (code_of(node) != 0)
+        key.pop_back();
+      std::uint16_t sibling = _links[node].sibling;
+      if (sibling != none) {
+        node = _slots[parent].base + sibling;
+        key += decode(sibling);
+        break;
+      }
+      node = parent;
+    }
+  }
+}
+
+// Previous terminal before node in key order, or end_slot. From end_slot it
+// is the last terminal.
+template <typename _Value>
+std::int32_t
+double_array_trie<_Value>::previous_terminal(std::int32_t node,
+                                             std::string &key) const {
+  if (node == end_slot) {
+    key.clear();
+    node = last_descendant(0, key);
+    return node == 0 ? end_slot : node;
+  }
+  for (;;) {
+    if (node == 0)
+      return end_slot;
+    std::int32_t parent = _slots[node].check;
+    std::uint16_t code = code_of(node);
+    if (code != 0)
+      key.pop_back();
+    std::uint16_t previous = none;
+    for (std::uint16_t c = _links[parent].child; c != code;
+         c = _links[_slots[parent].base + c].sibling)
+      previous = c;
+    if (previous == none) {
+      node = parent;
+      continue;
+    }
+    if (previous != 0)
+      key += decode(previous);
+    node = last_descendant(_slots[parent].base + previous, key);
+    if (code_of(node) == 0)
+      return node;
+  }
+}
+
+// Last node in pre-order under node; it is a terminal unless node is an
+// empty root.
+template <typename _Value>
+std::int32_t
+double_array_trie<_Value>::last_descendant(std::int32_t node,
+                                           std::string &key) const {
+  while (_links[node].child != none) {
+    std::uint16_t code = _links[node].child;
+    while (_links[_slots[node].base + code].sibling != none)
+      code = _links[_slots[node].base + code].sibling;
+    node = _slots[node].base + code;
+    if (code != 0)
+      key += decode(code);
+  }
+  return node;
+}
+
+// ###### Slots ######
+
+template <typename _Value>
+std::uint16_t double_array_trie<_Value>::encode(char key) noexcept {
+  return static_cast<std::uint16_t>(static_cast<signed char>(key) + 129);
+}
+
+template <typename _Value>
+char double_array_trie<_Value>::decode(std::uint16_t code) noexcept {
+  return static_cast<char>(static_cast<signed char>(code - 129));
+}
+
+template <typename _Value>
+std::uint16_t double_array_trie<_Value>::code_of(std::int32_t node) const
+    noexcept {
+  return static_cast<std::uint16_t>(node - _slots[_slots[node].check].base);
+}
+
+template <typename _Value>
+bool double_array_trie<_Value>::is_free(std::int32_t index) const noexcept {
+  return _slots[index].check < 0;
+}
+
+// New slots join the end of the free list.
+template <typename _Value>
+void double_array_trie<_Value>::grow(std::size_t new_size) {
+  std::size_t old_size = _slots.size();
+  new_size = std::max(new_size, old_size + old_size / 2);
+  if (new_size > static_cast<std::size_t>(INT32_MAX))
+    throw std::length_error("double_array_trie too large");
+  _slots.resize(new_size);
+  _links.resize(new_size, links{none, none});
+  for (std::size_t index = old_size; index < new_size; ++index)
+    release_slot(static_cast<std::int32_t>(index));
+}
+
+template <typename _Value>
+void double_array_trie<_Value>::take_slot(std::int32_t index) noexcept {
+  std::int32_t next = -_slots[index].check;
+  std::int32_t previous = -_slots[index].base;
+  if (next == index) {
+    _free_head = 0;
+  } else {
+    _slots[previous].check = -next;
+    _slots[next].base = -previous;
+    if (_free_head == index)
+      _free_head = next;
+  }
+}
+
+template <typename _Value>
+void double_array_trie<_Value>::release_slot(std::int32_t index) noexcept {
+  _links[index] = links{none, none};
+  if (_free_head == 0) {
+    _slots[index] = slot{-index, -index};
+    _free_head = index;
+    return;
+  }
+  std::int32_t last = -_slots[_free_head].base;
+  _slots[last].check = -index;
+  _slots[index] = slot{-last, -_free_head};
+  _slots[_free_head].base = -index;
+}
+
+// Lowest base on the free list at which every code lands on a free slot,
+// growing the arrays when none does.
+template <typename _Value>
+std::int32_t double_array_trie<_Value>::find_base(
+    const std::vector<std::uint16_t> &child_list) {
+  std::uint16_t first = child_list.front();
+  if (_free_head != 0) {
+    std::int32_t index = _free_head;
+    do {
+      std::int32_t base = index - first;
+      if (base >= 1) {
+        if (static_cast<std::size_t>(base) + codes > _slots.size())
+          grow(base + codes);
+        bool fits = true;
+        for (auto code : child_list) {
+          if (!is_free(base + code)) {
+            fits = false;
+            break;
+          }
+        }
+        if (fits)
+          return base;
+      }
+      index = -_slots[index].check;
+    } while (index != _free_head);
+  }
+  std::int32_t base =
+      std::max<std::int32_t>(1, static_cast<std::int32_t>(_slots.size()) -
+                                    first);
+  grow(base + codes);
+  return base;
+}
+
+template <typename _Value>
+void double_array_trie<_Value>::child_codes(
+    std::int32_t node, std::vector<std::uint16_t> &out) const {
+  out.clear();
+  for (std::uint16_t code = _links[node].child; code != none;
+       code = _links[_slots[node].base + code].sibling)
+    out.push_back(code);
+}
+
+// Keeps the sibling list sorted by code.
+template <typename _Value>
+void double_array_trie<_Value>::link_child(std::int32_t node,
+                                           std::uint16_t code) noexcept {
+  std::int32_t base = _slots[node].base;
+  std::uint16_t *position = &_links[node].child;
+  while (*position != none && *position < code)
+    position = &_links[base + *position].sibling;
+  _links[base + code].sibling = *position;
+  *position = code;
+}
+
+template <typename _Value>
+void double_array_trie<_Value>::unlink_child(std::int32_t node,
+                                             std::uint16_t code) noexcept {
+  std::int32_t base = _slots[node].base;
+  std::uint16_t *position = &_links[node].child;
+  while (*position != code)
+    position = &_links[base + *position].sibling;
+  *position = _links[base + code].sibling;
+}
+
+// Moves the children of node to new_base, pointing their own children at
+// the new slots. Every target slot must be free.
+template <typename _Value>
+void double_array_trie<_Value>::relocate(std::int32_t node,
+                                         std::int32_t new_base) noexcept {
+  std::int32_t old_base = _slots[node].base;
+  for (std::uint16_t code = _links[node].child; code != none;) {
+    std::int32_t old_child = old_base + code;
+    std::int32_t new_child = new_base + code;
+    take_slot(new_child);
+    _slots[new_child] = _slots[old_child];
+    _links[new_child] = _links[old_child];
+    if (code != 0) {
+      std::int32_t base = _slots[old_child].base;
+      for (std::uint16_t grandchild = _links[old_child].child;
+           grandchild != none; grandchild = _links[base + grandchild].sibling)
+        _slots[base + grandchild].check = new_child;
+    }
+    code = _links[old_child].sibling;
+    release_slot(old_child);
+  }
+  _slots[node].base = new_base;
+}
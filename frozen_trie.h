@@ -0,0 +1,553 @@
+#pragma once
+
+#include "trie_node.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bitvector with rank of ones and select of zeros, the two operations the
+// LOUDS encoding needs. Ones are counted per 512-bit block and every 512th
+// zero records its block, which adds about 7% to the bits.
+class trie_bitvector {
+public:
+  void push_back(bool bit);
+  void build();
+
+  bool get(std::size_t position) const noexcept;
+  std::size_t size() const noexcept;
+  std::size_t rank1(std::size_t position) const noexcept;
+  std::size_t select0(std::size_t k) const noexcept;
+  std::size_t next0(std::size_t position) const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+private:
+  static constexpr std::size_t block_bits = 512;
+  static constexpr std::size_t block_words = block_bits / 64;
+
+  std::vector<std::uint64_t> _words;
+  std::vector<std::uint32_t> _ranks;
+  std::vector<std::uint32_t> _zero_samples;
+  std::size_t _size = 0;
+
+  static unsigned int select_in_word(std::uint64_t word,
+                                     unsigned int k) noexcept;
+};
+
+// Immutable trie in the LOUDS (level-order unary degree sequence) encoding,
+// built by trie::freeze(). Nodes are numbered in breadth-first order and
+// every node appends one 1 per child and a terminating 0 to one bitvector,
+// so the children of node v are the consecutive nodes
+// select0(v - 1) - v + 2 up to the one before select0(v) - v + 1. Each node
+// stores the character leading to it in a byte array indexed by node, a
+// second bitvector marks the nodes that hold a value and its rank indexes a
+// dense value array. Compressed labels are expanded to one node per
+// character.
+//
+// A node whose subtree is a single chain down to one value becomes a leaf
+// that keeps the rest of the chain as a tail string; a third bitvector
+// marks those leaves and its rank indexes the tail offsets. Lookups then
+// take one LOUDS step per branching character and compare the unique
+// suffix of a key in one go, and a node costs well under 2 bytes plus its
+// value.
+//
+// Iterators go depth first over the breadth-first numbering, in key order,
+// with a stack of the nodes still to visit and the key length of their
+// parent.
+template <typename _Value> class frozen_trie {
+public:
+  using key_type = std::string;
+  using value_type = _Value;
+  using size_type = std::size_t;
+
+  class trie_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = _Value;
+    using pointer = const _Value *;
+    using reference = const _Value &;
+
+    reference operator*() const { return *_value; }
+    pointer operator->() const { return _value; }
+    std::string_view key() const noexcept { return _key; }
+
+    trie_iterator &operator++() {
+      advance();
+      return *this;
+    }
+    trie_iterator operator++(int) {
+      trie_iterator t = *this;
+      ++(*this);
+      return t;
+    }
+
+    friend bool operator==(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1._value == it2._value;
+    }
+    friend bool operator!=(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1._value != it2._value;
+    }
+
+  private:
+    friend class frozen_trie<_Value>;
+
+    const frozen_trie<_Value> *_trie;
+    std::size_t _start;
+    std::vector<std::pair<std::size_t, std::size_t>> _stack;
+    std::string _key;
+    const _Value *_value;
+
+    explicit trie_iterator(const frozen_trie<_Value> *owner)
+        : _trie(owner), _start(npos), _value(nullptr) {}
+    trie_iterator(const frozen_trie<_Value> *owner, std::size_t start,
+                  std::string key)
+        : _trie(owner), _start(start), _key(std::move(key)) {
+      _stack.emplace_back(start, _key.length());
+      advance();
+    }
+
+    // Pops nodes until one holds a value, queueing the children of each.
+    void advance() {
+      while (!_stack.empty()) {
+        auto [node, length] = _stack.back();
+        _stack.pop_back();
+        _key.resize(length);
+        if (node != _start) {
+          _key += _trie->_labels[node];
+          _key.append(_trie->tail(node));
+        }
+        auto range = _trie->children(node);
+        for (std::size_t child = range.second; child > range.first; --child)
+          _stack.emplace_back(child - 1, _key.length());
+        if (_trie->_has_value.get(node)) {
+          _value = &_trie->_values[_trie->_has_value.rank1(node)];
+          return;
+        }
+      }
+      _value = nullptr;
+    }
+  };
+
+  using iterator = trie_iterator;
+  using const_iterator = trie_iterator;
+
+  explicit frozen_trie(const trie_node<_Value> *root);
+
+  // ###### Element access ######
+  const _Value &at(std::string_view key) const;
+
+  // ###### Iterators ######
+  const_iterator begin() const;
+  const_iterator end() const;
+  std::pair<const_iterator, const_iterator>
+  prefix_range(std::string_view prefix) const;
+
+  // ###### Capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t node_count() const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+  // ###### Lookup ######
+  const _Value *find(std::string_view key) const noexcept;
+  size_type count(std::string_view key) const noexcept;
+  bool contains(std::string_view key) const noexcept;
+  template <typename _Function> void for_each(_Function function) const;
+  template <typename _Function>
+  void for_each_prefix(std::string_view prefix, _Function function) const;
+
+private:
+  static constexpr std::size_t npos = ~std::size_t(0);
+
+  trie_bitvector _louds;
+  trie_bitvector _has_value;
+  trie_bitvector _has_tail;
+  std::vector<char> _labels;
+  std::vector<_Value> _values;
+  std::vector<std::uint32_t> _tail_offsets;
+  std::string _tails;
+
+  std::pair<std::size_t, std::size_t> children(std::size_t node) const
+      noexcept;
+  std::size_t find_child(std::size_t node, char key) const noexcept;
+  std::string_view tail(std::size_t node) const noexcept;
+  std::size_t descend(std::string_view key, std::size_t &matched) const
+      noexcept;
+
+  // ###### Utilities ######
+  static const trie_node<_Value> *single_path(const trie_node<_Value> *node,
+                                              std::string &tail);
+};
+
+// ###### trie_bitvector ######
+
+inline void trie_bitvector::push_back(bool bit) {
+  if (_size % 64 == 0)
+    _words.push_back(0);
+  if (bit)
+    _words.back() |= std::uint64_t(1) << (_size % 64);
+  ++_size;
+}
+
+// Fills the rank and select directories; call once after the last bit.
+inline void trie_bitvector::build() {
+  _ranks.clear();
+  _zero_samples.clear();
+  std::size_t ones = 0;
+  for (std::size_t word = 0; word < _words.size(); ++word) {
+    if (word % block_words == 0)
+      _ranks.push_back(static_cast<std::uint32_t>(ones));
+    std::size_t zeros_before = word * 64 - ones;
+    std::size_t bits = std::min<std::size_t>(64, _size - word * 64);
+    std::size_t zeros = bits - __builtin_popcountll(_words[word]);
+    for (std::size_t z = (zeros_before + block_bits - 1) / block_bits *
+                         block_bits;
+         z < zeros_before + zeros; z += block_bits)
+      _zero_samples.push_back(static_cast<std::uint32_t>(word / block_words));
+    ones += __builtin_popcountll(_words[word]);
+  }
+  _ranks.push_back(static_cast<std::uint32_t>(ones));
+}
+
+inline bool trie_bitvector::get(std::size_t position) const noexcept {
+  return (_words[position / 64] >> (position % 64)) & 1;
+}
+
+inline std::size_t trie_bitvector::size() const noexcept { return _size; }
+
+// Ones in [0, position).
+inline std::size_t trie_bitvector::rank1(std::size_t position) const
+    noexcept {
+  std::size_t word = position / 64;
+  std::size_t rank = _ranks[word / block_words];
+  for (std::size_t w = word / block_words * block_words; w < word; ++w)
+    rank += __builtin_popcountll(_words[w]);
+  if (position % 64 != 0)
+    rank += __builtin_popcountll(_words[word] << (64 - position % 64));
+  return rank;
+}
+
+// Position of the k-th zero, counting from 0; k must be in range.
+inline std::size_t trie_bitvector::select0(std::size_t k) const noexcept {
+  std::size_t block = _zero_samples[k / block_bits];
+  while (block + 1 < _ranks.size() &&
+         (block + 1) * block_bits - _ranks[block + 1] <= k)
+    ++block;
+  std::size_t word = block * block_words;
+  std::size_t zeros = block * block_bits - _ranks[block];
+  for (;; ++word) {
+    std::size_t in_word = 64 - __builtin_popcountll(_words[word]);
+    if (zeros + in_word > k)
+      break;
+    zeros += in_word;
+  }
+  return word * 64 +
+         select_in_word(~_words[word], static_cast<unsigned int>(k - zeros));
+}
+
+// Position of the first zero at or after position; there must be one.
+inline std::size_t trie_bitvector::next0(std::size_t position) const
+    noexcept {
+  std::size_t word = position / 64;
+  std::uint64_t zeros = ~_words[word] >> (position % 64);
+  if (zeros != 0)
+    return position + __builtin_ctzll(zeros);
+  while ((zeros = ~_words[++word]) == 0)
+    ;
+  return word * 64 + __builtin_ctzll(zeros);
+}
+
+inline std::size_t trie_bitvector::memory_usage() const noexcept {
+  return _words.size() * sizeof(std::uint64_t) +
+         (_ranks.size() + _zero_samples.size()) * sizeof(std::uint32_t);
+}
+
+// Skips whole bytes by popcount, then clears the low set bits of the byte
+// that holds the k-th one.
+inline unsigned int trie_bitvector::select_in_word(std::uint64_t word,
+                                                   unsigned int k) noexcept {
+  unsigned int shift = 0;
+  for (;; shift += 8) {
+    unsigned int ones = __builtin_popcount((word >> shift) & 0xff);
+    if (ones > k)
+      break;
+    k -= ones;
+  }
+  unsigned int byte = (word >> shift) & 0xff;
+  for (; k > 0; --k)
+    byte &= byte - 1;
+  return shift + __builtin_ctz(byte);
+}
+
+// ###### frozen_trie ######
+
+// Walks the trie breadth first, expanding every label into a chain of
+// single-character nodes. A queue entry is a trie node, how much of its
+// label has been emitted and whether it may head a tail. A node that does
+// not, and has no value and one child, passes its branch down to the child,
+// so every chain is walked once.
+template <typename _Value>
+frozen_trie<_Value>::frozen_trie(const trie_node<_Value> *root) {
+  struct entry {
+    const trie_node<_Value> *node;
+    std::size_t emitted;
+    bool check;
+  };
+  std::vector<entry> queue;
+  queue.push_back({root, 0, false});
+  _labels.push_back('\0');
+  _tail_offsets.push_back(0);
+  std::string chain;
+  for (std::size_t head = 0; head < queue.size(); ++head) {
+    auto [current_node, emitted, check] = queue[head];
+    std::string_view label = current_node->get_label();
+    if (check) {
+      auto last = single_path(current_node, chain);
+      if (last != nullptr && !chain.empty()) {
+        _values.push_back(*last->get_value());
+        _has_value.push_back(true);
+        _has_tail.push_back(true);
+        _tails += chain;
+        _tail_offsets.push_back(static_cast<std::uint32_t>(_tails.size()));
+        _louds.push_back(false);
+        continue;
+      }
+    }
+    if (emitted < label.length()) {
+      queue.push_back({current_node, emitted + 1, false});
+      _labels.push_back(label[emitted]);
+      _louds.push_back(true);
+      _has_value.push_back(false);
+    } else {
+      bool valued = current_node->get_value().has_value();
+      bool check_children =
+          head == 0 || valued || current_node->children_count() != 1;
+      current_node->for_each_child([&](const trie_node<_Value> *child) {
+        queue.push_back({child, 0, check_children});
+        _labels.push_back(child->get_node_key());
+        _louds.push_back(true);
+      });
+      if (valued)
+        _values.push_back(*current_node->get_value());
+      _has_value.push_back(valued);
+    }
+    _has_tail.push_back(false);
+    _louds.push_back(false);
+  }
+  if (_tails.size() >= ~std::uint32_t(0))
+    throw std::length_error("frozen_trie tails too large");
+  _louds.build();
+  _has_value.build();
+  _has_tail.build();
+}
+
+// ###### Element access ######
+
+template <typename _Value>
+const _Value &frozen_trie<_Value>::at(std::string_view key) const {
+  auto value = find(key);
+  if (value == nullptr)
+    throw std::out_of_range("");
+  return *value;
+}
+
+// ###### Iterators ######
+
+template <typename _Value>
+typename frozen_trie<_Value>::const_iterator
+frozen_trie<_Value>::begin() const {
+  return const_iterator(this, 0, std::string());
+}
+
+template <typename _Value>
+typename frozen_trie<_Value>::const_iterator frozen_trie<_Value>::end() const {
+  return const_iterator(this);
+}
+
+// The elements whose key starts with prefix, in key order.
+template <typename _Value>
+std::pair<typename frozen_trie<_Value>::const_iterator,
+          typename frozen_trie<_Value>::const_iterator>
+frozen_trie<_Value>::prefix_range(std::string_view prefix) const {
+  std::size_t matched = 0;
+  std::size_t start = descend(prefix, matched);
+  if (start == npos)
+    return {end(), end()};
+  std::string key(prefix);
+  key.append(tail(start).substr(matched));
+  return {const_iterator(this, start, std::move(key)), end()};
+}
+
+// ###### Capacity ######
+
+template <typename _Value> bool frozen_trie<_Value>::empty() const noexcept {
+  return size() == 0;
+}
+
+template <typename _Value>
+typename frozen_trie<_Value>::size_type frozen_trie<_Value>::size() const
+    noexcept {
+  return _values.size();
+}
+
+template <typename _Value>
+std::size_t frozen_trie<_Value>::node_count() const noexcept {
+  return _labels.size();
+}
+
+// Bytes held by the encoding, values included.
+template <typename _Value>
+std::size_t frozen_trie<_Value>::memory_usage() const noexcept {
+  return _louds.memory_usage() + _has_value.memory_usage() +
+         _has_tail.memory_usage() + _labels.size() +
+         _tail_offsets.size() * sizeof(std::uint32_t) + _tails.size() +
+         _values.size() * sizeof(_Value);
+}
+
+// ###### Lookup ######
+
+template <typename _Value>
+const _Value *frozen_trie<_Value>::find(std::string_view key) const noexcept {
+  std::size_t matched = 0;
+  std::size_t node = descend(key, matched);
+  if (key.empty() || node == npos || !_has_value.get(node) ||
+      matched != tail(node).length())
+    return nullptr;
+  return &_values[_has_value.rank1(node)];
+}
+
+template <typename _Value>
+typename frozen_trie<_Value>::size_type
+frozen_trie<_Value>::count(std::string_view key) const noexcept {
+  return find(key) != nullptr;
+}
+
+template <typename _Value>
+bool frozen_trie<_Value>::contains(std::string_view key) const noexcept {
+  return count(key);
+}
+
+// Calls function(key, value) for every element in key order.
+template <typename _Value>
+template <typename _Function>
+void frozen_trie<_Value>::for_each(_Function function) const {
+  for_each_prefix("", function);
+}
+
+// The same walk as the iterators, kept inline so the callback needs no
+// iterator state between elements.
+template <typename _Value>
+template <typename _Function>
+void frozen_trie<_Value>::for_each_prefix(std::string_view prefix,
+                                          _Function function) const {
+  std::size_t matched = 0;
+  std::size_t start = descend(prefix, matched);
+  if (start == npos)
+    return;
+  std::string key(prefix);
+  key.append(tail(start).substr(matched));
+  std::vector<std::pair<std::size_t, std::size_t>> stack;
+  stack.emplace_back(start, key.length());
+  while (!stack.empty()) {
+    auto [node, length] = stack.back();
+    stack.pop_back();
+    key.resize(length);
+    if (node != start) {
+      key += _labels[node];
+      key.append(tail(node));
+    }
+    if (_has_value.get(node))
+      function(std::string_view(key), _values[_has_value.rank1(node)]);
+    auto range = children(node);
+    for (std::size_t child = range.second; child > range.first; --child)
+      stack.emplace_back(child - 1, key.length());
+  }
+}
+
+// First child and one past the last child of node.
+template <typename _Value>
+std::pair<std::size_t, std::size_t>
+frozen_trie<_Value>::children(std::size_t node) const noexcept {
+  std::size_t begin = node == 0 ? 0 : _louds.select0(node - 1) + 1;
+  std::size_t end = _louds.next0(begin);
+  return {begin - node + 1, end - node + 1};
+}
+
+template <typename _Value>
+std::size_t frozen_trie<_Value>::find_child(std::size_t node, char key) const
+    noexcept {
+  auto range = children(node);
+  const char *first = _labels.data() + range.first;
+  const char *last = _labels.data() + range.second;
+  const char *position;
+  if (range.second - range.first <= 16)
+    position = std::find(first, last, key);
+  else
+    position = std::lower_bound(first, last, key, [](char a, char b) {
+      return static_cast<signed char>(a) < static_cast<signed char>(b);
+    });
+  if (position == last || *position != key)
+    return npos;
+  return position - _labels.data();
+}
+
+template <typename _Value>
+std::string_view frozen_trie<_Value>::tail(std::size_t node) const noexcept {
+  if (!_has_tail.get(node))
+    return std::string_view();
+  std::size_t index = _has_tail.rank1(node);
+  return std::string_view(_tails.data() + _tail_offsets[index],
+                          _tail_offsets[index + 1] - _tail_offsets[index]);
+}
+
+// Returns the node reached by key, or npos. The key may end inside the tail
+// of a leaf; matched is then the number of tail characters it covers.
+template <typename _Value>
+std::size_t frozen_trie<_Value>::descend(std::string_view key,
+                                         std::size_t &matched) const noexcept {
+  std::size_t node = 0;
+  matched = 0;
+  for (std::size_t position = 0; position < key.length();) {
+    node = find_child(node, key[position++]);
+    if (node == npos)
+      return npos;
+    if (_has_tail.get(node)) {
+      std::string_view rest = key.substr(position);
+      std::string_view suffix = tail(node);
+      if (rest.length() > suffix.length() ||
+          suffix.compare(0, rest.length(), rest) != 0)
+        return npos;
+      matched = rest.length();
+      return node;
+    }
+  }
+  return node;
+}
+
+// ###### Utilities ######
+
+// Returns the node holding the only value under node if the subtree is one
+// chain ending in that value, with the characters below node in tail;
+// nullptr otherwise.
+template <typename _Value>
+const trie_node<_Value> *
+frozen_trie<_Value>::single_path(const trie_node<_Value> *node,
+                                 std::string &tail) {
+  tail.assign(node->get_label());
+  for (;;) {
+    unsigned int children = node->children_count();
+    if (node->get_value().has_value())
+      return children == 0 ? node : nullptr;
+    if (children != 1)
+      return nullptr;
+    node = node->get_first_child();
+    tail += node->get_node_key();
+    tail.append(node->get_label());
+  }
+}
@@ -0,0 +1,669 @@
+#pragma once
+
+#include "trie_node.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Read-only trie over a flat image written by trie::save(). The image holds
+// no pointers: nodes are stored in pre-order in one array and refer to their
+// children, labels and values by index, so the file is mmap()ed as it is and
+// queried in place without parsing or allocating per node. Opening costs
+// the same whatever the size of the trie; pages are read as lookups touch
+// them.
+//
+// Each node records the end of its subtree in the array and the number of
+// values stored before it in pre-order. A node has a value when the next
+// node's value_begin is larger, and the values of a subtree are the
+// contiguous range [value_begin, nodes[subtree_end].value_begin); a sentinel
+// node after the last one closes the ranges. Child keys of a node are stored
+// sorted like signed chars next to each other, as are their node indices.
+//
+// Iterators walk the node array in that same pre-order, which is key order,
+// and rebuild the key from one frame per open node on the way.
+//
+// Values must be trivially copyable. The image uses the byte order and
+// layout of the machine that wrote it; the header is checked on load but
+// node contents are trusted.
+template <typename _Value> class mapped_trie {
+public:
+  using key_type = std::string;
+  using value_type = _Value;
+  using size_type = std::size_t;
+
+  class trie_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = _Value;
+    using pointer = const _Value *;
+    using reference = const _Value &;
+
+    reference operator*() const {
+      return _trie->_values[_trie->_nodes[index()].value_begin];
+    }
+    pointer operator->() const { return &**this; }
+    std::string_view key() const noexcept { return _key; }
+
+    trie_iterator &operator++() {
+      do
+        step();
+      while (!_frames.empty() && !_trie->has_value(index()));
+      return *this;
+    }
+    trie_iterator operator++(int) {
+      trie_iterator t = *this;
+      ++(*this);
+      return t;
+    }
+
+    friend bool operator==(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1.index() == it2.index();
+    };
+    friend bool operator!=(const trie_iterator &it1, const trie_iterator &it2) {
+      return it1.index() != it2.index();
+    };
+
+  private:
+    friend class mapped_trie<_Value>;
+
+    // A node on the path from the first node to the current one, the next
+    // of its edges to follow and the key length at the node.
+    struct frame {
+      std::uint32_t index;
+      std::uint32_t edge;
+      std::size_t key_length;
+    };
+
+    const mapped_trie<_Value> *_trie;
+    std::vector<frame> _frames;
+    std::string _key;
+
+    explicit trie_iterator(const mapped_trie<_Value> *owner) : _trie(owner) {}
+    trie_iterator(const mapped_trie<_Value> *owner, std::uint32_t first,
+                  std::string key)
+        : _trie(owner), _key(std::move(key)) {
+      _frames.push_back(
+          {first, _trie->_nodes[first].child_begin, _key.length()});
+      if (!_trie->has_value(first))
+        ++(*this);
+    }
+
+    std::uint32_t index() const noexcept {
+      return _frames.empty() ? npos : _frames.back().index;
+    }
+
+    // Moves to the next node in pre-order below the first one, if any.
+    void step() {
+      while (!_frames.empty()) {
+        frame &top = _frames.back();
+        const node &current_node = _trie->_nodes[top.index];
+        if (top.edge < current_node.child_begin + current_node.child_count) {
+          std::uint32_t child = _trie->_targets[top.edge];
+          _key.resize(top.key_length);
+          _key += _trie->_keys[top.edge++];
+          _key.append(_trie->label(child));
+          _frames.push_back(
+              {child, _trie->_nodes[child].child_begin, _key.length()});
+          return;
+        }
+        _frames.pop_back();
+      }
+    }
+  };
+
+  using iterator = trie_iterator;
+  using const_iterator = trie_iterator;
+
+  explicit mapped_trie(const std::string &path);
+  mapped_trie(const mapped_trie<_Value> &other_trie) = delete;
+  mapped_trie(mapped_trie<_Value> &&other_trie) noexcept;
+  mapped_trie<_Value> &operator=(const mapped_trie<_Value> &other_trie) =
+      delete;
+  mapped_trie<_Value> &operator=(mapped_trie<_Value> &&other_trie) noexcept;
+  ~mapped_trie() noexcept;
+
+  static void save(const trie_node<_Value> *root, const std::string &path);
+
+  // ###### Element access ######
+  const _Value &at(std::string_view key) const;
+
+  // ###### Iterators ######
+  const_iterator begin() const;
+  const_iterator end() const;
+  std::pair<const_iterator, const_iterator>
+  prefix_range(std::string_view prefix) const;
+
+  // ###### Capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t node_count() const noexcept;
+  std::size_t image_size() const noexcept;
+
+  // ###### Lookup ######
+  const _Value *find(std::string_view key) const noexcept;
+  size_type count(std::string_view key) const noexcept;
+  bool contains(std::string_view key) const noexcept;
+  size_type count_prefix(std::string_view prefix) const noexcept;
+  template <typename _Function> void for_each(_Function function) const;
+  template <typename _Function>
+  void for_each_prefix(std::string_view prefix, _Function function) const;
+
+private:
+  static constexpr char magic[8] = {'T', 'R', 'I', 'E', 'I', 'M', 'G', '\0'};
+  static constexpr std::uint32_t version = 1;
+  static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+  struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t value_size;
+    std::uint32_t value_align;
+    std::uint32_t node_count;
+    std::uint32_t value_count;
+    std::uint32_t edge_count;
+    std::uint64_t label_bytes;
+    std::uint64_t nodes_offset;
+    std::uint64_t targets_offset;
+    std::uint64_t values_offset;
+    std::uint64_t keys_offset;
+    std::uint64_t labels_offset;
+    std::uint64_t file_size;
+  };
+
+  struct node {
+    std::uint32_t subtree_end;
+    std::uint32_t value_begin;
+    std::uint32_t child_begin;
+    std::uint32_t child_count;
+    std::uint32_t label_offset;
+    std::uint32_t label_length;
+  };
+
+  // The image while it is built by save().
+  struct builder {
+    std::vector<node> nodes;
+    std::vector<std::uint32_t> targets;
+    std::vector<_Value> values;
+    std::vector<char> keys;
+    std::string labels;
+  };
+
+  void *_map;
+  std::size_t _length;
+  const header *_header;
+  const node *_nodes;
+  const std::uint32_t *_targets;
+  const _Value *_values;
+  const char *_keys;
+  const char *_labels;
+
+  std::uint32_t descend(std::string_view key, std::size_t &overshoot) const
+      noexcept;
+  std::uint32_t find_child(std::uint32_t index, char key) const noexcept;
+  bool has_value(std::uint32_t index) const noexcept;
+  std::string_view label(std::uint32_t index) const noexcept;
+
+  // ###### Utilities ######
+  static std::uint32_t add_node(const trie_node<_Value> *current_node,
+                                builder &image);
+  static std::uint64_t align(std::uint64_t offset,
+                             std::uint64_t alignment) noexcept;
+  static void write_all(int fd, const void *data, std::size_t length,
+                        const std::string &path);
+  static void write_padding(int fd, std::size_t length,
+                            const std::string &path);
+  static void sync_directory(const std::string &path);
+  template <typename _Function>
+  void walk(std::uint32_t index, std::string &key, _Function &function) const;
+};
+
+// ###### mapped_trie ######
+
+template <typename _Value>
+mapped_trie<_Value>::mapped_trie(const std::string &path) {
+  static_assert(std::is_trivially_copyable<_Value>::value,
+                "mapped_trie values must be trivially copyable");
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), path);
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  _length = static_cast<std::size_t>(status.st_size);
+  if (_length < sizeof(header)) {
+    ::close(fd);
+    throw std::runtime_error(path + ": not a trie image");
+  }
+  _map = ::mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (_map == MAP_FAILED)
+    throw std::system_error(error, std::generic_category(), path);
+
+  auto base = static_cast<const char *>(_map);
+  _header = reinterpret_cast<const header *>(base);
+  const header &h = *_header;
+  std::uint64_t nodes = std::uint64_t(h.node_count) + 1;
+  bool valid =
+      std::memcmp(h.magic, magic, sizeof(magic)) == 0 &&
+      h.version == version && h.value_size == sizeof(_Value) &&
+      h.value_align == alignof(_Value) && h.node_count > 0 &&
+      h.file_size == _length &&
+      h.nodes_offset + nodes * sizeof(node) <= h.targets_offset &&
+      h.targets_offset + h.edge_count * sizeof(std::uint32_t) <=
+          h.values_offset &&
+      h.values_offset % alignof(_Value) == 0 &&
+      h.values_offset + std::uint64_t(h.value_count) * sizeof(_Value) <=
+          h.keys_offset &&
+      h.keys_offset + h.edge_count <= h.labels_offset &&
+      h.labels_offset + h.label_bytes <= h.file_size;
+  if (!valid) {
+    ::munmap(_map, _length);
+    throw std::runtime_error(path + ": not a trie image for this type");
+  }
+  _nodes = reinterpret_cast<const node *>(base + h.nodes_offset);
+  _targets = reinterpret_cast<const std::uint32_t *>(base + h.targets_offset);
+  _values = reinterpret_cast<const _Value *>(base + h.values_offset);
+  _keys = base + h.keys_offset;
+  _labels = base + h.labels_offset;
+}
+
+template <typename _Value>
+mapped_trie<_Value>::mapped_trie(mapped_trie<_Value> &&other_trie) noexcept
+    : _map(other_trie._map), _length(other_trie._length),
+      _header(other_trie._header), _nodes(other_trie._nodes),
+      _targets(other_trie._targets), _values(other_trie._values),
+      _keys(other_trie._keys), _labels(other_trie._labels) {
+  other_trie._map = nullptr;
+}
+
+template <typename _Value>
+mapped_trie<_Value> &
+mapped_trie<_Value>::operator=(mapped_trie<_Value> &&other_trie) noexcept {
+  if (this != &other_trie) {
+    if (_map != nullptr)
+      ::munmap(_map, _length);
+    _map = other_trie._map;
+    _length = other_trie._length;
+    _header = other_trie._header;
+    _nodes = other_trie._nodes;
+    _targets = other_trie._targets;
+    _values = other_trie._values;
+    _keys = other_trie._keys;
+    _labels = other_trie._labels;
+    other_trie._map = nullptr;
+  }
+  return *this;
+}
+
+// A moved-from mapped_trie may only be destroyed or assigned to.
+template <typename _Value> mapped_trie<_Value>::~mapped_trie() noexcept {
+  if (_map != nullptr)
+    ::munmap(_map, _length);
+}
+
+// Writes the subtree under root as an image. The image is written and
+// synced to a file of its own next to path and renamed over it, so
+// processes that still map the old file keep reading it instead of faulting
+// on truncated pages, and concurrent saves to one path do not share a
+// temporary file. The directory is synced last to make the rename durable.
+template <typename _Value>
+void mapped_trie<_Value>::save(const trie_node<_Value> *root,
+                               const std::string &path) {
+  static_assert(std::is_trivially_copyable<_Value>::value,
+                "mapped_trie values must be trivially copyable");
+  builder image;
+  add_node(root, image);
+  if (image.nodes.size() >= npos || image.labels.size() >= npos)
+    throw std::length_error("trie too large for an image");
+  node sentinel = {};
+  sentinel.value_begin = static_cast<std::uint32_t>(image.values.size());
+  image.nodes.push_back(sentinel);
+
+  header h = {};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.value_size = sizeof(_Value);
+  h.value_align = alignof(_Value);
+  h.node_count = static_cast<std::uint32_t>(image.nodes.size() - 1);
+  h.value_count = static_cast<std::uint32_t>(image.values.size());
+  h.edge_count = static_cast<std::uint32_t>(image.keys.size());
+  h.label_bytes = image.labels.size();
+  h.nodes_offset = align(sizeof(header), alignof(node));
+  h.targets_offset = h.nodes_offset + image.nodes.size() * sizeof(node);
+  h.values_offset =
+      align(h.targets_offset + image.targets.size() * sizeof(std::uint32_t),
+            alignof(_Value));
+  h.keys_offset = h.values_offset + image.values.size() * sizeof(_Value);
+  h.labels_offset = h.keys_offset + image.keys.size();
+  h.file_size = h.labels_offset + image.labels.size();
+
+  std::string temporary = path + ".XXXXXX";
+  int fd = ::mkstemp(&temporary[0]);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), temporary);
+  try {
+    if (::fchmod(fd, 0644) != 0)
+      throw std::system_error(errno, std::generic_category(), temporary);
+    write_all(fd, &h, sizeof(h), path);
+    write_padding(fd, h.nodes_offset - sizeof(h), path);
+    write_all(fd, image.nodes.data(), image.nodes.size() * sizeof(node), path);
+    write_all(fd, image.targets.data(),
+              image.targets.size() * sizeof(std::uint32_t), path);
+    write_padding(fd,
+                  h.values_offset - h.targets_offset -
+                      image.targets.size() * sizeof(std::uint32_t),
+                  path);
+    write_all(fd, image.values.data(), image.values.size() * sizeof(_Value),
+              path);
+    write_all(fd, image.keys.data(), image.keys.size(), path);
+    write_all(fd, image.labels.data(), image.labels.size(), path);
+    if (::fsync(fd) != 0)
+      throw std::system_error(errno, std::generic_category(), temporary);
+  } catch (...) {
+    ::close(fd);
+    ::unlink(temporary.c_str());
+    throw;
+  }
+  if (::close(fd) != 0) {
+    int error = errno;
+    ::unlink(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), temporary);
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    int error = errno;
+    ::unlink(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  sync_directory(path);
+}
+
+// ###### Element access ######
+
+template <typename _Value>
+const _Value &mapped_trie<_Value>::at(std::string_view key) const {
+  auto value = find(key);
+  if (value == nullptr)
+    throw std::out_of_range("");
+  return *value;
+}
+
+// ###### Iterators ######
+
+template <typename _Value>
+typename mapped_trie<_Value>::const_iterator
+mapped_trie<_Value>::begin() const {
+  return const_iterator(this, 0, std::string());
+}
+
+template <typename _Value>
+typename mapped_trie<_Value>::const_iterator mapped_trie<_Value>::end() const {
+  return const_iterator(this);
+}
+
+// The elements whose key starts with prefix, in key order.
+template <typename _Value>
+std::pair<typename mapped_trie<_Value>::const_iterator,
+          typename mapped_trie<_Value>::const_iterator>
+mapped_trie<_Value>::prefix_range(std::string_view prefix) const {
+  std::size_t overshoot = 0;
+  auto index = descend(prefix, overshoot);
+  if (index == npos)
+    return {end(), end()};
+  std::string key(prefix);
+  std::string_view rest = label(index);
+  key.append(rest.substr(rest.length() - overshoot));
+  return {const_iterator(this, index, std::move(key)), end()};
+}
+
+// ###### Capacity ######
+
+template <typename _Value> bool mapped_trie<_Value>::empty() const noexcept {
+  return size() == 0;
+}
+
+template <typename _Value>
+typename mapped_trie<_Value>::size_type mapped_trie<_Value>::size() const
+    noexcept {
+  return _header->value_count;
+}
+
+template <typename _Value>
+std::size_t mapped_trie<_Value>::node_count() const noexcept {
+  return _header->node_count;
+}
+
+template <typename _Value>
+std::size_t mapped_trie<_Value>::image_size() const noexcept {
+  return _length;
+}
+
+// ###### Lookup ######
+
+// Like trie::find, a key that ends inside a compressed label is not found.
+template <typename _Value>
+const _Value *mapped_trie<_Value>::find(std::string_view key) const noexcept {
+  std::size_t overshoot = 0;
+  auto index = descend(key, overshoot);
+  if (key.empty() || index == npos || overshoot != 0 || !has_value(index))
+    return nullptr;
+  return &_values[_nodes[index].value_begin];
+}
+
+template <typename _Value>
+typename mapped_trie<_Value>::size_type
+mapped_trie<_Value>::count(std::string_view key) const noexcept {
+  return find(key) != nullptr;
+}
+
+template <typename _Value>
+bool mapped_trie<_Value>::contains(std::string_view key) const noexcept {
+  return count(key);
+}
+
+template <typename _Value>
+typename mapped_trie<_Value>::size_type
+mapped_trie<_Value>::count_prefix(std::string_view prefix) const noexcept {
+  std::size_t overshoot = 0;
+  auto index = descend(prefix, overshoot);
+  if (index == npos)
+    return 0;
+  const node &current_node = _nodes[index];
+  return _nodes[current_node.subtree_end].value_begin -
+         current_node.value_begin;
+}
+
+// Calls function(key, value) for every element in key order.
+template <typename _Value>
+template <typename _Function>
+void mapped_trie<_Value>::for_each(_Function function) const {
+  for_each_prefix("", function);
+}
+
+template <typename _Value>
+template <typename _Function>
+void mapped_trie<_Value>::for_each_prefix(std::string_view prefix,
+                                          _Function function) const {
+  std::size_t overshoot = 0;
+  auto index = descend(prefix, overshoot);
+  if (index == npos)
+    return;
+  std::string key(prefix);
+  std::string_view rest = label(index);
+  key.append(rest.substr(rest.length() - overshoot));
+  walk(index, key, function);
+}
+
+// Returns the node reached by key, or npos. A key may end inside the node's
+// label; overshoot is then the number of label characters past its end.
+template <typename _Value>
+std::uint32_t mapped_trie<_Value>::descend(std::string_view key,
+                                           std::size_t &overshoot) const
+    noexcept {
+  std::uint32_t index = 0;
+  std::size_t position = 0;
+  overshoot = 0;
+  while (position < key.length()) {
+    index = find_child(index, key[position++]);
+    if (index == npos)
+      return npos;
+    std::string_view current_label = label(index);
+    std::size_t length =
+        std::min(current_label.length(), key.length() - position);
+    if (key.compare(position, length, current_label.substr(0, length)) != 0)
+      return npos;
+    position += length;
+    overshoot = current_label.length() - length;
+  }
+  return index;
+}
+
+template <typename _Value>
+std::uint32_t mapped_trie<_Value>::find_child(std::uint32_t index,
+                                              char key) const noexcept {
+  const node &current_node = _nodes[index];
+  const char *first = _keys + current_node.child_begin;
+  const char *last = first + current_node.child_count;
+  const char *position;
+  if (current_node.child_count <= 16)
+    position = std::find(first, last, key);
+  else
+    position = std::lower_bound(first, last, key, [](char a, char b) {
+      return static_cast<signed char>(a) < static_cast<signed char>(b);
+    });
+  if (position == last || *position != key)
+    return npos;
+  return _targets[position - _keys];
+}
+
+template <typename _Value>
+bool mapped_trie<_Value>::has_value(std::uint32_t index) const noexcept {
+  return _nodes[index + 1].value_begin != _nodes[index].value_begin;
+}
+
+template <typename _Value>
+std::string_view mapped_trie<_Value>::label(std::uint32_t index) const
+    noexcept {
+  return std::string_view(_labels + _nodes[index].label_offset,
+                          _nodes[index].label_length);
+}
+
+// ###### Utilities ######
+
+// Appends current_node and its subtree in pre-order and returns its index.
+// The child keys are reserved before the children are added so that they
+// stay next to each other.
+template <typename _Value>
+std::uint32_t mapped_trie<_Value>::add_node(
+    const trie_node<_Value> *current_node, builder &image) {
+  auto index = static_cast<std::uint32_t>(image.nodes.size());
+  node record = {};
+  record.value_begin = static_cast<std::uint32_t>(image.values.size());
+  record.child_begin = static_cast<std::uint32_t>(image.keys.size());
+  record.child_count = current_node->children_count();
+  std::string_view current_label = current_node->get_label();
+  record.label_offset = static_cast<std::uint32_t>(image.labels.size());
+  record.label_length = static_cast<std::uint32_t>(current_label.length());
+  image.labels.append(current_label);
+  image.nodes.push_back(record);
+  if (current_node->get_value().has_value())
+    image.values.push_back(*current_node->get_value());
+
+  std::uint32_t edge = record.child_begin;
+  image.keys.resize(image.keys.size() + record.child_count);
+  image.targets.resize(image.keys.size());
+  current_node->for_each_child([&](const trie_node<_Value> *child) {
+    image.keys[edge] = child->get_node_key();
+    std::uint32_t child_index = add_node(child, image);
+    image.targets[edge++] = child_index;
+  });
+  image.nodes[index].subtree_end =
+      static_cast<std::uint32_t>(image.nodes.size());
+  return index;
+}
+
+template <typename _Value>
+std::uint64_t mapped_trie<_Value>::align(std::uint64_t offset,
+                                         std::uint64_t alignment) noexcept {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename _Value>
+void mapped_trie<_Value>::write_all(int fd, const void *data,
+                                    std::size_t length,
+                                    const std::string &path) {
+  auto bytes = static_cast<const char *>(data);
+  while (length > 0) {
+    ssize_t written = ::write(fd, bytes, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0)
+      throw std::system_error(errno, std::generic_category(), path);
+    bytes += written;
+    length -= static_cast<std::size_t>(written);
+  }
+}
+
+template <typename _Value>
+void mapped_trie<_Value>::write_padding(int fd, std::size_t length,
+                                        const std::string &path) {
+  static const char zeros[64] = {};
+  for (; length > sizeof(zeros); length -= sizeof(zeros))
+    write_all(fd, zeros, sizeof(zeros), path);
+  write_all(fd, zeros, length, path);
+}
+
+// Syncs the directory holding path, so that a rename into it survives a
+// crash.
+template <typename _Value>
+void mapped_trie<_Value>::sync_directory(const std::string &path) {
+  auto slash = path.rfind('/');
+  std::string directory = ".";
+  if (slash != std::string::npos)
+    directory = path.substr(0, std::max<std::size_t>(slash, 1));
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), directory);
+  int result = ::fsync(fd);
+  int error = errno;
+  ::close(fd);
+  if (result != 0)
+    throw std::system_error(error, std::generic_category(), directory);
+}
+
+template <typename _Value>
+template <typename _Function>
+void mapped_trie<_Value>::walk(std::uint32_t index, std::string &key,
+                               _Function &function) const {
+  const node &current_node = _nodes[index];
+  if (has_value(index))
+    function(std::string_view(key), _values[current_node.value_begin]);
+  for (std::uint32_t edge = current_node.child_begin;
+       edge < current_node.child_begin + current_node.child_count; ++edge) {
+    std::size_t length = key.length();
+    key += _keys[edge];
+    key.append(label(_targets[edge]));
+    walk(_targets[edge], key, function);
+    key.resize(length);
+  }
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Trie with persistent, path-copying updates. Nodes are immutable once
+// built and shared between versions: a write copies only the nodes from the
+// root down to the one it changes and leaves every other subtree shared, so
+// snapshot() and copying are O(1). Values sit behind their own shared
+// pointer so that copying a node on the path does not copy its value.
+//
+// One thread may modify and read a persistent_trie while others take
+// snapshot()s of it; the root pointer is copied and swapped under a
+// mutex. Snapshots are plain persistent_tries that nothing else writes to,
+// so they can be read freely and outlive the trie they came from. Keys are
+// not path compressed.
+template <typename _Value> class persistent_trie {
+public:
+  using key_type = std::string;
+  using value_type = _Value;
+  using size_type = std::size_t;
+
+  persistent_trie() noexcept;
+  persistent_trie(const persistent_trie<_Value> &other_trie) noexcept;
+  persistent_trie<_Value> &
+  operator=(const persistent_trie<_Value> &other_trie) noexcept;
+
+  persistent_trie<_Value> snapshot() const noexcept;
+
+  // ###### Element access ######
+  const _Value &at(std::string_view key) const;
+
+  // ###### Capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t node_count() const noexcept;
+  std::size_t
+  shared_node_count(const persistent_trie<_Value> &other_trie) const;
+
+  // ###### Modifiers ######
+  void clear() noexcept;
+  bool insert(std::string_view key, const _Value &value);
+  bool insert_or_assign(std::string_view key, const _Value &value);
+  size_type erase(std::string_view key);
+
+  // ###### Lookup ######
+  const _Value *find(std::string_view key) const noexcept;
+  size_type count(std::string_view key) const noexcept;
+  bool contains(std::string_view key) const noexcept;
+  size_type count_prefix(std::string_view prefix) const noexcept;
+  template <typename _Function> void for_each(_Function function) const;
+  template <typename _Function>
+  void for_each_prefix(std::string_view prefix, _Function function) const;
+
+private:
+  struct node;
+  using node_ptr = std::shared_ptr<const node>;
+
+  // count is the number of values in the subtree; children are sorted like
+  // signed chars.
+  struct node {
+    std::shared_ptr<const _Value> value;
+    size_type count = 0;
+    std::vector<std::pair<char, node_ptr>> children;
+  };
+
+  node_ptr _root;
+  mutable std::mutex _root_mutex;
+
+  node_ptr root() const noexcept;
+  void publish(node_ptr new_root) noexcept;
+  const node *find_node(std::string_view key) const noexcept;
+
+  // ###### Utilities ######
+  static typename std::vector<std::pair<char, node_ptr>>::const_iterator
+  lower_bound(const node *current_node, char key) noexcept;
+  static node_ptr assign(const node *current_node, std::string_view key,
+                         std::shared_ptr<const _Value> &value,
+                         bool &inserted);
+  static node_ptr remove(const node_ptr &current_node, std::string_view key,
+                         bool &erased);
+  template <typename _Function>
+  static void walk(const node *current_node, std::string &key,
+                   _Function &function);
+  template <typename _Function>
+  static void visit(const node *current_node, _Function &function);
+};
+
+// ###### persistent_trie ######
+
+template <typename _Value>
+persistent_trie<_Value>::persistent_trie() noexcept
+    : _root(std::make_shared<const node>()) {}
+
+template <typename _Value>
+persistent_trie<_Value>::persistent_trie(
+    const persistent_trie<_Value> &other_trie) noexcept
+    : _root(other_trie.root()) {}
+
+template <typename _Value>
+persistent_trie<_Value> &
+persistent_trie<_Value>::operator=(const persistent_trie<_Value> &other_trie)
+    noexcept {
+  publish(other_trie.root());
+  return *this;
+}
+
+template <typename _Value>
+persistent_trie<_Value> persistent_trie<_Value>::snapshot() const noexcept {
+  return persistent_trie<_Value>(*this);
+}
+
+// ###### Element access ######
+
+template <typename _Value>
+const _Value &persistent_trie<_Value>::at(std::string_view key) const {
+  auto value = find(key);
+  if (value == nullptr)
+    throw std::out_of_range("");
+  return *value;
+}
+
+// ###### Capacity ######
+
+template <typename _Value>
+bool persistent_trie<_Value>::empty() const noexcept {
+  return size() == 0;
+}
+
+template <typename _Value>
+typename persistent_trie<_Value>::size_type
+persistent_trie<_Value>::size() const noexcept {
+  return _root->count;
+}
+
+template <typename _Value>
+std::size_t persistent_trie<_Value>::node_count() const noexcept {
+  std::size_t count = 0;
+  auto counter = [&count](const node *) { ++count; };
+  visit(_root.get(), counter);
+  return count;
+}
+
+// Nodes reachable from both versions, i.e. stored once for the two.
+template <typename _Value>
+std::size_t persistent_trie<_Value>::shared_node_count(
+    const persistent_trie<_Value> &other_trie) const {
+  std::unordered_set<const node *> other_nodes;
+  auto collect = [&other_nodes](const node *current_node) {
+    other_nodes.insert(current_node);
+  };
+  auto other_root = other_trie.root();
+  visit(other_root.get(), collect);
+  std::size_t shared = 0;
+  auto match = [&](const node *current_node) {
+    shared += other_nodes.count(current_node);
+  };
+  visit(_root.get(), match);
+  return shared;
+}
+
+// ###### Modifiers ######
+
+template <typename _Value> void persistent_trie<_Value>::clear() noexcept {
+  publish(std::make_shared<const node>());
+}
+
+template <typename _Value>
+bool persistent_trie<_Value>::insert(std::string_view key,
+                                     const _Value &value) {
+  if (key.empty() || find(key) != nullptr)
+    return false;
+  return insert_or_assign(key, value);
+}
+
+template <typename _Value>
+bool persistent_trie<_Value>::insert_or_assign(std::string_view key,
+                                               const _Value &value) {
+  if (key.empty())
+    return false;
+  auto shared_value = std::make_shared<const _Value>(value);
+  bool inserted = false;
+  publish(assign(_root.get(), key, shared_value, inserted));
+  return inserted;
+}
+
+template <typename _Value>
+typename persistent_trie<_Value>::size_type
+persistent_trie<_Value>::erase(std::string_view key) {
+  if (key.empty())
+    return 0;
+  bool erased = false;
+  auto new_root = remove(_root, key, erased);
+  if (!erased)
+    return 0;
+  publish(new_root != nullptr ? std::move(new_root)
+                              : std::make_shared<const node>());
+  return 1;
+}
+
+// ###### Lookup ######
+
+template <typename _Value>
+const _Value *persistent_trie<_Value>::find(std::string_view key) const
+    noexcept {
+  auto current_node = find_node(key);
+  if (key.empty() || current_node == nullptr)
+    return nullptr;
+  return current_node->value.get();
+}
+
+template <typename _Value>
+typename persistent_trie<_Value>::size_type
+persistent_trie<_Value>::count(std::string_view key) const noexcept {
+  return find(key) != nullptr;
+}
+
+template <typename _Value>
+bool persistent_trie<_Value>::contains(std::string_view key) const noexcept {
+  return count(key);
+}
+
+template <typename _Value>
+typename persistent_trie<_Value>::size_type
+persistent_trie<_Value>::count_prefix(std::string_view prefix) const
+    noexcept {
+  auto current_node = find_node(prefix);
+  return current_node == nullptr ? 0 : current_node->count;
+}
+
+// Calls function(key, value) for every element in key order.
+template <typename _Value>
+template <typename _Function>
+void persistent_trie<_Value>::for_each(_Function function) const {
+  for_each_prefix("", function);
+}
+
+template <typename _Value>
+template <typename _Function>
+void persistent_trie<_Value>::for_each_prefix(std::string_view prefix,
+                                              _Function function) const {
+  auto current_node = find_node(prefix);
+  if (current_node == nullptr)
+    return;
+  std::string key(prefix);
+  walk(current_node, key, function);
+}
+
+// The node stays valid until the next modification of this trie.
+template <typename _Value>
+const typename persistent_trie<_Value>::node *
+persistent_trie<_Value>::find_node(std::string_view key) const noexcept {
+  const node *current_node = _root.get();
+  for (char k : key) {
+    auto position = lower_bound(current_node, k);
+    if (position == current_node->children.end() || position->first != k)
+      return nullptr;
+    current_node = position->second.get();
+  }
+  return current_node;
+}
+
+template <typename _Value>
+typename persistent_trie<_Value>::node_ptr
+persistent_trie<_Value>::root() const noexcept {
+  std::lock_guard<std::mutex> guard(_root_mutex);
+  return _root;
+}
+
+// The old root is released after the lock, so a large version is not
+// freed while snapshot() waits on it.
+template <typename _Value>
+void persistent_trie<_Value>::publish(node_ptr new_root) noexcept {
+  std::lock_guard<std::mutex> guard(_root_mutex);
+  _root.swap(new_root);
+}
+
+// ###### Utilities ######
+
+template <typename _Value>
+typename std::vector<
+    std::pair<char, typename persistent_trie<_Value>::node_ptr>>::const_iterator
+persistent_trie<_Value>::lower_bound(const node *current_node,
+                                     char key) noexcept {
+  return std::lower_bound(
+      current_node->children.begin(), current_node->children.end(), key,
+      [](const std::pair<char, node_ptr> &child, char k) {
+        return child.first < k;
+      });
+}
+
+// Returns a copy of current_node (or a new node) with value stored under
+// key, copying the nodes on the way down.
+template <typename _Value>
+typename persistent_trie<_Value>::node_ptr
+persistent_trie<_Value>::assign(const node *current_node, std::string_view key,
+                                std::shared_ptr<const _Value> &value,
+                                bool &inserted) {
+  auto copy = current_node != nullptr ? std::make_shared<node>(*current_node)
+                                      : std::make_shared<node>();
+  if (key.empty()) {
+    inserted = copy->value == nullptr;
+    copy->value = std::move(value);
+  } else {
+    auto position = lower_bound(copy.get(), key[0]);
+    auto offset = position - copy->children.cbegin();
+    if (position != copy->children.cend() && position->first == key[0]) {
+      copy->children[offset].second =
+          assign(position->second.get(), key.substr(1), value, inserted);
+    } else {
+      copy->children.emplace(position, key[0],
+                             assign(nullptr, key.substr(1), value, inserted));
+    }
+  }
+  copy->count += inserted;
+  return copy;
+}
+
+// Returns current_node itself if key is not there, nullptr if the node is
+// left without value and children, and a trimmed copy otherwise.
+template <typename _Value>
+typename persistent_trie<_Value>::node_ptr
+persistent_trie<_Value>::remove(const node_ptr &current_node,
+                                std::string_view key, bool &erased) {
+  node_ptr child;
+  auto position = current_node->children.cend();
+  if (key.empty()) {
+    erased = current_node->value != nullptr;
+    if (!erased)
+      return current_node;
+  } else {
+    position = lower_bound(current_node.get(), key[0]);
+    if (position == current_node->children.cend() || position->first != key[0])
+      return current_node;
+    child = remove(position->second, key.substr(1), erased);
+    if (!erased)
+      return current_node;
+  }
+
+  auto copy = std::make_shared<node>(*current_node);
+  if (key.empty()) {
+    copy->value = nullptr;
+  } else {
+    auto offset = position - current_node->children.cbegin();
+    if (child != nullptr)
+      copy->children[offset].second = std::move(child);
+    else
+      copy->children.erase(copy->children.begin() + offset);
+  }
+  --copy->count;
+  if (copy->value == nullptr && copy->children.empty())
+    return nullptr;
+  return copy;
+}
+
+template <typename _Value>
+template <typename _Function>
+void persistent_trie<_Value>::walk(const node *current_node, std::string &key,
+                                   _Function &function) {
+  if (current_node->value != nullptr)
+    function(std::string_view(key), *current_node->value);
+  for (const auto &child : current_node->children) {
+    key.push_back(child.first);
+    walk(child.second.get(), key, function);
+    key.pop_back();
+  }
+}
+
+template <typename _Value>
+template <typename _Function>
+void persistent_trie<_Value>::visit(const node *current_node,
+                                    _Function &function) {
+  function(current_node);
+  for (const auto &child : current_node->children)
+    visit(child.second.get(), function);
+}
@@ -1,6 +1,15 @@
+#include "concurrent_trie.h"
+#include "persistent_trie.h"
 #include "trie.h"
+#include "trie_backend.h"
 
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <thread>
 #include <stdlib.h>
 #include <time.h>
 
@@ -49,7 +58,8 @@ void test_trie_capacity(trie<int> new_trie) {
   assert(new_trie.size() == 7);
   std::cout << "size: check" << std::endl;
 
-  assert(new_trie.max_size() == 59652323);
+  assert(new_trie.max_size() ==
+         std::numeric_limits<unsigned int>().max() / sizeof(trie_node<int>));
   std::cout << "max_size: check" << std::endl;
 
   assert(new_trie.empty() == 0);
@@ -99,6 +109,16 @@ void test_trie_element_access(trie<int> new_trie) {
 
   assert((new_trie["xyz"] = 30) == 30);
   assert(new_trie["xyz"].value_or(-1) == 30);
+
+  std::size_t size = new_trie.size();
+  exception_thrown = false;
+  try {
+    new_trie[""] = 1;
+  } catch (const std::out_of_range &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+  assert(new_trie.size() == size && !new_trie.contains(""));
   std::cout << "[]: check" << std::endl;
 
   std::cout << std::endl << "### end of test_trie_lookup ###" << std::endl;
@@ -125,7 +145,6 @@ void test_trie_clear_erase(trie<int> new_trie) {
 
   assert(
       strcmp((*new_trie.erase(new_trie.find("ab"))).get_key().c_str(), "ac"));
-  std::cout << new_trie.find("ab")->get_key() << std::endl;
   assert(new_trie.find("ab") == new_trie.end());
   assert(new_trie.erase("xyz") == 0);
   assert(new_trie.erase("ab") == 0);
@@ -159,6 +178,1750 @@ void test_trie_emplace(trie<int> new_trie) {
   std::cout << std::endl << "### end of test_trie_emplace ###" << std::endl;
 }
 
+void test_trie_node_children() {
+  std::cout << "### start of test_trie_node_children ###" << std::endl
+            << std::endl;
+
+  trie<int> wide_trie;
+  for (int c = 127; c >= -128; --c)
+    if (c != 0)
+      wide_trie.insert(std::string(1, static_cast<char>(c)), c);
+  assert(wide_trie.size() == 255);
+
+  int previous = -129;
+  for (auto it = wide_trie.begin(); it != wide_trie.end(); it++) {
+    assert((*it).get_node_key() > previous);
+    assert((*it).get_value().value() == (*it).get_node_key());
+    previous = (*it).get_node_key();
+  }
+  assert(previous == 127);
+  std::cout << "ordered growth: check" << std::endl;
+
+  for (int c = -128; c < 128; ++c) {
+    if (c == 0 || c % 7 == 0)
+      continue;
+    assert(wide_trie.erase(std::string(1, static_cast<char>(c))) == 1);
+    assert(!wide_trie.contains(std::string(1, static_cast<char>(c))));
+  }
+  for (int c = -126; c < 127; c += 7)
+    if (c != 0)
+      assert(wide_trie.at(std::string(1, static_cast<char>(c))).value() == c);
+  assert(wide_trie.size() == 36);
+  std::cout << "shrink: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_node_children ###" << std::endl;
+}
+
+void test_trie_path_compression() {
+  std::cout << "### start of test_trie_path_compression ###" << std::endl
+            << std::endl;
+
+  std::vector<std::string> keys = {
+      "http://example.com/a/b", "http://example.com/a",  "http://example.org",
+      "https://example.com",    "hello",                 "help",
+      "hel",                    "he",                    "zebra"};
+  trie<int> plain_trie;
+  trie<int> compressed_trie(true);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    assert(plain_trie.insert(keys[i], i).second);
+    assert(compressed_trie.insert(keys[i], i).second);
+  }
+  assert(!compressed_trie.insert("hel", 0).second);
+  assert(compressed_trie.size() == keys.size());
+  assert(compressed_trie.node_count() < plain_trie.node_count() / 3);
+
+  auto cit = compressed_trie.begin();
+  for (auto it = plain_trie.begin(); it != plain_trie.end(); ++it, ++cit) {
+    assert((*it).get_key() == (*cit).get_key());
+    assert((*it).get_value() == (*cit).get_value());
+  }
+  assert(cit == compressed_trie.end());
+  std::cout << "insert and iteration: check" << std::endl;
+
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    assert(compressed_trie.at(keys[i]).value() == int(i));
+  assert(!compressed_trie.contains("http://example"));
+  assert(!compressed_trie.contains("hellos"));
+  assert(!compressed_trie.contains("x"));
+  std::cout << "find: check" << std::endl;
+
+  std::size_t full_count = compressed_trie.node_count();
+  assert(compressed_trie.insert("helpful", 10).second);
+  assert(compressed_trie.erase("helpful") == 1);
+  assert(compressed_trie.node_count() == full_count);
+  assert(compressed_trie.erase("hel") == 1);
+  assert(compressed_trie.erase("he") == 1);
+  assert(compressed_trie.contains("hello") && compressed_trie.contains("help"));
+  assert(compressed_trie.erase("http://example.com/a") == 1);
+  assert(compressed_trie.at("http://example.com/a/b").value() == 0);
+  assert(compressed_trie.erase("help") == 1);
+  assert(compressed_trie.node_count() == full_count - 4);
+  std::cout << "erase and merge: check" << std::endl;
+
+  assert(plain_trie.erase("he") == 1);
+  assert(plain_trie.contains("hello") && !plain_trie.contains("he"));
+  std::cout << "erase keeps descendants: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_path_compression ###" << std::endl;
+}
+
+void test_trie_arena() {
+  std::cout << "### start of test_trie_arena ###" << std::endl << std::endl;
+
+  trie_arena arena;
+  void *first = arena.allocate(40);
+  arena.deallocate(first, 40);
+  assert(arena.allocate(48) == first);
+  void *large = arena.allocate(10000);
+  arena.deallocate(large, 10000);
+  assert(arena.capacity() > 0);
+  arena.release();
+  assert(arena.capacity() == 0);
+  std::cout << "allocate/release: check" << std::endl;
+
+  trie<std::string> string_trie(true);
+  string_trie.insert("alpha", std::string(100, 'a'));
+  string_trie.insert("alphabet", std::string(100, 'b'));
+  string_trie.insert("beta", std::string(100, 'c'));
+  trie<std::string> copied_trie(string_trie);
+  string_trie.clear();
+  assert(string_trie.empty());
+  string_trie.insert("gamma", "g");
+  assert(string_trie.size() == 1);
+  assert(copied_trie.size() == 3);
+  assert(copied_trie.at("alphabet").value() == std::string(100, 'b'));
+  assert(copied_trie.erase("alpha") == 1);
+  assert(copied_trie.at("alphabet").value() == std::string(100, 'b'));
+  std::cout << "clear/copy: check" << std::endl;
+
+  std::cout << std::endl << "### end of test_trie_arena ###" << std::endl;
+}
+
+void test_trie_subtree_counts() {
+  std::cout << "### start of test_trie_subtree_counts ###" << std::endl
+            << std::endl;
+
+  srand(7);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 300; ++i) {
+    std::string key(1 + rand() % 6, ' ');
+    for (auto &c : key)
+      c = 'a' + rand() % 4;
+    keys.push_back(key);
+  }
+
+  for (bool compressed : {false, true}) {
+    trie<int> counted_trie(compressed);
+    counted_trie.enable_subtree_counts();
+    std::set<std::string> expected;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      counted_trie.insert(keys[i], i);
+      expected.insert(keys[i]);
+      if (i % 3 == 0) {
+        counted_trie.erase(keys[i / 2]);
+        expected.erase(keys[i / 2]);
+      }
+    }
+    assert(counted_trie.size() == expected.size());
+
+    trie<int> plain_counts(counted_trie);
+    trie<int> walked_counts(compressed);
+    for (const auto &key : expected)
+      walked_counts.insert(key, 0);
+
+    unsigned int index = 0;
+    for (const auto &key : expected) {
+      assert(counted_trie.rank(key) == index);
+      assert(walked_counts.rank(key) == index);
+      assert((*counted_trie.select(index)).get_key().substr(1) == key);
+      assert((*walked_counts.select(index)).get_key().substr(1) == key);
+      ++index;
+    }
+    assert(counted_trie.select(index) == counted_trie.end());
+    assert(counted_trie.rank("zzz") == expected.size());
+    assert(counted_trie.rank("") == 0);
+    std::cout << "rank/select: check" << std::endl;
+
+    for (const std::string prefix : {"", "a", "ab", "abc", "dd", "x"}) {
+      unsigned int count = 0;
+      for (const auto &key : expected)
+        count += key.compare(0, prefix.length(), prefix) == 0;
+      assert(counted_trie.count_prefix(prefix) == count);
+      assert(plain_counts.count_prefix(prefix) == count);
+      assert(walked_counts.count_prefix(prefix) == count);
+    }
+    std::cout << "count_prefix: check" << std::endl;
+  }
+
+  std::cout << std::endl
+            << "### end of test_trie_subtree_counts ###" << std::endl;
+}
+
+void test_trie_prefix_range() {
+  std::cout << "### start of test_trie_prefix_range ###" << std::endl
+            << std::endl;
+
+  std::vector<std::string> keys = {"car",  "card", "care", "cared", "cart",
+                                   "cat",  "do",   "dog",  "dot",   "c",
+                                   "zulu", "carp"};
+  for (bool compressed : {false, true}) {
+    trie<int> prefix_trie(compressed);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      prefix_trie.insert(keys[i], i);
+
+    for (const std::string prefix :
+         {"", "c", "ca", "car", "care", "cared", "caredx", "d", "x", "zu"}) {
+      std::vector<std::string> expected;
+      for (auto it = prefix_trie.begin(); it != prefix_trie.end(); ++it)
+        if ((*it).get_key().compare(1, prefix.length(), prefix) == 0)
+          expected.push_back((*it).get_key());
+
+      std::vector<std::string> found;
+      auto range = prefix_trie.prefix_range(prefix);
+      for (auto it = range.first; it != range.second; ++it)
+        found.push_back((*it).get_key());
+      assert(found == expected);
+      assert(prefix_trie.count_prefix(prefix) == expected.size());
+
+      const trie<int> &const_trie = prefix_trie;
+      auto const_range = const_trie.prefix_range(prefix);
+      std::size_t const_count = 0;
+      for (auto it = const_range.first; it != const_range.second; ++it)
+        ++const_count;
+      assert(const_count == expected.size());
+    }
+    std::cout << "prefix_range: check" << std::endl;
+
+    assert(prefix_trie.erase_prefix("care") == 2);
+    assert(!prefix_trie.contains("care") && !prefix_trie.contains("cared"));
+    assert(prefix_trie.contains("card") && prefix_trie.contains("carp"));
+    assert(prefix_trie.erase_prefix("ca") == 5);
+    assert(prefix_trie.contains("c") && !prefix_trie.contains("cat"));
+    assert(prefix_trie.erase_prefix("x") == 0);
+    assert(prefix_trie.erase_prefix("zul") == 1);
+    assert(prefix_trie.size() == 4);
+    assert(prefix_trie.erase_prefix("") == 4);
+    assert(prefix_trie.empty());
+    std::cout << "erase_prefix: check" << std::endl;
+  }
+
+  std::cout << std::endl
+            << "### end of test_trie_prefix_range ###" << std::endl;
+}
+
+void test_trie_iterator_keys() {
+  std::cout << "### start of test_trie_iterator_keys ###" << std::endl
+            << std::endl;
+
+  std::vector<std::string> keys = {
+      "a",   "ab",  "abc", "abd", "b", "bcdef", "bcx", "zzzzzzzzzzzzzzzzzz",
+      "zzzzz", "m"};
+  for (bool compressed : {false, true}) {
+    trie<int> key_trie(compressed);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      key_trie.insert(keys[i], i);
+
+    for (auto it = key_trie.begin(); it != key_trie.end(); ++it)
+      assert(it.key() == (*it).get_key().substr(1));
+    for (auto cit = key_trie.cbegin(); cit != key_trie.cend(); ++cit)
+      assert(cit.key() == (*cit).get_key().substr(1));
+    for (auto rit = key_trie.rbegin(); rit != key_trie.rend(); ++rit)
+      assert(rit.base().key() == (*rit.base()).get_key().substr(1));
+    std::cout << "iteration keys: check" << std::endl;
+
+    auto it = key_trie.find("bcdef");
+    assert(it.key() == "bcdef");
+    ++it;
+    assert(it.key() == "bcx");
+    assert(key_trie.insert("bcy", 0).first.key() == "bcy");
+    auto selected = key_trie.select(2);
+    assert(selected.key() == "abc");
+    ++selected;
+    assert(selected.key() == "abd");
+    auto range = key_trie.prefix_range("zz");
+    assert(range.first.key() == "zzzzz");
+    assert(key_trie.end().key().empty());
+    std::cout << "lazy keys: check" << std::endl;
+  }
+
+  std::cout << std::endl
+            << "### end of test_trie_iterator_keys ###" << std::endl;
+}
+
+struct counted_value {
+  static int copies;
+  static int moves;
+  std::string payload;
+
+  counted_value() = default;
+  counted_value(std::string text) : payload(std::move(text)) {}
+  counted_value(const counted_value &other) : payload(other.payload) {
+    ++copies;
+  }
+  counted_value(counted_value &&other) noexcept
+      : payload(std::move(other.payload)) {
+    ++moves;
+  }
+  counted_value &operator=(const counted_value &other) {
+    payload = other.payload;
+    ++copies;
+    return *this;
+  }
+  counted_value &operator=(counted_value &&other) noexcept {
+    payload = std::move(other.payload);
+    ++moves;
+    return *this;
+  }
+};
+int counted_value::copies = 0;
+int counted_value::moves = 0;
+
+std::ostream &operator<<(std::ostream &os, const counted_value &value) {
+  return os << value.payload;
+}
+
+void test_trie_move() {
+  std::cout << "### start of test_trie_move ###" << std::endl << std::endl;
+
+  trie<counted_value> value_trie(true);
+  assert(value_trie.emplace("alpha", "first").second);
+  assert(counted_value::copies == 0 && counted_value::moves == 0);
+  counted_value second("second");
+  assert(value_trie.insert("beta", std::move(second)).second);
+  assert(counted_value::copies == 0 && counted_value::moves == 1);
+  counted_value third("third");
+  assert(!value_trie.insert_or_assign("beta", std::move(third)).second);
+  assert(value_trie.at("beta").value().payload == "third");
+  assert(counted_value::copies == 0 && counted_value::moves == 2);
+  value_trie["gamma"].value().payload = "fourth";
+  assert(counted_value::copies == 0 && counted_value::moves == 2);
+  std::cout << "in-place insert: check" << std::endl;
+
+  trie<counted_value> moved_trie(std::move(value_trie));
+  assert(counted_value::copies == 0);
+  assert(moved_trie.size() == 3 && moved_trie.compressed());
+  assert(value_trie.empty());
+  assert(value_trie.insert("delta", counted_value("x")).second);
+
+  value_trie = std::move(moved_trie);
+  assert(counted_value::copies == 0);
+  assert(value_trie.size() == 3 && moved_trie.empty());
+  assert(value_trie.at("alpha").value().payload == "first");
+  std::cout << "move: check" << std::endl;
+
+  moved_trie = value_trie;
+  assert(counted_value::copies == 3);
+  assert(moved_trie.at("gamma").value().payload == "fourth");
+  std::cout << "copy assignment: check" << std::endl;
+
+  std::cout << std::endl << "### end of test_trie_move ###" << std::endl;
+}
+
+void test_trie_string_view() {
+  std::cout << "### start of test_trie_string_view ###" << std::endl
+            << std::endl;
+
+  for (bool compressed : {false, true}) {
+    trie<int> view_trie(compressed);
+    const char buffer[] = "GET /api/v1/users HTTP/1.1";
+    std::string_view request(buffer);
+    std::string_view path = request.substr(4, 13);
+    std::string_view prefix = request.substr(4, 8);
+
+    assert(view_trie.insert(path, 1).second);
+    assert(view_trie.insert(prefix, 2).second);
+    view_trie[request.substr(0, 3)] = 3;
+    assert(view_trie.size() == 3);
+
+    assert(view_trie.contains(std::string_view(buffer + 4, 13)));
+    assert(view_trie.count(std::string_view(buffer + 4, 12)) == 0);
+    assert(view_trie.at(path).value() == 1);
+    assert(view_trie.find(prefix).key() == "/api/v1/");
+    assert(view_trie.find(std::string_view(buffer, 3)) != view_trie.end());
+    assert(view_trie.count_prefix(prefix) == 2);
+    assert(view_trie.rank(path) == 1);
+
+    auto range = view_trie.prefix_range(std::string_view(buffer + 4, 5));
+    assert(std::distance(range.first, range.second) == 2);
+
+    assert(view_trie.erase(std::string_view(buffer, 3)) == 1);
+    assert(view_trie.erase_prefix(request.substr(4, 4)) == 2);
+    assert(view_trie.empty());
+  }
+  std::cout << "string_view keys: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_string_view ###" << std::endl;
+}
+
+void test_trie_build_sorted() {
+  std::cout << "### start of test_trie_build_sorted ###" << std::endl
+            << std::endl;
+
+  std::vector<std::pair<std::string, int>> sorted = {
+      {"a", 1}, {"ab", 2},    {"abc", 3}, {"abd", 4}, {"abd", 40},
+      {"b", 5}, {"bcdef", 6}, {"bcx", 7}, {"bd", 8},  {"", 9}};
+  std::vector<std::pair<std::string, int>> unsorted = {
+      {"zeta", 1}, {"bc", 2}, {"zet", 3}, {"bcdefg", 4}, {"a", 5}};
+
+  for (bool compressed : {false, true}) {
+    for (const auto &input : {sorted, unsorted}) {
+      trie<int> inserted(compressed);
+      trie<int> built(compressed);
+      inserted.enable_subtree_counts();
+      built.enable_subtree_counts();
+      inserted.insert("bcd", 100);
+      built.insert("bcd", 100);
+
+      std::size_t expected = 0;
+      for (const auto &entry : input)
+        expected += inserted.insert(entry.first, entry.second).second;
+      assert(built.build_sorted(input.begin(), input.end()) == expected);
+
+      assert(built.size() == inserted.size());
+      assert(built.node_count() == inserted.node_count());
+      auto it = inserted.cbegin();
+      for (auto jt = built.cbegin(); jt != built.cend(); ++jt, ++it) {
+        assert(jt.key() == it.key());
+        assert((*jt).get_value() == (*it).get_value());
+      }
+      assert(it == inserted.cend());
+      assert(built.count_prefix("b") == inserted.count_prefix("b"));
+    }
+  }
+  std::cout << "matches insert: check" << std::endl;
+
+  std::vector<std::pair<std::string, std::string>> moved = {
+      {"key", std::string(64, 'x')}};
+  trie<std::string> moved_trie;
+  moved_trie.build_sorted(std::make_move_iterator(moved.begin()),
+                          std::make_move_iterator(moved.end()));
+  assert(moved_trie.at("key").value().length() == 64);
+  assert(moved[0].second.empty());
+  std::cout << "move iterators: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_build_sorted ###" << std::endl;
+}
+
+void test_trie_build_parallel() {
+  std::cout << "### start of test_trie_build_parallel ###" << std::endl
+            << std::endl;
+
+  std::vector<std::pair<std::string, int>> input;
+  srand(7);
+  for (int i = 0; i < 2000; ++i) {
+    std::string key(1 + rand() % 8, ' ');
+    for (auto &c : key)
+      c = static_cast<char>('a' + rand() % 12);
+    input.emplace_back(key, i);
+  }
+  input.emplace_back("", -1);
+  input.emplace_back("\xff\x80", -2);
+
+  for (bool compressed : {false, true}) {
+    for (unsigned int threads : {1u, 2u, 3u, 8u}) {
+      trie<int> inserted(compressed);
+      trie<int> built(compressed);
+      built.enable_subtree_counts();
+      inserted.insert("bcd", 100);
+      built.insert("bcd", 100);
+
+      std::size_t expected = 0;
+      for (const auto &entry : input)
+        expected += inserted.insert(entry.first, entry.second).second;
+      assert(built.build_parallel(input.begin(), input.end(), threads) ==
+             expected);
+
+      assert(built.size() == inserted.size());
+      assert(built.node_count() == inserted.node_count());
+      auto it = inserted.cbegin();
+      for (auto jt = built.cbegin(); jt != built.cend(); ++jt, ++it) {
+        assert(jt.key() == it.key());
+        assert((*jt).get_value() == (*it).get_value());
+      }
+      assert(it == inserted.cend());
+      assert(built.count_prefix("a") == inserted.count_prefix("a"));
+      assert(built.rank("b") == inserted.rank("b"));
+
+      assert(built.erase_prefix("c") == inserted.erase_prefix("c"));
+      built.insert("cab", 1);
+      assert(built.contains("cab") && built.size() == inserted.size() + 1);
+    }
+  }
+  std::cout << "matches insert: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_build_parallel ###" << std::endl;
+}
+
+void test_concurrent_trie() {
+  std::cout << "### start of test_concurrent_trie ###" << std::endl
+            << std::endl;
+
+  concurrent_trie<int> shared_trie;
+  assert(shared_trie.insert("ab", 1));
+  assert(shared_trie.insert("abc", 2));
+  assert(!shared_trie.insert("ab", 3));
+  assert(!shared_trie.insert("", 4));
+  assert(shared_trie.size() == 2);
+  assert(shared_trie.find("ab") == 1 && shared_trie.at("abc") == 2);
+  assert(!shared_trie.contains("a") && shared_trie.find("a") == std::nullopt);
+  bool thrown = false;
+  try {
+    shared_trie.at("a");
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(!shared_trie.insert_or_assign("ab", 5) && shared_trie.at("ab") == 5);
+  assert(shared_trie.erase("ab") == 1 && shared_trie.erase("ab") == 0);
+  assert(shared_trie.contains("abc") && shared_trie.size() == 1);
+  assert(shared_trie.erase("abc") == 1 && shared_trie.empty());
+  shared_trie.insert("x", 1);
+  shared_trie.clear();
+  assert(shared_trie.empty() && !shared_trie.contains("x"));
+  std::cout << "single thread: check" << std::endl;
+
+  // Stable keys are never touched by the writer; churn keys come and go but
+  // always carry their own length as value.
+  std::vector<std::string> stable, churn;
+  for (int i = 0; i < 200; ++i) {
+    stable.push_back("stable/" + std::to_string(i));
+    churn.push_back("churn/" + std::string(i % 7, 'x') + std::to_string(i));
+  }
+  for (const auto &key : stable)
+    shared_trie.insert(key, static_cast<int>(key.length()));
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      std::size_t i = r;
+      while (!done.load()) {
+        const auto &key = stable[i % stable.size()];
+        if (shared_trie.find(key) != static_cast<int>(key.length()))
+          ++failures;
+        const auto &other = churn[i % churn.size()];
+        auto value = shared_trie.find(other);
+        if (value && *value != static_cast<int>(other.length()))
+          ++failures;
+        i += 7;
+      }
+    });
+  }
+  for (int round = 0; round < 20; ++round) {
+    for (const auto &key : churn)
+      shared_trie.insert(key, static_cast<int>(key.length()));
+    for (std::size_t i = round % 2; i < churn.size(); i += 2)
+      shared_trie.insert_or_assign(churn[i],
+                                   static_cast<int>(churn[i].length()));
+    for (const auto &key : churn)
+      shared_trie.erase(key);
+  }
+  done.store(true);
+  for (auto &reader : readers)
+    reader.join();
+  assert(failures.load() == 0);
+  assert(shared_trie.size() == stable.size());
+  std::cout << "one writer, four readers: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_concurrent_trie ###" << std::endl;
+}
+
+// Writers own disjoint keys, so each knows the exact state of its own keys
+// and checks every result against that model; values carry a per-key
+// counter that any reader must only ever see grow. On the shared keys every
+// thread races, and successful inserts minus successful erases must match
+// what is left.
+void test_concurrent_trie_writers() {
+  std::cout << "### start of test_concurrent_trie_writers ###" << std::endl
+            << std::endl;
+
+  const int threads = 8;
+  const int owned_keys = 64;
+  std::vector<std::string> shared_keys;
+  for (int i = 0; i < 16; ++i)
+    shared_keys.push_back("shared/" + std::to_string(i));
+
+  auto owned = [](int t, int k) {
+    return "owned/" + std::to_string(t) + "/" + std::to_string(k);
+  };
+
+  concurrent_trie<long> shared_trie;
+  std::vector<std::atomic<long>> net(shared_keys.size());
+  std::atomic<int> failures(0);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([&, t] {
+      std::vector<long> model(owned_keys, -1);
+      std::vector<long> seen(owned_keys * threads, -1);
+      unsigned int seed = 17 + t;
+      for (int op = 0; op < 4000; ++op) {
+        int k = rand_r(&seed) % owned_keys;
+        std::string key = owned(t, k);
+        long stamp = op;
+        switch (rand_r(&seed) % 5) {
+        case 0:
+          if (shared_trie.insert(key, stamp) != (model[k] < 0))
+            ++failures;
+          if (model[k] < 0)
+            model[k] = stamp;
+          break;
+        case 1:
+          shared_trie.insert_or_assign(key, stamp);
+          model[k] = stamp;
+          break;
+        case 2:
+          if (shared_trie.erase(key) != (model[k] >= 0 ? 1u : 0u))
+            ++failures;
+          model[k] = -1;
+          break;
+        case 3: {
+          int other = rand_r(&seed) % (owned_keys * threads);
+          auto value =
+              shared_trie.find(owned(other / owned_keys, other % owned_keys));
+          if (value) {
+            if (*value < seen[other])
+              ++failures;
+            seen[other] = *value;
+          }
+          if (shared_trie.find(key).value_or(-1) != model[k])
+            ++failures;
+          break;
+        }
+        default: {
+          std::size_t s = rand_r(&seed) % shared_keys.size();
+          if (rand_r(&seed) % 2) {
+            if (shared_trie.insert(shared_keys[s], 0))
+              ++net[s];
+          } else if (shared_trie.erase(shared_keys[s])) {
+            --net[s];
+          }
+        }
+        }
+      }
+      for (int k = 0; k < owned_keys; ++k) {
+        std::string key = owned(t, k);
+        if (shared_trie.find(key).value_or(-1) != model[k])
+          ++failures;
+        shared_trie.erase(key);
+      }
+    });
+  }
+  for (auto &writer : writers)
+    writer.join();
+  assert(failures.load() == 0);
+
+  std::size_t left = 0;
+  for (std::size_t s = 0; s < shared_keys.size(); ++s) {
+    long present = shared_trie.count(shared_keys[s]);
+    assert(net[s].load() == present);
+    left += net[s].load();
+  }
+  assert(shared_trie.size() == left);
+  std::cout << "mixed writers: check" << std::endl;
+
+  shared_trie.clear();
+  assert(shared_trie.empty());
+  std::vector<std::thread> builders;
+  for (int t = 0; t < threads; ++t)
+    builders.emplace_back([&, t] {
+      for (int k = 0; k < 500; ++k)
+        shared_trie.insert(std::to_string(t) + "/" + std::to_string(k), k);
+    });
+  for (auto &builder : builders)
+    builder.join();
+  assert(shared_trie.size() == static_cast<std::size_t>(threads) * 500);
+  assert(shared_trie.at("3/250") == 250);
+  std::cout << "disjoint inserts: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_concurrent_trie_writers ###" << std::endl;
+}
+
+void test_persistent_trie() {
+  std::cout << "### start of test_persistent_trie ###" << std::endl
+            << std::endl;
+
+  persistent_trie<int> live;
+  assert(live.insert("ab", 1) && live.insert("abc", 2) && live.insert("b", 3));
+  assert(!live.insert("ab", 4) && !live.insert("", 4));
+  assert(live.size() == 3 && live.at("abc") == 2 && !live.contains("a"));
+
+  auto first = live.snapshot();
+  assert(live.shared_node_count(first) == live.node_count());
+  assert(!live.insert_or_assign("ab", 10));
+  assert(live.insert("abd", 5));
+  assert(live.erase("b") == 1 && live.erase("b") == 0);
+  assert(live.size() == 3 && live.at("ab") == 10 && !live.contains("b"));
+  assert(first.size() == 3 && first.at("ab") == 1 && first.contains("b"));
+  assert(!first.contains("abd") && first.count_prefix("ab") == 2);
+  assert(live.count_prefix("ab") == 3);
+
+  // Only the root and the nodes for "a", "ab" were copied; "abc" is shared.
+  assert(live.shared_node_count(first) == 1);
+  std::cout << "snapshot isolation: check" << std::endl;
+
+  std::string keys;
+  live.for_each([&](std::string_view key, int value) {
+    keys += std::string(key) + "=" + std::to_string(value) + " ";
+  });
+  assert(keys == "ab=10 abc=2 abd=5 ");
+  keys.clear();
+  first.for_each_prefix("abc", [&](std::string_view key, int) {
+    keys += std::string(key) + " ";
+  });
+  assert(keys == "abc ");
+  std::cout << "ordered walk: check" << std::endl;
+
+  assert(live.erase("abd") == 1 && live.erase("abc") == 1);
+  assert(live.erase("ab") == 1 && live.empty() && live.node_count() == 1);
+  assert(first.size() == 3 && first.at("abc") == 2);
+  live = first;
+  assert(live.at("b") == 3);
+  live.clear();
+  assert(live.empty() && first.size() == 3);
+  std::cout << "erase and clear: check" << std::endl;
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::thread reader([&] {
+    while (!done.load()) {
+      auto view = live.snapshot();
+      std::size_t counted = 0;
+      view.for_each([&](std::string_view key, int value) {
+        counted += static_cast<int>(key.length()) == value;
+      });
+      if (counted != view.size())
+        ++failures;
+    }
+  });
+  for (int i = 0; i < 2000; ++i) {
+    std::string key = "k" + std::to_string(i % 97);
+    if (i % 3 == 2)
+      live.erase(key);
+    else
+      live.insert_or_assign(key, static_cast<int>(key.length()));
+  }
+  done.store(true);
+  reader.join();
+  assert(failures.load() == 0);
+  std::cout << "snapshots under a writer: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_persistent_trie ###" << std::endl;
+}
+
+void test_trie_save_load() {
+  std::cout << "### start of test_trie_save_load ###" << std::endl
+            << std::endl;
+
+  const std::string path = "test_trie_save_load.img";
+  std::vector<std::string> keys = {"a",   "ab",    "abc",  "abd", "b",
+                                   "bcd", "bcdef", "\xff", "zz",  "-x"};
+  for (bool compressed : {false, true}) {
+    trie<long> source(compressed);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      source.insert(keys[i], static_cast<long>(i * 10));
+    source.save(path);
+    auto image = trie<long>::load(path);
+
+    assert(image.size() == source.size() && !image.empty());
+    assert(image.node_count() == source.node_count());
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      assert(image.at(keys[i]) == static_cast<long>(i * 10));
+    assert(!image.contains("") && !image.contains("bc") &&
+           !image.contains("abcd") && image.find("q") == nullptr);
+    bool thrown = false;
+    try {
+      image.at("bcde");
+    } catch (const std::out_of_range &) {
+      thrown = true;
+    }
+    assert(thrown);
+    assert(image.count_prefix("") == keys.size());
+    assert(image.count_prefix("ab") == 3 && image.count_prefix("bc") == 2);
+    assert(image.count_prefix("bcde") == 1 && image.count_prefix("c") == 0);
+
+    auto it = source.begin();
+    std::size_t visited = 0;
+    image.for_each([&](std::string_view key, long value) {
+      assert(it->get_key().substr(1) == key && *it->get_value() == value);
+      ++it;
+      ++visited;
+    });
+    assert(visited == keys.size() && it == source.end());
+    std::string scanned;
+    image.for_each_prefix("bcd", [&](std::string_view key, long) {
+      scanned += std::string(key) + " ";
+    });
+    assert(scanned == "bcd bcdef ");
+    scanned.clear();
+    image.for_each_prefix("bcde", [&](std::string_view key, long) {
+      scanned += std::string(key) + " ";
+    });
+    assert(scanned == "bcdef ");
+
+    it = source.begin();
+    for (auto image_it = image.begin(); image_it != image.end(); ++image_it) {
+      assert(it->get_key().substr(1) == image_it.key());
+      assert(*it->get_value() == *image_it);
+      ++it;
+    }
+    assert(it == source.end());
+    std::vector<std::string> ranged;
+    for (std::string prefix : {"bcd", "bcde", "ab", "q", "abce"}) {
+      auto [first, last] = image.prefix_range(prefix);
+      for (; first != last; first++)
+        ranged.push_back(std::string(first.key()) + "=" +
+                         std::to_string(*first));
+      ranged.push_back("|");
+    }
+    assert((ranged == std::vector<std::string>{
+                          "bcd=50", "bcdef=60", "|", "bcdef=60", "|", "ab=10",
+                          "abc=20", "abd=30", "|", "|", "|"}));
+
+    auto moved = std::move(image);
+    assert(moved.at("zz") == 80);
+  }
+  std::cout << "round trip: check" << std::endl;
+
+  trie<long> first_trie;
+  first_trie.insert("kept", 1);
+  first_trie.save(path);
+  auto mapped = trie<long>::load(path);
+  trie<long> second_trie;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    second_trie.insert(keys[i], static_cast<long>(i));
+  second_trie.save(path);
+  assert(mapped.size() == 1 && mapped.at("kept") == 1);
+  assert(trie<long>::load(path).size() == keys.size());
+  std::vector<std::thread> savers;
+  for (const trie<long> *saved : {&first_trie, &second_trie})
+    savers.emplace_back([saved, &path] {
+      for (int round = 0; round < 20; ++round)
+        saved->save(path);
+    });
+  for (auto &saver : savers)
+    saver.join();
+  auto last_saved = trie<long>::load(path);
+  assert(last_saved.size() == 1 ? last_saved.at("kept") == 1
+                                : last_saved.at("zz") == 8);
+  std::size_t leftovers = 0;
+  for (const auto &entry : std::filesystem::directory_iterator("."))
+    leftovers += entry.path().filename().string().rfind(path + ".", 0) == 0;
+  assert(leftovers == 0);
+  std::cout << "save over a mapped image: check" << std::endl;
+
+  trie<int> empty_trie;
+  empty_trie.save(path);
+  auto empty_image = trie<int>::load(path);
+  assert(empty_image.empty() && empty_image.count_prefix("") == 0);
+  bool thrown = false;
+  try {
+    trie<long>::load(path);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  std::remove(path.c_str());
+  thrown = false;
+  try {
+    trie<int>::load(path);
+  } catch (const std::system_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  std::cout << "empty and mismatched images: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_save_load ###" << std::endl;
+}
+
+void test_trie_freeze() {
+  std::cout << "### start of test_trie_freeze ###" << std::endl << std::endl;
+
+  std::vector<std::string> keys = {"a",   "ab",    "abc",  "abd", "b",
+                                   "bcd", "bcdef", "\xff", "zz",  "-x"};
+  for (bool compressed : {false, true}) {
+    trie<std::string> source(compressed);
+    for (const auto &key : keys)
+      source.insert(key, key + "!");
+    auto frozen = source.freeze();
+
+    assert(frozen.size() == keys.size() && !frozen.empty());
+    for (const auto &key : keys)
+      assert(frozen.at(key) == key + "!" && frozen.count(key) == 1);
+    assert(!frozen.contains("") && !frozen.contains("bc") &&
+           !frozen.contains("abcd") && frozen.find("bcde") == nullptr);
+    bool thrown = false;
+    try {
+      frozen.at("q");
+    } catch (const std::out_of_range &) {
+      thrown = true;
+    }
+    assert(thrown);
+
+    auto it = source.begin();
+    frozen.for_each([&](std::string_view key, const std::string &value) {
+      assert(it->get_key().substr(1) == key && *it->get_value() == value);
+      ++it;
+    });
+    assert(it == source.end());
+    std::string scanned;
+    frozen.for_each_prefix("bcde", [&](std::string_view key,
+                                       const std::string &) {
+      scanned += std::string(key) + " ";
+    });
+    assert(scanned == "bcdef ");
+
+    it = source.begin();
+    for (auto frozen_it = frozen.begin(); frozen_it != frozen.end();
+         frozen_it++) {
+      assert(it->get_key().substr(1) == frozen_it.key());
+      assert(*it->get_value() == *frozen_it && frozen_it->back() == '!');
+      ++it;
+    }
+    assert(it == source.end());
+    std::vector<std::string> ranged;
+    for (std::string prefix : {"ab", "bcde", "b", "q", "abce"}) {
+      auto [first, last] = frozen.prefix_range(prefix);
+      for (; first != last; ++first)
+        ranged.emplace_back(first.key());
+      ranged.push_back("|");
+    }
+    assert((ranged == std::vector<std::string>{"ab", "abc", "abd", "|",
+                                               "bcdef", "|", "b", "bcd",
+                                               "bcdef", "|", "|", "|"}));
+  }
+  // Labels expand to one node per character down to the branch, and the
+  // unique suffixes below it become tails.
+  trie<int> compressed_trie(true);
+  compressed_trie.insert("abcdef", 1);
+  compressed_trie.insert("abcxyz", 2);
+  compressed_trie.insert("abcx", 3);
+  auto chains = compressed_trie.freeze();
+  assert(chains.node_count() == 7);
+  assert(chains.at("abcdef") == 1 && chains.at("abcxyz") == 2);
+  assert(chains.at("abcx") == 3 && !chains.contains("abcxy"));
+  assert(!chains.contains("abcd") && !chains.contains("abcdefg"));
+  std::string scanned;
+  chains.for_each_prefix("abcxy", [&](std::string_view key, int) {
+    scanned += std::string(key) + " ";
+  });
+  assert(scanned == "abcxyz ");
+  std::cout << "lookup and order: check" << std::endl;
+
+  // Enough nodes to span several rank and select blocks.
+  trie<int> large_trie;
+  std::set<std::string> large_keys;
+  srand(7);
+  while (large_keys.size() < 3000) {
+    std::string key;
+    for (int length = 1 + rand() % 8; length > 0; --length)
+      key += static_cast<char>('a' + rand() % 20);
+    large_keys.insert(key);
+  }
+  int i = 0;
+  for (const auto &key : large_keys)
+    large_trie.insert(key, i++);
+  auto frozen = large_trie.freeze();
+  assert(frozen.node_count() < large_trie.node_count());
+  i = 0;
+  for (const auto &key : large_keys)
+    assert(frozen.at(key) == i++);
+  auto next = large_keys.begin();
+  frozen.for_each([&](std::string_view key, int) {
+    assert(*next++ == key);
+  });
+  assert(next == large_keys.end());
+  next = large_keys.begin();
+  for (auto it = frozen.begin(); it != frozen.end(); ++it)
+    assert(*next++ == it.key());
+  assert(next == large_keys.end());
+  std::cout << "many blocks: check" << std::endl;
+
+  std::cout << std::endl << "### end of test_trie_freeze ###" << std::endl;
+}
+
+// Written once against basic_trie, so it has to compile on every backend.
+template <typename _Backend> void check_backend() {
+  basic_trie<int, _Backend> backend_trie;
+  assert(backend_trie.insert("tea", 1).second);
+  assert(backend_trie.insert_or_assign("ten", 2).second);
+  backend_trie["to"] = 3;
+  assert(backend_trie.at("ten") == 2 && backend_trie["to"].value() == 3);
+  std::string keys;
+  for (auto it = backend_trie.begin(); it != backend_trie.end(); ++it) {
+    keys += std::string(it.key()) + std::to_string(*it->get_value());
+    (*it).get_value() = *it->get_value() * 10;
+  }
+  assert(keys == "tea1ten2to3");
+  const auto &const_trie = backend_trie;
+  assert(const_trie.find("ten")->get_value() == 20);
+  assert(const_trie.at("to").value_or(-1) == 30);
+  assert(backend_trie.erase("tea") == 1 && backend_trie.size() == 2);
+  assert(backend_trie.count("tea") == 0 && backend_trie.contains("to"));
+  assert(!backend_trie.insert("", 4).second && !backend_trie.contains(""));
+  assert(backend_trie.size() == 2);
+  bool thrown = false;
+  try {
+    backend_trie[""] = 4;
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown && backend_trie.size() == 2);
+}
+
+void test_double_array_trie() {
+  std::cout << "### start of test_double_array_trie ###" << std::endl
+            << std::endl;
+
+  basic_trie<int, double_array_backend> da_trie;
+  assert(da_trie.empty() && da_trie.begin() == da_trie.end());
+  std::vector<std::string> keys = {"to", "tea", "ted", "ten",      "i",
+                                   "in", "inn", "A",   "\xff\x01", "-z"};
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    auto inserted = da_trie.insert(keys[i], static_cast<int>(i));
+    assert(inserted.second &&
+           inserted.first->get_value() == static_cast<int>(i));
+  }
+  assert(!da_trie.insert("tea", 100).second && da_trie.at("tea") == 1);
+  assert(!da_trie.insert_or_assign("tea", 100).second);
+  assert(da_trie.at("tea") == 100 && da_trie.size() == keys.size());
+  assert(da_trie.insert("", 8) == std::make_pair(da_trie.end(), false));
+  assert(!da_trie.contains("") && da_trie.size() == keys.size());
+  assert(!da_trie.contains("t") && !da_trie.contains("tean"));
+  assert(da_trie.count("inn") == 1 && da_trie.find("x") == da_trie.end());
+  assert(da_trie.find("ten").key() == "ten");
+  da_trie["new"] = 42;
+  assert(da_trie.at("new") == 42 && da_trie["new"] == 42);
+  bool thrown = false;
+  try {
+    da_trie.at("te");
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  std::cout << "insert and lookup: check" << std::endl;
+
+  // Same order as the node trie, which sorts children like signed chars.
+  trie<int> reference;
+  for (auto it = da_trie.begin(); it != da_trie.end(); ++it)
+    reference.insert(it.key(), *it->get_value());
+  auto expected = reference.begin();
+  std::vector<std::string> forwards;
+  for (auto it = da_trie.begin(); it != da_trie.end(); ++it, ++expected) {
+    assert(expected->get_key().substr(1) == it.key());
+    forwards.emplace_back(it.key());
+  }
+  assert(expected == reference.end());
+  std::vector<std::string> backwards;
+  for (auto it = da_trie.end(); it != da_trie.begin();) {
+    --it;
+    backwards.emplace_back(it.key());
+  }
+  assert(std::equal(forwards.rbegin(), forwards.rend(), backwards.begin()));
+  auto last = da_trie.end();
+  --last;
+  assert(last.key() == "to");
+  auto first = da_trie.find("A");
+  --first;
+  assert(first.key() == "-z");
+  std::cout << "ordered iteration: check" << std::endl;
+
+  assert(da_trie.erase("te") == 0 && da_trie.erase("tea") == 1);
+  assert(!da_trie.contains("tea") && da_trie.at("ted") == 2);
+  auto after = da_trie.erase(da_trie.find("in"));
+  assert(after.key() == "inn" && !da_trie.contains("in"));
+  assert(da_trie.at("i") == 4 && da_trie.at("inn") == 6);
+  assert(da_trie.size() == keys.size() - 1);
+  std::cout << "erase: check" << std::endl;
+
+  std::map<std::string, int> model;
+  for (auto it = da_trie.begin(); it != da_trie.end(); ++it)
+    model[std::string(it.key())] = *it->get_value();
+  srand(11);
+  for (int i = 0; i < 20000; ++i) {
+    std::string key;
+    for (int length = 1 + rand() % 5; length > 0; --length)
+      key += static_cast<char>(rand() % 2 ? 'a' + rand() % 26 : rand() % 256);
+    if (rand() % 3 == 0) {
+      assert(da_trie.erase(key) == model.erase(key));
+    } else {
+      da_trie.insert_or_assign(key, i);
+      model[key] = i;
+    }
+  }
+  auto check_model = [&] {
+    assert(da_trie.size() == model.size());
+    for (const auto &entry : model)
+      assert(da_trie.at(entry.first) == entry.second);
+    std::size_t visited = 0;
+    for (auto it = da_trie.begin(); it != da_trie.end(); ++it) {
+      assert(model.count(std::string(it.key())) == 1);
+      ++visited;
+    }
+    assert(visited == model.size());
+  };
+  check_model();
+  std::size_t slots = da_trie.slot_count();
+  da_trie.compact();
+  assert(da_trie.slot_count() <= slots);
+  check_model();
+  da_trie.insert("after compaction", 1);
+  assert(da_trie.at("after compaction") == 1);
+  da_trie.clear();
+  assert(da_trie.empty() && !da_trie.contains("after compaction"));
+  std::cout << "random updates and compaction: check" << std::endl;
+
+  check_backend<node_backend>();
+  check_backend<double_array_backend>();
+  std::cout << "same interface as node_backend: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_double_array_trie ###" << std::endl;
+}
+
+void test_trie_find_batch() {
+  std::cout << "### start of test_trie_find_batch ###" << std::endl
+            << std::endl;
+
+  for (bool compressed : {false, true}) {
+    trie<int> batch_trie(compressed);
+    std::vector<std::string> stored;
+    for (int i = 0; i < 300; ++i) {
+      stored.push_back("key/" + std::to_string(i * 7));
+      batch_trie.insert(stored.back(), i);
+    }
+    batch_trie.insert("k", -1);
+    std::vector<std::string> probes = {"", "k", "ke", "key/", "key/7x"};
+    for (int i = 0; i < 100; ++i)
+      probes.push_back("key/" + std::to_string(i));
+    probes.insert(probes.end(), stored.begin(), stored.end());
+    std::vector<std::string_view> views(probes.begin(), probes.end());
+
+    std::vector<trie<int>::iterator> found(views.size(), batch_trie.end());
+    std::unique_ptr<bool[]> present(new bool[views.size()]);
+    batch_trie.find_batch(views.data(), views.size(), found.data());
+    batch_trie.contains_batch(views.data(), views.size(), present.get());
+    const trie<int> &const_trie = batch_trie;
+    std::vector<trie<int>::const_iterator> const_found(views.size(),
+                                                      const_trie.cend());
+    const_trie.find_batch(views.data(), views.size(), const_found.data());
+    for (std::size_t i = 0; i < views.size(); ++i) {
+      assert(found[i] == batch_trie.find(views[i]));
+      assert(const_found[i] == const_trie.find(views[i]));
+      assert(present[i] == batch_trie.contains(views[i]));
+    }
+    assert(present[1] && !present[2] && present[views.size() - 1]);
+  }
+  std::cout << "matches find and contains: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_find_batch ###" << std::endl;
+}
+
+void test_trie_prefixes_of() {
+  std::cout << "### start of test_trie_prefixes_of ###" << std::endl
+            << std::endl;
+
+  for (bool compressed : {false, true}) {
+    trie<int> routes(compressed);
+    routes.insert("/", 1);
+    routes.insert("/api", 2);
+    routes.insert("/api/v1", 3);
+    routes.insert("/api/v1/users", 4);
+    routes.insert("/static", 5);
+
+    auto longest = routes.longest_prefix_of("/api/v1/users/42");
+    assert(longest != routes.end() && *longest->get_value() == 4);
+    assert(longest.key() == "/api/v1/users");
+    assert(*routes.longest_prefix_of("/api/v2")->get_value() == 2);
+    assert(*routes.longest_prefix_of("/api/v1")->get_value() == 3);
+    assert(*routes.longest_prefix_of("/stat")->get_value() == 1);
+    assert(routes.longest_prefix_of("api") == routes.end());
+    assert(routes.longest_prefix_of("") == routes.end());
+
+    std::vector<trie<int>::iterator> found;
+    routes.prefixes_of("/api/v1/users", std::back_inserter(found));
+    assert(found.size() == 4);
+    for (std::size_t i = 0; i < found.size(); ++i)
+      assert(*found[i]->get_value() == static_cast<int>(i + 1));
+    const trie<int> &const_routes = routes;
+    trie<int>::const_iterator buffer[8] = {
+        const_routes.cend(), const_routes.cend(), const_routes.cend(),
+        const_routes.cend(), const_routes.cend(), const_routes.cend(),
+        const_routes.cend(), const_routes.cend()};
+    auto last = const_routes.prefixes_of("/static/app.js", buffer);
+    assert(last - buffer == 2 && buffer[1].key() == "/static");
+  }
+  std::cout << "longest and all prefixes: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_prefixes_of ###" << std::endl;
+}
+
+std::size_t edit_distance(std::string_view a, std::string_view b) {
+  std::vector<std::size_t> row(b.length() + 1);
+  for (std::size_t j = 0; j <= b.length(); ++j)
+    row[j] = j;
+  for (std::size_t i = 1; i <= a.length(); ++i) {
+    std::size_t diagonal = row[0];
+    row[0] = i;
+    for (std::size_t j = 1; j <= b.length(); ++j) {
+      std::size_t above = row[j];
+      row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                         diagonal + (a[i - 1] != b[j - 1])});
+      diagonal = above;
+    }
+  }
+  return row[b.length()];
+}
+
+void test_trie_fuzzy_find() {
+  std::cout << "### start of test_trie_fuzzy_find ###" << std::endl
+            << std::endl;
+
+  std::vector<std::string> words = {"cat",   "cart", "care", "cast",  "dog",
+                                    "dot",   "do",   "a",    "catalog", "at",
+                                    "scat",  "cut",  "coat", "caterpillar"};
+  srand(5);
+  for (int i = 0; i < 400; ++i) {
+    std::string word;
+    for (int length = 1 + rand() % 7; length > 0; --length)
+      word += static_cast<char>('a' + rand() % 6);
+    words.push_back(word);
+  }
+  std::vector<std::string> queries = {"cat", "", "dgo", "caterpilar", "xyz",
+                                      "abcdef", "fedcba", "aaa"};
+  for (bool compressed : {false, true}) {
+    trie<int> dictionary(compressed);
+    for (std::size_t i = 0; i < words.size(); ++i)
+      dictionary.insert(words[i], static_cast<int>(i));
+    for (const auto &query : queries) {
+      for (std::size_t distance = 0; distance <= 2; ++distance) {
+        std::map<std::string, std::size_t> expected;
+        for (auto it = dictionary.begin(); it != dictionary.end(); ++it) {
+          std::size_t d = edit_distance(it.key(), query);
+          if (d <= distance)
+            expected[std::string(it.key())] = d;
+        }
+        auto matches = dictionary.fuzzy_find(query, distance);
+        assert(matches.size() == expected.size());
+        std::string previous;
+        for (auto &match : matches) {
+          std::string key(match.first.key());
+          assert(expected.count(key) && expected[key] == match.second);
+          assert(previous.empty() || previous < key);
+          previous = key;
+        }
+      }
+    }
+  }
+  trie<int> dictionary;
+  dictionary.insert("hello", 1);
+  const trie<int> &const_dictionary = dictionary;
+  auto close = const_dictionary.fuzzy_find("helo", 1);
+  assert(close.size() == 1 && close[0].second == 1);
+  assert(*close[0].first->get_value() == 1);
+  std::cout << "matches brute force: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_fuzzy_find ###" << std::endl;
+}
+
+// Reference glob matcher for test_trie_match, by plain recursion.
+bool glob_matches(std::string_view pattern, std::string_view key) {
+  if (pattern.empty())
+    return key.empty();
+  if (pattern[0] == '*')
+    return glob_matches(pattern.substr(1), key) ||
+           (!key.empty() && glob_matches(pattern, key.substr(1)));
+  if (key.empty())
+    return false;
+  std::size_t first = 1;
+  if (pattern.length() > 1 && (pattern[1] == '!' || pattern[1] == '^'))
+    ++first;
+  std::size_t end = pattern.find(']', first + 1);
+  if (pattern[0] == '[' && end != std::string_view::npos) {
+    bool negated = first == 2;
+    bool found = false;
+    for (std::size_t i = 1 + negated; i < end; ++i) {
+      if (i + 2 < end && pattern[i + 1] == '-') {
+        found |= pattern[i] <= key[0] && key[0] <= pattern[i + 2];
+        i += 2;
+      } else {
+        found |= pattern[i] == key[0];
+      }
+    }
+    return found != negated &&
+           glob_matches(pattern.substr(end + 1), key.substr(1));
+  }
+  if (pattern[0] == '\\' && pattern.length() > 1)
+    return pattern[1] == key[0] &&
+           glob_matches(pattern.substr(2), key.substr(1));
+  return (pattern[0] == '?' || pattern[0] == key[0]) &&
+         glob_matches(pattern.substr(1), key.substr(1));
+}
+
+void test_trie_match() {
+  std::cout << "### start of test_trie_match ###" << std::endl << std::endl;
+
+  std::vector<std::string> words = {"user.alice.prefs", "user.bob.prefs",
+                                    "user.bob.mail",    "user.prefs",
+                                    "abc",              "axc",
+                                    "ac",               "a*c",
+                                    "a?c"};
+  srand(6);
+  for (int i = 0; i < 400; ++i) {
+    std::string word;
+    for (int length = 1 + rand() % 8; length > 0; --length)
+      word += static_cast<char>('a' + rand() % 5);
+    words.push_back(word);
+  }
+  // Malformed classes fall back to literal characters.
+  for (std::string word : {"[!]", "[^]", "[", "[!", "[]", "a[b", "]", "\\",
+                           "b\\", "[]a]", "-", "a-"})
+    words.push_back(word);
+  std::vector<std::string> patterns = {
+      "user.*.prefs", "a?c*", "*",     "?",      "",       "a*c",
+      "*a*b*",        "[a-c]?[!d]*",   "[^ab]*e", "a\\*c", "a\\?c",
+      "*[cd]",        "b**a",  "e??",   "abcdeabcde", "[]a]*",
+      "[!]",          "[^]",   "[",     "[!",     "[]",     "a[b",
+      "[!]]*",        "[^]a]", "*\\",  "[a-]*"};
+  for (bool compressed : {false, true}) {
+    trie<int> dictionary(compressed);
+    for (std::size_t i = 0; i < words.size(); ++i)
+      dictionary.insert(words[i], static_cast<int>(i));
+    for (const auto &pattern : patterns) {
+      std::vector<std::string> expected;
+      for (auto it = dictionary.begin(); it != dictionary.end(); ++it)
+        if (glob_matches(pattern, it.key()))
+          expected.emplace_back(it.key());
+      std::vector<std::string> matched;
+      auto [it, last] = dictionary.match(pattern);
+      for (; it != last; ++it) {
+        assert(it->get_value() != std::nullopt);
+        assert(words[*it->get_value()] == it.key());
+        matched.emplace_back(it.key());
+      }
+      assert(matched == expected);
+    }
+  }
+  std::cout << "matches brute force: check" << std::endl;
+
+  trie<int> dictionary;
+  for (std::size_t i = 0; i < words.size(); ++i)
+    dictionary.insert(words[i], static_cast<int>(i));
+  for (std::string pattern : {"[!]", "[^]", "[", "[!", "[]", "a[b"}) {
+    auto [it, last] = dictionary.match(pattern);
+    assert(it != last && it.key() == pattern && ++it == last);
+  }
+  std::cout << "malformed classes: check" << std::endl;
+  const trie<int> &const_dictionary = dictionary;
+  auto first = const_dictionary.match("user.*.prefs").first;
+  assert(first.key() == "user.alice.prefs");
+  ++first;
+  assert(first.key() == "user.bob.prefs");
+  assert(++first == const_dictionary.match("user.*.prefs").second);
+  auto some = dictionary.match("*");
+  (*some.first).get_value() = -1;
+  assert(dictionary.at(std::string(some.first.key())) == -1);
+  std::cout << "lazy iteration: check" << std::endl;
+
+  std::cout << std::endl << "### end of test_trie_match ###" << std::endl;
+}
+
+// Scores of the top_k() result next to the k best scores by brute force.
+void check_top_k(trie<int> &dictionary, std::string_view prefix,
+                 std::size_t k) {
+  std::vector<int> expected;
+  auto range = dictionary.prefix_range(prefix);
+  for (auto it = range.first; it != range.second; ++it)
+    expected.push_back(*it->get_value());
+  std::sort(expected.rbegin(), expected.rend());
+  expected.resize(std::min(k, expected.size()));
+  std::vector<int> scores;
+  for (auto it : dictionary.top_k(prefix, k)) {
+    assert(it.key().substr(0, prefix.length()) == prefix);
+    scores.push_back(*it->get_value());
+  }
+  assert(scores == expected);
+}
+
+void test_trie_top_k() {
+  std::cout << "### start of test_trie_top_k ###" << std::endl << std::endl;
+
+  srand(7);
+  std::vector<std::string> words;
+  for (int i = 0; i < 600; ++i) {
+    std::string word;
+    for (int length = 1 + rand() % 6; length > 0; --length)
+      word += static_cast<char>('a' + rand() % 4);
+    words.push_back(word);
+  }
+  std::vector<std::string> prefixes = {"", "a", "ab", "cdc", "dddd", "x"};
+  for (bool compressed : {false, true}) {
+    trie<int> dictionary(compressed);
+    for (std::size_t i = 0; i < words.size() / 2; ++i)
+      dictionary.insert_or_assign(words[i], rand() % 1000);
+    assert(!dictionary.max_scores());
+    for (const auto &prefix : prefixes)
+      check_top_k(dictionary, prefix, 10);
+    dictionary.enable_max_scores();
+    assert(dictionary.max_scores());
+    for (std::size_t i = words.size() / 2; i < words.size(); ++i)
+      dictionary.insert_or_assign(words[i], rand() % 1000);
+    for (const auto &prefix : prefixes)
+      for (std::size_t k : {0, 1, 5, 50, 1000})
+        check_top_k(dictionary, prefix, k);
+
+    for (int round = 0; round < 200; ++round) {
+      const auto &word = words[rand() % words.size()];
+      if (round % 3 == 0)
+        dictionary.erase(word);
+      else if (round % 3 == 1)
+        dictionary.insert_or_assign(word, rand() % 1000);
+      else
+        dictionary.insert_or_assign(word, -1);
+      check_top_k(dictionary, prefixes[round % prefixes.size()], 7);
+    }
+    dictionary.erase_prefix("ab");
+    dictionary.erase_prefix("d");
+    for (const auto &prefix : prefixes)
+      check_top_k(dictionary, prefix, 20);
+
+    trie<int> copy(dictionary);
+    assert(copy.max_scores());
+    for (const auto &prefix : prefixes)
+      check_top_k(copy, prefix, 20);
+  }
+  std::cout << "best first matches brute force: check" << std::endl;
+
+  std::vector<std::pair<std::string, int>> entries;
+  for (std::size_t i = 0; i < words.size(); ++i)
+    entries.emplace_back(words[i], static_cast<int>(i));
+  std::sort(entries.begin(), entries.end());
+  trie<int> built(true);
+  built.enable_max_scores();
+  built.build_sorted(entries.begin(), entries.end());
+  trie<int> parallel;
+  parallel.enable_max_scores();
+  parallel.build_parallel(entries.begin(), entries.end(), 3);
+  for (const auto &prefix : prefixes) {
+    check_top_k(built, prefix, 15);
+    check_top_k(parallel, prefix, 15);
+  }
+  const trie<int> &const_built = built;
+  auto best = const_built.top_k("", 1);
+  assert(best.size() == 1);
+  int highest = -1;
+  for (auto it = built.cbegin(); it != built.cend(); ++it)
+    highest = std::max(highest, *it->get_value());
+  assert(*best[0]->get_value() == highest);
+  const trie<int> &const_parallel = parallel;
+  best = const_parallel.top_k("", 1);
+  assert(best.size() == 1 && *best[0]->get_value() == highest);
+  std::cout << "bulk builds: check" << std::endl;
+
+  float (*lowest)(const int &) = [](const int &value) -> float {
+    return -value;
+  };
+  trie<int> ranked;
+  for (std::size_t i = 0; i < words.size(); ++i)
+    ranked.insert(words[i], static_cast<int>(i));
+  auto lowest_of = [&ranked, lowest](std::string_view prefix) {
+    std::vector<int> values;
+    for (auto it : ranked.top_k(prefix, 3, lowest))
+      values.push_back(*it->get_value());
+    return values;
+  };
+  auto expected_lowest = [&ranked](std::string_view prefix) {
+    std::vector<int> values;
+    auto range = ranked.prefix_range(prefix);
+    for (auto it = range.first; it != range.second; ++it)
+      values.push_back(*it->get_value());
+    std::sort(values.begin(), values.end());
+    values.resize(std::min<std::size_t>(3, values.size()));
+    return values;
+  };
+  for (const auto &prefix : prefixes)
+    assert(lowest_of(prefix) == expected_lowest(prefix));
+  ranked.enable_max_scores();
+  for (const auto &prefix : prefixes)
+    assert(lowest_of(prefix) == expected_lowest(prefix));
+  ranked.enable_max_scores(lowest);
+  for (const auto &prefix : prefixes) {
+    std::vector<int> values;
+    for (auto it : ranked.top_k(prefix, 3))
+      values.push_back(*it->get_value());
+    assert(values == expected_lowest(prefix));
+  }
+
+  trie<std::string> names;
+  for (const auto &word : words)
+    names.insert(word, word + word);
+  float (*length)(const std::string &) = [](const std::string &value) {
+    return static_cast<float>(value.length());
+  };
+  bool thrown = false;
+  try {
+    names.top_k("a", 1);
+  } catch (const std::logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  auto longest = names.top_k("a", 1, length);
+  assert(longest.size() == 1 && longest[0]->get_value()->length() == 12);
+  names.enable_max_scores(length);
+  assert(names.top_k("a", 1)[0]->get_value()->length() == 12);
+  std::cout << "caller scores: check" << std::endl;
+
+  std::cout << std::endl << "### end of test_trie_top_k ###" << std::endl;
+}
+
+void test_trie_compile_scan() {
+  std::cout << "### start of test_trie_compile_scan ###" << std::endl
+            << std::endl;
+
+  trie<int> keywords;
+  keywords.insert("he", 1);
+  keywords.insert("she", 2);
+  keywords.insert("his", 3);
+  keywords.insert("hers", 4);
+  assert(!keywords.compiled());
+  bool thrown = false;
+  try {
+    keywords.scan("ushers", [](std::string_view, int) {});
+  } catch (const std::logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  keywords.compile();
+  assert(keywords.compiled());
+  std::string text = "ushers";
+  std::vector<std::pair<std::size_t, int>> found;
+  keywords.scan(text, [&](std::string_view match, int value) {
+    assert(match.data() >= text.data() &&
+           match.data() + match.length() <= text.data() + text.length());
+    found.emplace_back(match.data() - text.data(), value);
+  });
+  assert((found == std::vector<std::pair<std::size_t, int>>{
+                       {1, 2}, {2, 1}, {2, 4}}));
+  keywords.insert("us", 5);
+  assert(!keywords.compiled());
+  std::cout << "classic example: check" << std::endl;
+
+  srand(8);
+  trie<int> dictionary;
+  for (int i = 0; i < 300; ++i) {
+    std::string word;
+    for (int length = 1 + rand() % 5; length > 0; --length)
+      word += static_cast<char>('a' + rand() % 3);
+    dictionary.insert(word, i);
+  }
+  for (int round = 0; round < 3; ++round) {
+    dictionary.compile();
+    for (int t = 0; t < 20; ++t) {
+      std::string haystack;
+      for (int length = rand() % 60; length > 0; --length)
+        haystack += static_cast<char>('a' + rand() % 4);
+      std::vector<std::pair<std::size_t, int>> expected;
+      for (std::size_t end = 1; end <= haystack.length(); ++end) {
+        for (std::size_t begin = 0; begin < end; ++begin) {
+          auto it = dictionary.find(haystack.substr(begin, end - begin));
+          if (it != dictionary.end() && it->get_value() != std::nullopt)
+            expected.emplace_back(begin, *it->get_value());
+        }
+      }
+      std::vector<std::pair<std::size_t, int>> scanned;
+      dictionary.scan(haystack, [&](std::string_view match, int value) {
+        assert(dictionary.at(std::string(match)) == value);
+        scanned.emplace_back(match.data() - haystack.data(), value);
+      });
+      assert(scanned == expected);
+    }
+    for (int i = 0; i < 40; ++i) {
+      std::string word;
+      for (int length = 1 + rand() % 4; length > 0; --length)
+        word += static_cast<char>('a' + rand() % 3);
+      if (i % 2)
+        dictionary.erase(word);
+      else
+        dictionary.insert(word, 1000 + i);
+    }
+  }
+  trie<int> copy(dictionary);
+  assert(!copy.compiled());
+  copy.compile();
+  trie<int> moved(std::move(copy));
+  assert(moved.compiled());
+  std::size_t matches = 0;
+  moved.scan("abcabcabc", [&](std::string_view, int) { ++matches; });
+  assert(matches > 0);
+  std::cout << "matches brute force: check" << std::endl;
+
+  trie<int> compressed(true);
+  compressed.insert("abc", 1);
+  thrown = false;
+  try {
+    compressed.compile();
+  } catch (const std::logic_error &) {
+    thrown = true;
+  }
+  assert(thrown && !compressed.compiled());
+  std::cout << "compressed trie rejected: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_compile_scan ###" << std::endl;
+}
+
+// Random keys over the first `alphabet` symbols of _Key::value_type, checked
+// against a std::map ordered like the trie, with and without compression.
+template <typename _Key>
+void check_symbol_type(std::size_t alphabet, unsigned int seed) {
+  using traits = trie_symbol_traits<typename _Key::value_type>;
+  auto less = [](const _Key &a, const _Key &b) {
+    return std::lexicographical_compare(
+        a.begin(), a.end(), b.begin(), b.end(), [](auto x, auto y) {
+          return traits::index(x) < traits::index(y);
+        });
+  };
+  srand(seed);
+  for (bool compressed : {false, true}) {
+    trie<int, _Key> symbols(compressed);
+    std::map<_Key, int, decltype(less)> reference(less);
+    std::vector<_Key> keys;
+    for (int i = 0; i < 3000; ++i) {
+      _Key key;
+      for (int length = 1 + rand() % 6; length > 0; --length)
+        key += traits::symbol(rand() % alphabet);
+      keys.push_back(key);
+      assert(symbols.insert(key, i).second == reference.emplace(key, i).second);
+    }
+    std::vector<std::pair<_Key, int>> entries(reference.begin(),
+                                              reference.end());
+    trie<int, _Key> built(compressed);
+    assert(built.build_parallel(entries.begin(), entries.end(), 3) ==
+           reference.size());
+    auto built_it = built.begin();
+    for (auto it = symbols.begin(); it != symbols.end(); ++it, ++built_it)
+      assert(built_it.key() == it.key());
+    for (int round = 0; round < 2; ++round) {
+      assert(symbols.size() == reference.size());
+      auto it = symbols.begin();
+      for (const auto &[key, value] : reference) {
+        assert(it != symbols.end() && it.key() == key);
+        assert(*it->get_value() == value && symbols.at(key) == value);
+        ++it;
+      }
+      assert(it == symbols.end());
+      auto rit = symbols.rbegin();
+      for (auto ref = reference.rbegin(); ref != reference.rend(); ++ref) {
+        assert(rit != symbols.rend());
+        assert(*rit.base()->get_value() == ref->second);
+        ++rit;
+      }
+      assert(rit == symbols.rend());
+      for (std::size_t i = round; i < keys.size(); i += 2)
+        assert(symbols.erase(keys[i]) == reference.erase(keys[i]));
+      for (const auto &key : keys)
+        assert(symbols.count(key) == reference.count(key));
+    }
+  }
+}
+
+// Key of the first length bits of address, most significant first.
+trie_string<trie_bit> address_bits(std::uint32_t address, int length) {
+  trie_string<trie_bit> bits;
+  for (int i = 0; i < length; ++i)
+    bits += static_cast<trie_bit>((address >> (31 - i)) & 1);
+  return bits;
+}
+
+void test_trie_symbol_types() {
+  std::cout << "### start of test_trie_symbol_types ###" << std::endl
+            << std::endl;
+
+  trie<int> nul_keys;
+  std::vector<std::string> ordered = {std::string("\x80", 1),
+                                      std::string("\0", 1),
+                                      std::string("\0\0", 2),
+                                      std::string("\0a", 2),
+                                      std::string("a", 1),
+                                      std::string("a\0", 2),
+                                      std::string("a\0b", 3),
+                                      std::string("ab", 2)};
+  for (std::size_t i = ordered.size(); i-- > 0;)
+    nul_keys.insert(ordered[i], static_cast<int>(i));
+  std::size_t index = 0;
+  for (auto it = nul_keys.begin(); it != nul_keys.end(); ++it, ++index)
+    assert(it.key() == ordered[index] && *it->get_value() == int(index));
+  assert(index == ordered.size());
+  for (auto rit = nul_keys.rbegin(); rit != nul_keys.rend(); ++rit)
+    assert(*rit.base()->get_value() == int(--index));
+  assert(index == 0);
+  assert(nul_keys.erase(std::string("\0\0", 2)) == 1);
+  assert(!nul_keys.contains(std::string("\0\0", 2)));
+  assert(nul_keys.at(std::string("\0a", 2)) == 3);
+  std::cout << "embedded nul characters: check" << std::endl;
+
+  check_symbol_type<std::string>(256, 11);
+  check_symbol_type<trie_string<unsigned char>>(256, 12);
+  check_symbol_type<trie_string<std::uint32_t>>(2000, 13);
+  check_symbol_type<trie_string<std::uint32_t>>(3, 14);
+  check_symbol_type<trie_string<trie_nibble>>(16, 15);
+  check_symbol_type<trie_string<trie_bit>>(2, 16);
+  std::cout << "bytes, tokens, nibbles and bits match std::map: check"
+            << std::endl;
+
+  using bytes_key = trie_string<unsigned char>;
+  trie<unsigned char, bytes_key> bytes;
+  bytes.insert(bytes_key({0, 255}), 1);
+  bytes.insert(bytes_key({255}), 2);
+  bytes.insert(bytes_key({0}), 3);
+  assert(bytes.begin().key() == bytes_key({0}));
+  assert(bytes.rbegin().base()->get_node_key() == 255);
+  std::cout << "unsigned byte order: check" << std::endl;
+
+  trie<int, trie_string<trie_bit>> routes;
+  routes.insert(address_bits(0x0a000000, 8), 1);
+  routes.insert(address_bits(0x0a010000, 16), 2);
+  routes.insert(address_bits(0x0a010200, 24), 3);
+  routes.insert(address_bits(0xc0a80000, 16), 4);
+  auto route = [&routes](std::uint32_t address) {
+    auto it = routes.longest_prefix_of(address_bits(address, 32));
+    return it == routes.end() ? 0 : *it->get_value();
+  };
+  assert(route(0x0a010203) == 3 && route(0x0a0103ff) == 2);
+  assert(route(0x0aff0000) == 1 && route(0xc0a80101) == 4);
+  assert(route(0x0b000000) == 0);
+  std::cout << "longest prefix routing over bits: check" << std::endl;
+
+  using tokens = trie_string<std::uint32_t>;
+  trie<int, tokens> phrases;
+  phrases.insert(tokens({70000, 5}), 1);
+  phrases.insert(tokens({5}), 2);
+  phrases.insert(tokens({5, 1u << 31}), 3);
+  phrases.compile();
+  tokens text = {70000, 5, 1u << 31, 5};
+  std::vector<int> found;
+  phrases.scan(text, [&](trie_string_view<std::uint32_t>, int value) {
+    found.push_back(value);
+  });
+  assert((found == std::vector<int>{1, 2, 3, 2}));
+  std::cout << "token scan: check" << std::endl;
+
+  std::cout << std::endl
+            << "### end of test_trie_symbol_types ###" << std::endl;
+}
+
 int main() {
   std::cout << "### start of main ###" << std::endl;
 
@@ -179,6 +1942,29 @@ int main() {
   test_trie_inserts(new_trie);
   test_trie_clear_erase(new_trie);
   test_trie_emplace(new_trie);
+  test_trie_node_children();
+  test_trie_path_compression();
+  test_trie_arena();
+  test_trie_subtree_counts();
+  test_trie_prefix_range();
+  test_trie_iterator_keys();
+  test_trie_move();
+  test_trie_string_view();
+  test_trie_build_sorted();
+  test_trie_build_parallel();
+  test_concurrent_trie();
+  test_concurrent_trie_writers();
+  test_persistent_trie();
+  test_trie_save_load();
+  test_trie_freeze();
+  test_double_array_trie();
+  test_trie_find_batch();
+  test_trie_prefixes_of();
+  test_trie_fuzzy_find();
+  test_trie_match();
+  test_trie_top_k();
+  test_trie_compile_scan();
+  test_trie_symbol_types();
 
   std::cout << std::endl << "### end of main ###" << std::endl;
   return 0;
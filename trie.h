@@ -1,14 +1,35 @@
 #pragma once
 
+#include "frozen_trie.h"
+#include "mapped_trie.h"
 #include "trie_node.h"
+#include "trie_pattern.h"
 #include <cctype>
-
-template <typename _Value> class trie {
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if __has_include(<version>)
+#include <version>
+#endif
+#ifdef __cpp_lib_span
+#include <span>
+#endif
+
+template <typename _Value, typename _Key = std::string> class trie {
 public:
-  using key_type = std::string;
+  using key_type = _Key;
+  using symbol_type = typename _Key::value_type;
+  using key_view = trie_string_view<symbol_type>;
   using mapped_type = _Value;
-  using value_type = trie_node<_Value>;
+  using value_type = trie_node<_Value, symbol_type>;
   using size_type = unsigned int;
+  using score_function = float (*)(const _Value &);
+  static_assert(std::is_same_v<typename _Key::traits_type,
+                               trie_traits_t<symbol_type>>,
+                "trie keys must be trie_string<symbol>");
 
   template <typename _IterValue> struct trie_iterator {
     using iterator_category = std::bidirectional_iterator_tag;
@@ -19,14 +40,26 @@ public:
 
     enum Direction { forward = true, backward = false };
 
-    trie_iterator(pointer ptr) : _ptr(ptr), _current_key('\0') {}
+    trie_iterator(pointer ptr)
+        : _ptr(ptr), _from(nullptr),
+          _key_valid(ptr == nullptr || ptr->get_parent() == nullptr) {}
+    trie_iterator(pointer ptr, _Key key)
+        : _ptr(ptr), _from(nullptr), _key(std::move(key)),
+          _key_valid(true) {}
     reference operator*() const { return *_ptr; }
     pointer operator->() { return _ptr; }
 
+    // Key of the current element. It is kept up to date while stepping, so
+    // only an iterator built from a bare node walks the parents, once.
+    key_view key() const {
+      if (!_key_valid)
+        materialize_key();
+      return _key;
+    }
+
     trie_iterator &operator++() {
       step(forward);
-      while (_ptr &&
-             (_ptr->get_value() == std::nullopt || _current_key != '\0')) {
+      while (_ptr && (_ptr->get_value() == std::nullopt || _from != nullptr)) {
         step(forward);
       }
       return *this;
@@ -39,7 +72,9 @@ public:
     trie_iterator &operator--() {
       step(backward);
       while (_ptr && (_ptr->get_value() == std::nullopt ||
-                      _ptr->has_previous_child(_current_key))) {
+                      (_from == nullptr ? _ptr->has_children()
+                                        : _ptr->has_previous_child(
+                                              _from->get_node_key())))) {
         step(backward);
       }
       return *this;
@@ -59,58 +94,170 @@ public:
 
   private:
     pointer _ptr;
-    char _current_key;
+    // Child of _ptr the last step came up from, nullptr after stepping down.
+    pointer _from;
+    mutable _Key _key;
+    mutable bool _key_valid;
+
+    void materialize_key() const {
+      _key.clear();
+      for (auto node = _ptr; node->get_parent() != nullptr;
+           node = node->get_parent()) {
+        key_view label = node->get_label();
+        _key.append(label.rbegin(), label.rend());
+        _key += node->get_node_key();
+      }
+      std::reverse(_key.begin(), _key.end());
+      _key_valid = true;
+    }
 
     pointer get_next_child(Direction dir) {
-      std::vector<char> keys = _ptr->get_children_keys();
-
-      if (_current_key == '\0') {
-        return _ptr->get_child((dir ? keys.front() : keys.back()));
-      } else {
-        auto ckey = std::find(keys.begin(), keys.end(), _current_key);
-        if (dir) {
-          ckey++;
-          if (ckey != keys.end())
-            return _ptr->get_child((*ckey));
-        } else {
-          if (ckey != keys.begin())
-            return _ptr->get_child((*(--ckey)));
-        }
-      }
-      return nullptr;
+      if (_from == nullptr)
+        return dir ? _ptr->get_first_child() : _ptr->get_last_child();
+      return dir ? _ptr->get_next_child(_from->get_node_key())
+                 : _ptr->get_previous_child(_from->get_node_key());
     }
 
     void step(Direction dir) {
       if (_ptr->has_children()) {
         auto ptr = get_next_child(dir);
         if (ptr != nullptr) {
-          _current_key = '\0';
+          _from = nullptr;
           _ptr = ptr;
+          if (_key_valid) {
+            _key += _ptr->get_node_key();
+            _key += _ptr->get_label();
+          }
           return;
         }
       }
-      _current_key = _ptr->get_node_key();
+      _from = _ptr;
+      if (_key_valid && _ptr->get_parent() != nullptr)
+        _key.resize(_key.length() - 1 - _ptr->get_label().length());
       _ptr = _ptr->get_parent();
     }
   };
 
+  // Forward iterator over the elements whose keys match a trie_pattern, in
+  // key order. Matches are found lazily by a depth-first walk that keeps one
+  // pattern state set per level and leaves a child edge as soon as the set
+  // runs empty, so only subtrees that can still match are ever entered.
+  template <typename _IterValue> struct trie_match_iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = _IterValue;
+    using pointer = _IterValue *;
+    using reference = _IterValue &;
+
+    trie_match_iterator() : _ptr(nullptr) {}
+    trie_match_iterator(pointer root, std::string_view pattern)
+        : _pattern(std::make_shared<const trie_pattern>(pattern)),
+          _ptr(nullptr), _sets(_pattern->words()) {
+      _pattern->start(_sets.data());
+      _stack.push_back({root, root->get_first_child(), 0});
+      advance();
+    }
+    reference operator*() const { return *_ptr; }
+    pointer operator->() { return _ptr; }
+
+    std::string_view key() const { return _key; }
+
+    trie_match_iterator &operator++() {
+      advance();
+      return *this;
+    }
+    trie_match_iterator operator++(int) {
+      trie_match_iterator t = *this;
+      ++(*this);
+      return t;
+    }
+
+    friend bool operator==(const trie_match_iterator &it1,
+                           const trie_match_iterator &it2) {
+      return it1._ptr == it2._ptr;
+    };
+    friend bool operator!=(const trie_match_iterator &it1,
+                           const trie_match_iterator &it2) {
+      return it1._ptr != it2._ptr;
+    };
+
+  private:
+    // next_child is the next child of node to try, nullptr once all were.
+    struct frame {
+      pointer node;
+      pointer next_child;
+      std::size_t key_length;
+    };
+
+    std::shared_ptr<const trie_pattern> _pattern;
+    pointer _ptr;
+    std::vector<frame> _stack;
+    std::vector<std::uint64_t> _sets;
+    std::vector<std::uint64_t> _scratch;
+    std::string _key;
+
+    // Frame i's state set is at _sets[i * words()].
+    void advance() {
+      const std::size_t words = _pattern->words();
+      while (!_stack.empty()) {
+        frame &top = _stack.back();
+        pointer child = top.next_child;
+        if (child == nullptr) {
+          _stack.pop_back();
+          continue;
+        }
+        top.next_child = top.node->get_next_child(child->get_node_key());
+        _key.resize(top.key_length);
+
+        const std::size_t depth = _stack.size();
+        _sets.resize((depth + 1) * words);
+        _scratch.resize(words);
+        std::uint64_t *set = _sets.data() + depth * words;
+        bool alive = _pattern->step(set - words, child->get_node_key(), set);
+        for (char k : child->get_label()) {
+          if (!alive)
+            break;
+          alive = _pattern->step(set, k, _scratch.data());
+          std::copy(_scratch.begin(), _scratch.end(), set);
+        }
+        if (!alive)
+          continue;
+
+        _key += child->get_node_key();
+        _key += child->get_label();
+        _stack.push_back({child, child->get_first_child(), _key.length()});
+        if (child->get_value() != std::nullopt && _pattern->accepts(set)) {
+          _ptr = child;
+          return;
+        }
+      }
+      _ptr = nullptr;
+    }
+  };
+
   using iterator = trie_iterator<value_type>;
   using const_iterator = trie_iterator<const value_type>;
+  using match_iterator = trie_match_iterator<value_type>;
+  using const_match_iterator = trie_match_iterator<const value_type>;
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   trie() noexcept;
-  trie(const trie<_Value> &other_trie) noexcept;
+  explicit trie(bool path_compression) noexcept;
+  trie(const trie<_Value, _Key> &other_trie) noexcept;
+  trie(trie<_Value, _Key> &&other_trie) noexcept;
   ~trie() noexcept;
 
+  trie<_Value, _Key> &operator=(const trie<_Value, _Key> &other_trie) noexcept;
+  trie<_Value, _Key> &operator=(trie<_Value, _Key> &&other_trie) noexcept;
+
   // ###### Printers ######
   void print_tree() noexcept;
 
   // ###### Element access ######
-  std::optional<_Value> &at(const std::string &key);
-  const std::optional<_Value> &at(const std::string &key) const;
-  std::optional<_Value> &operator[](const std::string &key);
-  std::optional<_Value> &operator[](std::string &&key);
+  std::optional<_Value> &at(key_view key);
+  const std::optional<_Value> &at(key_view key) const;
+  std::optional<_Value> &operator[](key_view key);
 
   // ###### Iterators ######
   iterator begin() noexcept;
@@ -126,349 +273,1507 @@ public:
   bool empty() const noexcept;
   size_type size() const noexcept;
   size_type max_size() const noexcept;
+  std::size_t node_count() const noexcept;
+  bool compressed() const noexcept;
+  void enable_subtree_counts() noexcept;
+  bool subtree_counts() const noexcept;
+  void enable_max_scores(score_function score = default_score) noexcept;
+  bool max_scores() const noexcept;
 
   // ###### Modifiers ######
   void clear() noexcept;
-  std::pair<iterator, bool> insert(const std::string &key, const _Value &value);
-  std::pair<iterator, bool> insert(std::string &&key, _Value &&value);
-  std::pair<iterator, bool> insert_or_assign(const std::string &key,
-                                             _Value &&value);
-  std::pair<iterator, bool> insert_or_assign(std::string &&key, _Value &&value);
+  std::pair<iterator, bool> insert(key_view key, const _Value &value);
+  std::pair<iterator, bool> insert(key_view key, _Value &&value);
+  std::pair<iterator, bool> insert_or_assign(key_view key,
+                                             const _Value &value);
+  std::pair<iterator, bool> insert_or_assign(key_view key, _Value &&value);
   template <typename... Args> std::pair<iterator, bool> emplace(Args &&...args);
+  template <typename _InputIterator>
+  size_type build_sorted(_InputIterator first, _InputIterator last);
+  template <typename _RandomAccessIterator>
+  size_type
+  build_parallel(_RandomAccessIterator first, _RandomAccessIterator last,
+                 unsigned int threads = std::thread::hardware_concurrency());
   iterator erase(iterator pos);
-  size_type erase(const std::string &key);
+  size_type erase(key_view key);
+  size_type erase_prefix(key_view prefix);
 
   // ###### Lookup ######
-  size_type count(const std::string &key) const;
-  const_iterator find(const std::string &key) const;
-  iterator find(const std::string &key);
-  bool contains(const std::string &key) const;
+  size_type count(key_view key) const;
+  const_iterator find(key_view key) const;
+  iterator find(key_view key);
+  bool contains(key_view key) const;
+  void find_batch(const key_view *keys, std::size_t count,
+                  const_iterator *out) const;
+  void find_batch(const key_view *keys, std::size_t count, iterator *out);
+  void contains_batch(const key_view *keys, std::size_t count,
+                      bool *out) const;
+#ifdef __cpp_lib_span
+  void find_batch(std::span<const key_view> keys,
+                  std::span<const_iterator> out) const;
+  void find_batch(std::span<const key_view> keys, std::span<iterator> out);
+  void contains_batch(std::span<const key_view> keys,
+                      std::span<bool> out) const;
+#endif
+  size_type count_prefix(key_view prefix) const;
+  const_iterator longest_prefix_of(key_view key) const;
+  iterator longest_prefix_of(key_view key);
+  template <typename _OutputIterator>
+  _OutputIterator prefixes_of(key_view key, _OutputIterator out) const;
+  template <typename _OutputIterator>
+  _OutputIterator prefixes_of(key_view key, _OutputIterator out);
+  std::vector<std::pair<const_iterator, std::size_t>>
+  fuzzy_find(key_view query, std::size_t max_distance) const;
+  std::vector<std::pair<iterator, std::size_t>>
+  fuzzy_find(key_view query, std::size_t max_distance);
+  std::vector<const_iterator> top_k(key_view prefix, std::size_t k,
+                                    score_function score = nullptr) const;
+  std::vector<iterator> top_k(key_view prefix, std::size_t k,
+                              score_function score = nullptr);
+  std::pair<const_match_iterator, const_match_iterator>
+  match(std::string_view pattern) const;
+  std::pair<match_iterator, match_iterator> match(std::string_view pattern);
+  std::pair<const_iterator, const_iterator>
+  prefix_range(key_view prefix) const;
+  std::pair<iterator, iterator> prefix_range(key_view prefix);
+  size_type rank(key_view key) const;
+  const_iterator select(size_type index) const;
+  iterator select(size_type index);
+
+  // ###### Multi-pattern scanning ######
+  void compile();
+  bool compiled() const noexcept;
+  template <typename _Function>
+  void scan(key_view text, _Function function) const;
+
+  // ###### Serialization ######
+  void save(const std::string &path) const;
+  static mapped_trie<_Value> load(const std::string &path);
+  frozen_trie<_Value> freeze() const;
 
 private:
-  trie_node<_Value> *_base_node;
-
-  std::pair<iterator, bool> emplacer(std::string key, std::optional<_Value> value = std::nullopt);
+  static constexpr std::size_t batch_lanes = 16;
+
+  trie_arena _arena;
+  value_type *_base_node;
+  size_type _size;
+  bool _compressed;
+  bool _subtree_counts;
+  score_function _score;
+  bool _compiled;
+
+  template <typename... _Args>
+  std::pair<iterator, bool> emplacer(key_view key, _Args &&...args);
+  using build_path = std::vector<std::pair<value_type *, std::size_t>>;
+  template <typename _Entry>
+  bool build_next(_Entry &&entry, build_path &path, _Key &previous);
 
   // ###### Utilities ######
-  trie_node<_Value> *move_up(trie_node<_Value> *current_node) const noexcept;
-  trie_node<_Value> *move_down(char key,
-                               trie_node<_Value> *current_node) const noexcept;
-  std::pair<trie_node<_Value> *, bool>
-  insert_node(trie_node<_Value> *current_node, char key,
+  value_type *move_up(value_type *current_node) const noexcept;
+  value_type *move_down(symbol_type key,
+                        value_type *current_node) const noexcept;
+  value_type *find_node(key_view key) const noexcept;
+  void find_nodes(const key_view *keys, std::size_t count,
+                  value_type **out) const noexcept;
+  template <typename _Function>
+  void walk_prefixes(key_view key, _Function function) const;
+  template <typename _Function>
+  void fuzzy_walk(value_type *current_node, std::size_t depth,
+                  key_view query, std::size_t max_distance,
+                  std::vector<std::size_t> &rows, _Function &function) const;
+  value_type *find_prefix_node(key_view prefix) const noexcept;
+  value_type *select_node(size_type index) const noexcept;
+  template <typename _Iterator>
+  std::pair<_Iterator, _Iterator>
+  subtree_range(value_type *node) const noexcept;
+  size_type subtree_count(const value_type *node) const noexcept;
+  void update_counts(value_type *node, int delta) noexcept;
+  size_type recount(value_type *node) noexcept;
+  static float default_score(const _Value &value) noexcept;
+  float own_score(const value_type *node) const noexcept;
+  void raise_scores(value_type *node) noexcept;
+  void lower_scores(value_type *node, float removed) noexcept;
+  float rescore(value_type *node) noexcept;
+  void top_k_nodes(key_view prefix, std::size_t k, score_function score,
+                   std::vector<value_type *> &out) const;
+  std::pair<value_type *, bool>
+  insert_node(value_type *current_node, symbol_type key,
               const std::optional<_Value> value = std::nullopt) noexcept;
   void erase_at(iterator pos) noexcept;
-  trie_node<_Value> *release_path(trie_node<_Value> *current_node) noexcept;
+  value_type *release_path(value_type *current_node) noexcept;
 };
 
 // ###### trie ######
 
-template <typename _Value> trie<_Value>::trie() noexcept {
-  _base_node = new trie_node<_Value>('\0');
+template <typename _Value, typename _Key>
+trie<_Value, _Key>::trie() noexcept : trie(false) {}
+
+// With path compression a chain of single-child nodes is stored as one node
+// whose edge carries the whole chain (see trie_node::get_label()).
+template <typename _Value, typename _Key>
+trie<_Value, _Key>::trie(bool path_compression) noexcept {
+  _base_node = value_type::create(symbol_type(), std::nullopt, &_arena);
+  _size = 0;
+  _compressed = path_compression;
+  _subtree_counts = false;
+  _score = nullptr;
+  _compiled = false;
 }
 
-template <typename _Value>
-trie<_Value>::trie(const trie<_Value> &other_trie) noexcept {
-  _base_node = new trie_node<_Value>(*other_trie._base_node);
+template <typename _Value, typename _Key>
+trie<_Value, _Key>::trie(const trie<_Value, _Key> &other_trie) noexcept {
+  _base_node = other_trie._base_node->clone(&_arena);
+  _size = other_trie._size;
+  _compressed = other_trie._compressed;
+  _subtree_counts = other_trie._subtree_counts;
+  _score = other_trie._score;
+  _compiled = false;
 }
 
-template <typename _Value> trie<_Value>::~trie() noexcept { delete _base_node; }
+// The moved-from trie is left empty with its own fresh root.
+template <typename _Value, typename _Key>
+trie<_Value, _Key>::trie(trie<_Value, _Key> &&other_trie) noexcept
+    : _arena(std::move(other_trie._arena)) {
+  _base_node = other_trie._base_node;
+  _size = other_trie._size;
+  _compressed = other_trie._compressed;
+  _subtree_counts = other_trie._subtree_counts;
+  _score = other_trie._score;
+  _compiled = other_trie._compiled;
+  other_trie._base_node =
+      value_type::create(symbol_type(), std::nullopt, &other_trie._arena);
+  other_trie._size = 0;
+  other_trie._compiled = false;
+}
+
+// Nodes, child tables and labels all live in _arena, so unless values need
+// their destructors run the arena hands its blocks back without a walk.
+// build_parallel leaves its local tries without a root.
+template <typename _Value, typename _Key> trie<_Value, _Key>::~trie() noexcept {
+  if constexpr (!std::is_trivially_destructible_v<_Value>)
+    if (_base_node != nullptr)
+      value_type::destroy(_base_node, &_arena);
+}
+
+template <typename _Value, typename _Key>
+trie<_Value, _Key> &
+trie<_Value, _Key>::operator=(const trie<_Value, _Key> &other_trie) noexcept {
+  if (this != &other_trie)
+    *this = trie<_Value, _Key>(other_trie);
+  return *this;
+}
+
+template <typename _Value, typename _Key>
+trie<_Value, _Key> &
+trie<_Value, _Key>::operator=(trie<_Value, _Key> &&other_trie) noexcept {
+  if (this == &other_trie)
+    return *this;
+  if constexpr (!std::is_trivially_destructible_v<_Value>)
+    value_type::destroy(_base_node, &_arena);
+  _arena = std::move(other_trie._arena);
+  _base_node = other_trie._base_node;
+  _size = other_trie._size;
+  _compressed = other_trie._compressed;
+  _subtree_counts = other_trie._subtree_counts;
+  _score = other_trie._score;
+  _compiled = other_trie._compiled;
+  other_trie._base_node =
+      value_type::create(symbol_type(), std::nullopt, &other_trie._arena);
+  other_trie._size = 0;
+  other_trie._compiled = false;
+  return *this;
+}
 
 // ###### Printers ######
 
-template <typename _Value> void trie<_Value>::print_tree() noexcept {
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::print_tree() noexcept {
   _base_node->print_tree_from_this();
 }
 
 // ###### Element access ######
 
-template <typename _Value>
-std::optional<_Value> &trie<_Value>::at(const std::string &key) {
-  auto it = trie<_Value>::find(key);
-  if (it == nullptr)
+// The returned optional is always engaged. Elements are added and removed
+// through insert/erase so that size() stays accurate; resetting the
+// optional directly is not tracked.
+template <typename _Value, typename _Key>
+std::optional<_Value> &trie<_Value, _Key>::at(key_view key) {
+  auto node = find_node(key);
+  if (node == nullptr || node->get_value() == std::nullopt)
     throw std::out_of_range("");
-  return (*it).get_value();
+  return node->get_value();
 }
 
-template <typename _Value>
-const std::optional<_Value> &trie<_Value>::at(const std::string &key) const {
-  auto it = trie<_Value>::find(key);
-  if (it == nullptr)
+template <typename _Value, typename _Key>
+const std::optional<_Value> &trie<_Value, _Key>::at(key_view key) const {
+  auto node = find_node(key);
+  if (node == nullptr || node->get_value() == std::nullopt)
     throw std::out_of_range("");
-  return (*it).get_value();
-}
-
-template <typename _Value>
-std::optional<_Value> &trie<_Value>::operator[](const std::string &key) {
-  auto it = trie<_Value>::find(key);
-  if (it == nullptr)
-    it = trie<_Value>::insert(key, _Value());
-  return (*it).get_value();
+  return node->get_value();
 }
 
-template <typename _Value>
-std::optional<_Value> &trie<_Value>::operator[](std::string &&key) {
-  auto it = trie<_Value>::find(key);
-  if (it == nullptr)
-    it = trie<_Value>::insert(std::move(key), std::move(_Value())).first;
-  return (*it).get_value();
+// The empty key is never stored, so it throws like at() does.
+template <typename _Value, typename _Key>
+std::optional<_Value> &trie<_Value, _Key>::operator[](key_view key) {
+  if (key.empty())
+    throw std::out_of_range("");
+  auto node = find_node(key);
+  if (node == nullptr || node->get_value() == std::nullopt)
+    return (*emplacer(key).first).get_value();
+  return node->get_value();
 }
 
 // ###### Iterators ######
 
-template <typename _Value>
-typename trie<_Value>::iterator trie<_Value>::begin() noexcept {
-  trie<_Value>::iterator it = trie<_Value>::iterator(_base_node);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator trie<_Value, _Key>::begin() noexcept {
+  trie<_Value, _Key>::iterator it = trie<_Value, _Key>::iterator(_base_node);
   ++it;
   return it;
 }
 
-template <typename _Value>
-typename trie<_Value>::iterator trie<_Value>::end() noexcept {
-  return trie<_Value>::iterator(nullptr);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator trie<_Value, _Key>::end() noexcept {
+  return trie<_Value, _Key>::iterator(nullptr);
 }
 
-template <typename _Value>
-typename trie<_Value>::const_iterator trie<_Value>::cbegin() const noexcept {
-  trie<_Value>::const_iterator cit = trie<_Value>::const_iterator(_base_node);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_iterator
+trie<_Value, _Key>::cbegin() const noexcept {
+  trie<_Value, _Key>::const_iterator cit =
+      trie<_Value, _Key>::const_iterator(_base_node);
   ++cit;
   return cit;
 }
 
-template <typename _Value>
-typename trie<_Value>::const_iterator trie<_Value>::cend() const noexcept {
-  return trie<_Value>::const_iterator(nullptr);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_iterator
+trie<_Value, _Key>::cend() const noexcept {
+  return trie<_Value, _Key>::const_iterator(nullptr);
 }
 
-template <typename _Value>
-typename trie<_Value>::reverse_iterator trie<_Value>::rbegin() noexcept {
-  trie<_Value>::iterator it = trie<_Value>::iterator(_base_node);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::reverse_iterator
+trie<_Value, _Key>::rbegin() noexcept {
+  if (empty())
+    return rend();
+  trie<_Value, _Key>::iterator it = trie<_Value, _Key>::iterator(_base_node);
   while ((*it).has_children()) {
     --it;
   }
-  return trie<_Value>::reverse_iterator(it);
+  return trie<_Value, _Key>::reverse_iterator(it);
 }
 
-template <typename _Value>
-typename trie<_Value>::reverse_iterator trie<_Value>::rend() noexcept {
-  return trie<_Value>::reverse_iterator(nullptr);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::reverse_iterator
+trie<_Value, _Key>::rend() noexcept {
+  return trie<_Value, _Key>::reverse_iterator(nullptr);
 }
 
-template <typename _Value>
-typename trie<_Value>::const_reverse_iterator
-trie<_Value>::crbegin() const noexcept {
-  trie<_Value>::const_iterator cit = trie<_Value>::const_iterator(_base_node);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_reverse_iterator
+trie<_Value, _Key>::crbegin() const noexcept {
+  if (empty())
+    return crend();
+  trie<_Value, _Key>::const_iterator cit =
+      trie<_Value, _Key>::const_iterator(_base_node);
   while ((*cit).has_children()) {
     --cit;
   }
-  return trie<_Value>::const_reverse_iterator(cit);
+  return trie<_Value, _Key>::const_reverse_iterator(cit);
 }
 
-template <typename _Value>
-typename trie<_Value>::const_reverse_iterator
-trie<_Value>::crend() const noexcept {
-  return trie<_Value>::const_reverse_iterator(nullptr);
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_reverse_iterator
+trie<_Value, _Key>::crend() const noexcept {
+  return trie<_Value, _Key>::const_reverse_iterator(nullptr);
 }
 
 // ###### Capacity ######
 
-template <typename _Value> bool trie<_Value>::empty() const noexcept {
-  return !_base_node->has_children();
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::empty() const noexcept {
+  return _size == 0;
 }
 
-template <typename _Value>
-typename trie<_Value>::size_type trie<_Value>::size() const noexcept {
-  trie<_Value>::size_type size = 0;
-  for (auto cit = this->cbegin(); cit != this->cend(); cit++)
-    size++;
-  return size;
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::size() const noexcept {
+  return _size;
 }
 
-template <typename _Value>
-typename trie<_Value>::size_type trie<_Value>::max_size() const noexcept {
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::max_size() const noexcept {
   unsigned long max_uint = std::numeric_limits<unsigned int>().max();
-  return max_uint / sizeof(trie_node<_Value>);
+  return max_uint / sizeof(value_type);
+}
+
+template <typename _Value, typename _Key>
+std::size_t trie<_Value, _Key>::node_count() const noexcept {
+  return _base_node->node_count();
+}
+
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::compressed() const noexcept {
+  return _compressed;
+}
+
+// Every node then carries the number of values below it, which makes
+// rank(), select() and count_prefix() O(depth) at the cost of one parent
+// walk per insert and erase.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::enable_subtree_counts() noexcept {
+  _subtree_counts = true;
+  recount(_base_node);
+}
+
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::subtree_counts() const noexcept {
+  return _subtree_counts;
+}
+
+// Every node then carries the highest score(value) below it, which lets
+// top_k() skip subtrees that cannot place. Inserts raise the scores on the
+// path in O(depth); erasing or lowering the best value of a subtree also
+// looks at the siblings on the way up. Values changed in place through an
+// iterator are not seen, so rescoring updates go through insert_or_assign().
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::enable_max_scores(score_function score) noexcept {
+  _score = score;
+  rescore(_base_node);
+}
+
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::max_scores() const noexcept {
+  return _score != nullptr;
 }
 
 // ###### Modifiers ######
 
-template <typename _Value> void trie<_Value>::clear() noexcept {
-  _base_node->clear_children();
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::clear() noexcept {
+  if constexpr (!std::is_trivially_destructible_v<_Value>)
+    value_type::destroy(_base_node, &_arena);
+  _arena.release();
+  _base_node = value_type::create(symbol_type(), std::nullopt, &_arena);
+  _size = 0;
+  _compiled = false;
 }
 
-template <typename _Value>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::insert(const std::string &key, const _Value &value) {
-  return emplacer(key, std::optional<_Value>(value));
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::insert(key_view key, const _Value &value) {
+  return emplacer(key, value);
 }
 
-template <typename _Value>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::insert(std::string &&key, _Value &&value) {
-  return emplacer(std::move(key), std::optional<_Value>(std::move(value)));
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::insert(key_view key, _Value &&value) {
+  return emplacer(key, std::move(value));
 }
 
-template <typename _Value>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::insert_or_assign(const std::string &key, _Value &&value) {
-  return insert_or_assign(std::move(key), std::move(value));
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::insert_or_assign(key_view key, const _Value &value) {
+  auto pair = emplacer(key, value);
+  if (!pair.second) {
+    float previous = own_score(&*pair.first);
+    (*(pair.first)).assign_value(value);
+    if (own_score(&*pair.first) > previous)
+      raise_scores(&*pair.first);
+    else
+      lower_scores(&*pair.first, previous);
+  }
+  return pair;
 }
 
-template <typename _Value>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::insert_or_assign(std::string &&key, _Value &&value) {
-  auto pair = insert(std::move(key), std::move(value));
-  (*(pair.first)).assign_value(value);
+// emplacer() only consumes value when it inserts, so it is still intact
+// for the assignment.
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::insert_or_assign(key_view key, _Value &&value) {
+  auto pair = emplacer(key, std::move(value));
+  if (!pair.second) {
+    float previous = own_score(&*pair.first);
+    (*(pair.first)).assign_value(std::move(value));
+    if (own_score(&*pair.first) > previous)
+      raise_scores(&*pair.first);
+    else
+      lower_scores(&*pair.first, previous);
+  }
   return pair;
 }
 
-template <typename _Value>
+template <typename _Value, typename _Key>
 template <typename... Args>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::emplace(Args &&...args) {
-  return emplacer(args...);
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::emplace(Args &&...args) {
+  return emplacer(std::forward<Args>(args)...);
 }
 
-template <typename _Value>
-std::pair<typename trie<_Value>::iterator, bool>
-trie<_Value>::emplacer(std::string key, std::optional<_Value> value) {
+// The value is constructed in place from args, and only if key is not
+// present yet; with no args it is value-initialized.
+template <typename _Value, typename _Key>
+template <typename... _Args>
+std::pair<typename trie<_Value, _Key>::iterator, bool>
+trie<_Value, _Key>::emplacer(key_view key, _Args &&...args) {
   bool success = false;
-  if (key == "")
-    return std::pair<trie<_Value>::iterator, bool>(nullptr, success);
-  if (value == std::nullopt)
-    value = std::optional<_Value>(_Value());
-  char k;
-  trie_node<_Value> *current_node = _base_node;
-
-  std::string mutable_key(key);
-  char end_char = mutable_key.back();
-  mutable_key.erase(mutable_key.length() - 1, 1);
-
-  for (auto str_cit = mutable_key.cbegin(); str_cit != mutable_key.cend();
-       ++str_cit) {
-    current_node = insert_node(current_node, (*str_cit)).first;
-  }
-
-  if (current_node->has_child(end_char)) {
-    current_node = current_node->get_child(end_char);
-    if(current_node->get_value() == std::nullopt) {
-      current_node->assign_value(value.value());
-      success = true;
-    } else
-      success = false;
-  } else {
-    auto pair =
-        insert_node(current_node, end_char, std::optional<_Value>{value.value()});
-    current_node = pair.first;
-    success = pair.second;
-  }
-  return std::pair<trie<_Value>::iterator, bool>(
-      trie<_Value>::iterator(current_node), success);
-}
-
-template <typename _Value>
-typename trie<_Value>::iterator
-trie<_Value>::erase(trie<_Value>::iterator pos) {
+  if (key.empty())
+    return std::pair<trie<_Value, _Key>::iterator, bool>(nullptr, success);
+  value_type *current_node = _base_node;
+
+  std::size_t position = 0;
+  while (position < key.length()) {
+    auto child = move_down(key[position], current_node);
+    if (child == nullptr) {
+      if (_compressed) {
+        current_node = current_node->insert_child(
+            key[position], key.substr(position + 1), std::nullopt, &_arena);
+      } else {
+        for (; position < key.length(); ++position)
+          current_node = insert_node(current_node, key[position]).first;
+      }
+      current_node->emplace_value(std::forward<_Args>(args)...);
+      ++_size;
+      update_counts(current_node, 1);
+      raise_scores(current_node);
+      _compiled = false;
+      return std::pair<trie<_Value, _Key>::iterator, bool>(
+          trie<_Value, _Key>::iterator(current_node), true);
+    }
+    ++position;
+
+    key_view label = child->get_label();
+    std::size_t matched = 0;
+    while (matched < label.length() && position < key.length() &&
+           label[matched] == key[position]) {
+      ++matched;
+      ++position;
+    }
+    if (matched < label.length())
+      child = child->split_label(matched, &_arena);
+    current_node = child;
+  }
+
+  if (current_node->get_value() == std::nullopt) {
+    current_node->emplace_value(std::forward<_Args>(args)...);
+    ++_size;
+    update_counts(current_node, 1);
+    raise_scores(current_node);
+    _compiled = false;
+    success = true;
+  }
+  return std::pair<trie<_Value, _Key>::iterator, bool>(
+      trie<_Value, _Key>::iterator(current_node), success);
+}
+
+// Inserts the key/value pairs of [first, last) in one pass. The path of the
+// previous key is kept on a stack, so each key only walks down from where
+// it diverges from its predecessor; on sorted input that is where the new
+// nodes go. Any order is accepted, sorted input is just the fast case.
+template <typename _Value, typename _Key>
+template <typename _InputIterator>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::build_sorted(_InputIterator first, _InputIterator last) {
+  size_type inserted = 0;
+  build_path path(1, {_base_node, 0});
+  _Key previous;
+  for (; first != last; ++first)
+    inserted += build_next(*first, path, previous);
+  return inserted;
+}
+
+// Leading symbols are dealt out to the threads, largest buckets first, and
+// each thread builds its share into a trie of its own. The subtrees under
+// those roots are then hung under _base_node and their arenas adopted.
+// Buckets whose leading symbol is already a child of _base_node are built
+// in place on the calling thread afterwards. Within a bucket keys keep their
+// input order, so the result is the same as inserting them one by one.
+// Alphabets of more than 256 symbols are built on the calling thread.
+template <typename _Value, typename _Key>
+template <typename _RandomAccessIterator>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::build_parallel(_RandomAccessIterator first,
+                                   _RandomAccessIterator last,
+                                   unsigned int threads) {
+  using traits = trie_symbol_traits<symbol_type>;
+  constexpr int symbols =
+      static_cast<int>(std::min<std::size_t>(traits::alphabet_size, 256));
+  if (threads <= 1 || traits::alphabet_size > 256)
+    return build_sorted(first, last);
+
+  std::size_t offsets[symbols + 1] = {};
+  for (auto it = first; it != last; ++it) {
+    key_view key((*it).first);
+    if (!key.empty())
+      ++offsets[traits::index(key[0]) + 1];
+  }
+  for (int b = 0; b < symbols; ++b)
+    offsets[b + 1] += offsets[b];
+  std::vector<std::size_t> order(offsets[symbols]);
+  std::size_t fill[symbols];
+  std::copy(offsets, offsets + symbols, fill);
+  for (auto it = first; it != last; ++it) {
+    key_view key((*it).first);
+    if (!key.empty())
+      order[fill[traits::index(key[0])]++] = it - first;
+  }
+
+  std::vector<int> buckets;
+  std::vector<int> in_place;
+  for (int b = 0; b < symbols; ++b) {
+    if (offsets[b] == offsets[b + 1])
+      continue;
+    if (_base_node->has_child(traits::symbol(b)))
+      in_place.push_back(b);
+    else
+      buckets.push_back(b);
+  }
+  std::sort(buckets.begin(), buckets.end(), [&](int a, int b) {
+    return offsets[a + 1] - offsets[a] > offsets[b + 1] - offsets[b];
+  });
+  std::size_t workers = std::min<std::size_t>(threads, buckets.size());
+
+  std::vector<std::vector<int>> shares(workers);
+  std::vector<std::size_t> loads(workers);
+  for (int b : buckets) {
+    auto least = std::min_element(loads.begin(), loads.end()) - loads.begin();
+    shares[least].push_back(b);
+    loads[least] += offsets[b + 1] - offsets[b];
+  }
+
+  std::vector<trie<_Value, _Key>> locals;
+  for (std::size_t t = 0; t < workers; ++t) {
+    locals.emplace_back(_compressed);
+    if (_subtree_counts)
+      locals.back().enable_subtree_counts();
+    if (_score != nullptr)
+      locals.back().enable_max_scores(_score);
+  }
+  auto build_share = [&](std::size_t t) {
+    build_path path(1, {locals[t]._base_node, 0});
+    _Key previous;
+    for (int b : shares[t])
+      for (std::size_t i = offsets[b]; i < offsets[b + 1]; ++i)
+        locals[t].build_next(first[order[i]], path, previous);
+  };
+  std::vector<std::thread> pool;
+  for (std::size_t t = 1; t < workers; ++t)
+    pool.emplace_back(build_share, t);
+  if (workers > 0)
+    build_share(0);
+  for (auto &worker : pool)
+    worker.join();
+
+  // The emptied local roots go back to their arenas before those are
+  // adopted, so _arena can reuse them, and the locals die without a root.
+  // Only the children of _base_node changed, so its maximum is the only
+  // score to recompute.
+  size_type inserted = 0;
+  float score = _base_node->get_max_score();
+  for (std::size_t t = 0; t < workers; ++t) {
+    trie<_Value, _Key> &local = locals[t];
+    for (int b : shares[t]) {
+      value_type *child =
+          local._base_node->detach_child(traits::symbol(b), &local._arena);
+      score = std::max(score, child->get_max_score());
+      _base_node->insert_child(child, &_arena);
+    }
+    inserted += local._size;
+    value_type::destroy(local._base_node, &local._arena);
+    _arena.adopt(local._arena);
+    local._base_node = nullptr;
+    local._size = 0;
+  }
+  _size += inserted;
+  _compiled = false;
+  update_counts(_base_node, static_cast<int>(inserted));
+  if (_score != nullptr)
+    _base_node->set_max_score(score);
+
+  build_path path(1, {_base_node, 0});
+  _Key previous;
+  for (int b : in_place)
+    for (std::size_t i = offsets[b]; i < offsets[b + 1]; ++i)
+      inserted += build_next(first[order[i]], path, previous);
+  return inserted;
+}
+
+// One step of build_sorted(): path holds the nodes on previous's path
+// together with the key length at the end of each node's edge.
+template <typename _Value, typename _Key>
+template <typename _Entry>
+bool trie<_Value, _Key>::build_next(_Entry &&entry, build_path &path,
+                                    _Key &previous) {
+  key_view key(entry.first);
+  if (key.empty())
+    return false;
+
+  std::size_t common = 0;
+  while (common < key.length() && common < previous.length() &&
+         key[common] == previous[common])
+    ++common;
+  while (path.back().second > common)
+    path.pop_back();
+
+  auto current_node = path.back().first;
+  std::size_t position = path.back().second;
+  while (position < key.length()) {
+    auto child = move_down(key[position], current_node);
+    if (child == nullptr) {
+      if (_compressed) {
+        current_node = current_node->insert_child(
+            key[position], key.substr(position + 1), std::nullopt, &_arena);
+        position = key.length();
+        path.emplace_back(current_node, position);
+      } else {
+        for (; position < key.length(); ++position) {
+          current_node = current_node->insert_child(key[position],
+                                                    std::nullopt, &_arena);
+          path.emplace_back(current_node, position + 1);
+        }
+      }
+      break;
+    }
+    ++position;
+
+    key_view label = child->get_label();
+    std::size_t matched = 0;
+    while (matched < label.length() && position < key.length() &&
+           label[matched] == key[position]) {
+      ++matched;
+      ++position;
+    }
+    if (matched < label.length())
+      child = child->split_label(matched, &_arena);
+    current_node = child;
+    path.emplace_back(current_node, position);
+  }
+  previous.assign(key);
+
+  if (current_node->get_value() != std::nullopt)
+    return false;
+  current_node->emplace_value(std::forward<_Entry>(entry).second);
+  ++_size;
+  update_counts(current_node, 1);
+  raise_scores(current_node);
+  _compiled = false;
+  return true;
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator
+trie<_Value, _Key>::erase(trie<_Value, _Key>::iterator pos) {
   auto it = pos;
   ++it;
   erase_at(pos);
   return it;
 }
 
-template <typename _Value>
-typename trie<_Value>::size_type trie<_Value>::erase(const std::string &key) {
-  auto it = trie<_Value>::find(key);
-  if (it == trie<_Value>::end())
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type trie<_Value, _Key>::erase(key_view key) {
+  auto it = trie<_Value, _Key>::find(key);
+  if (it == trie<_Value, _Key>::end() || (*it).get_value() == std::nullopt)
     return 0;
   erase_at(it);
   return 1;
 }
 
+// Removes every key starting with prefix by detaching the subtree under it.
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::erase_prefix(key_view prefix) {
+  auto node = find_prefix_node(prefix);
+  if (node == nullptr)
+    return 0;
+  auto count = subtree_count(node);
+  if (node == _base_node) {
+    clear();
+    return count;
+  }
+  auto parent = move_up(node);
+  float removed = node->get_max_score();
+  _size -= count;
+  _compiled = false;
+  update_counts(parent, -static_cast<int>(count));
+  parent->erase_child(node->get_node_key(), &_arena);
+  lower_scores(release_path(parent), removed);
+  return count;
+}
+
 // ###### Lookup ######
-template <typename _Value>
-typename trie<_Value>::size_type
-trie<_Value>::count(const std::string &key) const {
-  auto it = trie<_Value>::find(key);
-  if (it == trie<_Value>::cend())
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::count(key_view key) const {
+  auto node = find_node(key);
+  if (node == nullptr || node->get_value() == std::nullopt)
     return 0;
   return 1;
 }
 
-template <typename _Value>
-typename trie<_Value>::const_iterator
-trie<_Value>::find(const std::string &key) const {
-  auto current_node = _base_node;
-  for (auto str_cit = key.cbegin(); str_cit != key.cend(); ++str_cit) {
-    current_node = move_down(*str_cit, current_node);
-    if (current_node == nullptr)
-      return trie<_Value>::cend();
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_iterator
+trie<_Value, _Key>::find(key_view key) const {
+  auto node = find_node(key);
+  if (node == nullptr)
+    return trie<_Value, _Key>::cend();
+  return trie<_Value, _Key>::const_iterator(node);
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator trie<_Value, _Key>::find(key_view key) {
+  auto node = find_node(key);
+  if (node == nullptr)
+    return trie<_Value, _Key>::end();
+  return trie<_Value, _Key>::iterator(node);
+}
+
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::contains(key_view key) const {
+  return trie<_Value, _Key>::count(key);
+}
+
+// Looks up keys[0..count) like find() into out[0..count). The lookups run
+// in lockstep so that their cache misses overlap; see find_nodes().
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::find_batch(const key_view *keys, std::size_t count,
+                                    const_iterator *out) const {
+  value_type *nodes[batch_lanes];
+  for (std::size_t first = 0; first < count; first += batch_lanes) {
+    std::size_t lanes = std::min(batch_lanes, count - first);
+    find_nodes(keys + first, lanes, nodes);
+    for (std::size_t i = 0; i < lanes; ++i)
+      out[first + i] = const_iterator(nodes[i]);
   }
-  return trie<_Value>::const_iterator(current_node);
 }
 
-template <typename _Value>
-typename trie<_Value>::iterator trie<_Value>::find(const std::string &key) {
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::find_batch(const key_view *keys, std::size_t count,
+                                    iterator *out) {
+  value_type *nodes[batch_lanes];
+  for (std::size_t first = 0; first < count; first += batch_lanes) {
+    std::size_t lanes = std::min(batch_lanes, count - first);
+    find_nodes(keys + first, lanes, nodes);
+    for (std::size_t i = 0; i < lanes; ++i)
+      out[first + i] = iterator(nodes[i]);
+  }
+}
+
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::contains_batch(const key_view *keys,
+                                        std::size_t count, bool *out) const {
+  value_type *nodes[batch_lanes];
+  for (std::size_t first = 0; first < count; first += batch_lanes) {
+    std::size_t lanes = std::min(batch_lanes, count - first);
+    find_nodes(keys + first, lanes, nodes);
+    for (std::size_t i = 0; i < lanes; ++i)
+      out[first + i] =
+          nodes[i] != nullptr && nodes[i]->get_value() != std::nullopt;
+  }
+}
+
+#ifdef __cpp_lib_span
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::find_batch(std::span<const key_view> keys,
+                                    std::span<const_iterator> out) const {
+  find_batch(keys.data(), std::min(keys.size(), out.size()), out.data());
+}
+
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::find_batch(std::span<const key_view> keys,
+                                    std::span<iterator> out) {
+  find_batch(keys.data(), std::min(keys.size(), out.size()), out.data());
+}
+
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::contains_batch(std::span<const key_view> keys,
+                                        std::span<bool> out) const {
+  contains_batch(keys.data(), std::min(keys.size(), out.size()), out.data());
+}
+#endif
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::count_prefix(key_view prefix) const {
+  auto node = find_prefix_node(prefix);
+  return node == nullptr ? 0 : subtree_count(node);
+}
+
+// Number of keys ordered before key.
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::rank(key_view key) const {
+  trie<_Value, _Key>::size_type rank = 0;
   auto current_node = _base_node;
-  for (auto str_cit = key.cbegin(); str_cit != key.cend(); ++str_cit) {
-    current_node = move_down(*str_cit, current_node);
+  std::size_t position = 0;
+  while (position < key.length()) {
+    if (current_node->get_value() != std::nullopt)
+      ++rank;
+    symbol_type k = key[position++];
+    current_node->for_each_child([&](const value_type *child) {
+      if (child->get_node_key() < k)
+        rank += subtree_count(child);
+    });
+    current_node = move_down(k, current_node);
     if (current_node == nullptr)
-      return trie<_Value>::end();
+      return rank;
+
+    key_view label = current_node->get_label();
+    for (std::size_t i = 0; i < label.length(); ++i, ++position) {
+      if (position == key.length())
+        return rank;
+      if (label[i] != key[position]) {
+        if (label[i] < key[position])
+          rank += subtree_count(current_node);
+        return rank;
+      }
+    }
+  }
+  return rank;
+}
+
+// Element with the longest key that is a prefix of key, or end().
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_iterator
+trie<_Value, _Key>::longest_prefix_of(key_view key) const {
+  value_type *longest = nullptr;
+  walk_prefixes(key, [&longest](value_type *node) { longest = node; });
+  return trie<_Value, _Key>::const_iterator(longest);
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator
+trie<_Value, _Key>::longest_prefix_of(key_view key) {
+  value_type *longest = nullptr;
+  walk_prefixes(key, [&longest](value_type *node) { longest = node; });
+  return trie<_Value, _Key>::iterator(longest);
+}
+
+// Writes an iterator to every element whose key is a prefix of key,
+// shortest first, and returns the end of the output.
+template <typename _Value, typename _Key>
+template <typename _OutputIterator>
+_OutputIterator trie<_Value, _Key>::prefixes_of(key_view key,
+                                                _OutputIterator out) const {
+  walk_prefixes(key, [&out](value_type *node) {
+    *out++ = trie<_Value, _Key>::const_iterator(node);
+  });
+  return out;
+}
+
+template <typename _Value, typename _Key>
+template <typename _OutputIterator>
+_OutputIterator trie<_Value, _Key>::prefixes_of(key_view key,
+                                                _OutputIterator out) {
+  walk_prefixes(key, [&out](value_type *node) {
+    *out++ = trie<_Value, _Key>::iterator(node);
+  });
+  return out;
+}
+
+// Elements whose key is within max_distance edits (insertions, deletions,
+// substitutions) of query, with their distance, in key order.
+template <typename _Value, typename _Key>
+std::vector<std::pair<typename trie<_Value, _Key>::const_iterator, std::size_t>>
+trie<_Value, _Key>::fuzzy_find(key_view query,
+                               std::size_t max_distance) const {
+  std::vector<std::pair<const_iterator, std::size_t>> matches;
+  std::vector<std::size_t> rows(query.length() + 1);
+  for (std::size_t j = 0; j <= query.length(); ++j)
+    rows[j] = j;
+  auto collect = [&matches](value_type *node, std::size_t distance) {
+    matches.emplace_back(trie<_Value, _Key>::const_iterator(node), distance);
+  };
+  fuzzy_walk(_base_node, 0, query, max_distance, rows, collect);
+  return matches;
+}
+
+template <typename _Value, typename _Key>
+std::vector<std::pair<typename trie<_Value, _Key>::iterator, std::size_t>>
+trie<_Value, _Key>::fuzzy_find(key_view query, std::size_t max_distance) {
+  std::vector<std::pair<iterator, std::size_t>> matches;
+  std::vector<std::size_t> rows(query.length() + 1);
+  for (std::size_t j = 0; j <= query.length(); ++j)
+    rows[j] = j;
+  auto collect = [&matches](value_type *node, std::size_t distance) {
+    matches.emplace_back(trie<_Value, _Key>::iterator(node), distance);
+  };
+  fuzzy_walk(_base_node, 0, query, max_distance, rows, collect);
+  return matches;
+}
+
+// The k elements under prefix with the highest score(value), best first;
+// ties come out in no particular order. Without a score, the one given to
+// enable_max_scores() is used, or default_score() for arithmetic values;
+// other values throw std::logic_error. When score is the one the max
+// scores were built with, this is a best-first search that expands a
+// subtree only once its maximum is the best score left, so it touches
+// O(k * depth) nodes and their children. Otherwise every element under
+// prefix is scored.
+template <typename _Value, typename _Key>
+std::vector<typename trie<_Value, _Key>::const_iterator>
+trie<_Value, _Key>::top_k(key_view prefix, std::size_t k,
+                          score_function score) const {
+  std::vector<value_type *> nodes;
+  top_k_nodes(prefix, k, score, nodes);
+  return std::vector<trie<_Value, _Key>::const_iterator>(nodes.begin(),
+                                                         nodes.end());
+}
+
+template <typename _Value, typename _Key>
+std::vector<typename trie<_Value, _Key>::iterator>
+trie<_Value, _Key>::top_k(key_view prefix, std::size_t k,
+                          score_function score) {
+  std::vector<value_type *> nodes;
+  top_k_nodes(prefix, k, score, nodes);
+  return std::vector<trie<_Value, _Key>::iterator>(nodes.begin(), nodes.end());
+}
+
+// Elements whose whole key matches the glob pattern (see trie_pattern), in
+// key order. The range is computed while it is iterated, so stopping early
+// skips the rest of the walk. Any modification of the trie invalidates it.
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::const_match_iterator,
+          typename trie<_Value, _Key>::const_match_iterator>
+trie<_Value, _Key>::match(std::string_view pattern) const {
+  return {trie<_Value, _Key>::const_match_iterator(_base_node, pattern),
+          trie<_Value, _Key>::const_match_iterator()};
+}
+
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::match_iterator,
+          typename trie<_Value, _Key>::match_iterator>
+trie<_Value, _Key>::match(std::string_view pattern) {
+  return {trie<_Value, _Key>::match_iterator(_base_node, pattern),
+          trie<_Value, _Key>::match_iterator()};
+}
+
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::const_iterator,
+          typename trie<_Value, _Key>::const_iterator>
+trie<_Value, _Key>::prefix_range(key_view prefix) const {
+  return subtree_range<trie<_Value, _Key>::const_iterator>(
+      find_prefix_node(prefix));
+}
+
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::iterator,
+          typename trie<_Value, _Key>::iterator>
+trie<_Value, _Key>::prefix_range(key_view prefix) {
+  return subtree_range<trie<_Value, _Key>::iterator>(find_prefix_node(prefix));
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::const_iterator
+trie<_Value, _Key>::select(size_type index) const {
+  return trie<_Value, _Key>::const_iterator(select_node(index));
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::iterator
+trie<_Value, _Key>::select(size_type index) {
+  return trie<_Value, _Key>::iterator(select_node(index));
+}
+
+// ###### Multi-pattern scanning ######
+
+// Adds Aho-Corasick failure and output links to the nodes, breadth first,
+// so that scan() finds every key occurring in a text in one pass. Inserts
+// and erases drop the compiled state and the trie has to be compiled
+// again. Edges of a path-compressed trie have no node per character to
+// hang the links on, so it cannot be compiled.
+template <typename _Value, typename _Key> void trie<_Value, _Key>::compile() {
+  if (_compressed)
+    throw std::logic_error("compile() needs an uncompressed trie");
+  auto root = _base_node->make_links(&_arena);
+  *root = {_base_node, nullptr, 0};
+  std::vector<value_type *> level(1, _base_node);
+  std::vector<value_type *> next_level;
+  while (!level.empty()) {
+    for (auto node : level) {
+      auto links = node->get_links();
+      node->for_each_child([&](value_type *child) {
+        symbol_type key = child->get_node_key();
+        value_type *fail = _base_node;
+        if (node != _base_node) {
+          auto suffix = links->fail;
+          while (suffix != _base_node && !suffix->has_child(key))
+            suffix = suffix->get_links()->fail;
+          if (auto match = suffix->get_child(key))
+            fail = match;
+        }
+        auto output = fail->get_value() != std::nullopt
+                          ? fail
+                          : fail->get_links()->output;
+        *child->make_links(&_arena) = {fail, output, links->depth + 1};
+        next_level.push_back(child);
+      });
+    }
+    level.swap(next_level);
+    next_level.clear();
   }
-  return trie<_Value>::iterator(current_node);
+  _compiled = true;
+}
+
+template <typename _Value, typename _Key>
+bool trie<_Value, _Key>::compiled() const noexcept {
+  return _compiled;
 }
 
-template <typename _Value>
-bool trie<_Value>::contains(const std::string &key) const {
-  return trie<_Value>::count(key);
+// Calls function(match, value) for every occurrence of a key in text, in
+// order of the match's end and, for the same end, longest first. match is
+// a view into text, so nothing is copied; its offset is match.data() -
+// text.data().
+template <typename _Value, typename _Key>
+template <typename _Function>
+void trie<_Value, _Key>::scan(key_view text, _Function function) const {
+  if (!_compiled)
+    throw std::logic_error("scan() needs a compiled trie");
+  const value_type *state = _base_node;
+  for (std::size_t position = 0; position < text.length(); ++position) {
+    symbol_type key = text[position];
+    const value_type *next = state->get_child(key);
+    while (next == nullptr && state != _base_node) {
+      state = state->get_links()->fail;
+      next = state->get_child(key);
+    }
+    state = next != nullptr ? next : _base_node;
+
+    auto output =
+        state->get_value() != std::nullopt ? state : state->get_links()->output;
+    for (; output != nullptr; output = output->get_links()->output) {
+      std::size_t length = output->get_links()->depth;
+      function(text.substr(position + 1 - length, length),
+               *output->get_value());
+    }
+  }
+}
+
+// ###### Serialization ######
+
+// Writes the trie as a flat image that load() maps back read-only; see
+// mapped_trie. Only tries of trivially copyable values can be saved.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::save(const std::string &path) const {
+  mapped_trie<_Value>::save(_base_node, path);
+}
+
+template <typename _Value, typename _Key>
+mapped_trie<_Value> trie<_Value, _Key>::load(const std::string &path) {
+  return mapped_trie<_Value>(path);
+}
+
+// Read-only succinct copy of the trie; see frozen_trie.
+template <typename _Value, typename _Key>
+frozen_trie<_Value> trie<_Value, _Key>::freeze() const {
+  return frozen_trie<_Value>(_base_node);
 }
 
 // ###### Utilities ######
 
-template <typename _Value>
-trie_node<_Value> *
-trie<_Value>::move_up(trie_node<_Value> *current_node) const noexcept {
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::move_up(value_type *current_node) const noexcept {
   if (current_node == nullptr)
     return nullptr;
   return current_node->get_parent();
 }
 
-template <typename _Value>
-trie_node<_Value> *
-trie<_Value>::move_down(const char key,
-                        trie_node<_Value> *current_node) const noexcept {
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::move_down(const symbol_type key,
+                              value_type *current_node) const noexcept {
   if (current_node == nullptr)
     return nullptr;
   return current_node->get_child(key);
 }
 
-template <typename _Value>
-std::pair<trie_node<_Value> *, bool>
-trie<_Value>::insert_node(trie_node<_Value> *current_node, const char key,
-                          std::optional<_Value> value) noexcept {
+// find_node() for up to batch_lanes keys at once. Each round first reads
+// the node every lookup has reached, checks its label and prefetches the
+// child table entry for the next character, then does the table lookups and
+// prefetches the children found. By the time a lookup comes round again its
+// memory has had a whole round of other lookups to arrive.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::find_nodes(const key_view *keys, std::size_t count,
+                                    value_type **out) const noexcept {
+  std::size_t positions[batch_lanes];
+  std::uint8_t active[batch_lanes];
+  std::size_t active_count = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    out[i] = _base_node;
+    positions[i] = 0;
+    active[active_count++] = static_cast<std::uint8_t>(i);
+  }
+  while (active_count > 0) {
+    std::size_t remaining = 0;
+    for (std::size_t a = 0; a < active_count; ++a) {
+      std::size_t i = active[a];
+      key_view key = keys[i];
+      auto current_node = out[i];
+      if (current_node == nullptr)
+        continue;
+      key_view label = current_node->get_label();
+      if (key.compare(positions[i], label.length(), label) != 0) {
+        out[i] = nullptr;
+        continue;
+      }
+      positions[i] += label.length();
+      if (positions[i] == key.length())
+        continue;
+      current_node->prefetch_child(key[positions[i]]);
+      active[remaining++] = static_cast<std::uint8_t>(i);
+    }
+    active_count = remaining;
+    for (std::size_t a = 0; a < active_count; ++a) {
+      std::size_t i = active[a];
+      out[i] = out[i]->get_child(keys[i][positions[i]++]);
+      if (out[i] != nullptr)
+        __builtin_prefetch(out[i]);
+    }
+  }
+}
+
+// Calls function(node) for every node with a value on the path of key, in
+// one walk from the root.
+template <typename _Value, typename _Key>
+template <typename _Function>
+void trie<_Value, _Key>::walk_prefixes(key_view key,
+                                       _Function function) const {
+  auto current_node = _base_node;
+  std::size_t position = 0;
+  while (position < key.length()) {
+    current_node = move_down(key[position++], current_node);
+    if (current_node == nullptr)
+      return;
+    key_view label = current_node->get_label();
+    if (key.compare(position, label.length(), label) != 0)
+      return;
+    position += label.length();
+    if (current_node->get_value() != std::nullopt)
+      function(current_node);
+  }
+}
+
+// Depth-first Levenshtein search. rows holds one DP row per character on
+// the path, row depth being the distances between the path's first depth
+// characters and every prefix of query; the row for current_node is the
+// last one. A child appends a row for its key and each label character and
+// is dropped as soon as a row's minimum exceeds max_distance, since no
+// longer key can get closer. Cells further than max_distance from the
+// diagonal can only exceed it, so each row fills just that band and caps
+// everything at max_distance + 1.
+template <typename _Value, typename _Key>
+template <typename _Function>
+void trie<_Value, _Key>::fuzzy_walk(value_type *current_node,
+                                    std::size_t depth, key_view query,
+                                    std::size_t max_distance,
+                                    std::vector<std::size_t> &rows,
+                                    _Function &function) const {
+  const std::size_t width = query.length() + 1;
+  const std::size_t cap = max_distance + 1;
+  if (depth > 0 && depth + max_distance >= query.length() &&
+      current_node->get_value() != std::nullopt &&
+      rows[depth * width + query.length()] <= max_distance)
+    function(current_node, rows[depth * width + query.length()]);
+
+  current_node->for_each_child([&](value_type *child) {
+    key_view label = child->get_label();
+    std::size_t child_depth = depth;
+    for (std::size_t c = 0; c <= label.length(); ++c) {
+      symbol_type k = c == 0 ? child->get_node_key() : label[c - 1];
+      rows.resize((child_depth + 2) * width);
+      const std::size_t *previous = rows.data() + child_depth * width;
+      std::size_t *row = rows.data() + (child_depth + 1) * width;
+      std::size_t i = child_depth + 1;
+      std::size_t first = i > max_distance ? i - max_distance : 1;
+      std::size_t last = std::min(query.length(), i + max_distance);
+      row[0] = std::min(i, cap);
+      if (first > 1)
+        row[first - 1] = cap;
+      std::size_t minimum = row[0];
+      for (std::size_t j = first; j <= last; ++j) {
+        row[j] = std::min({previous[j] + 1, row[j - 1] + 1,
+                           previous[j - 1] + (query[j - 1] != k), cap});
+        minimum = std::min(minimum, row[j]);
+      }
+      if (last < query.length())
+        row[last + 1] = cap;
+      ++child_depth;
+      if (minimum > max_distance)
+        return;
+    }
+    fuzzy_walk(child, child_depth, query, max_distance, rows, function);
+  });
+}
+
+// Keys ending inside a compressed edge are not found: there is no node for
+// them to point at.
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::find_node(key_view key) const noexcept {
+  auto current_node = _base_node;
+  std::size_t position = 0;
+  while (position < key.length()) {
+    current_node = move_down(key[position++], current_node);
+    if (current_node == nullptr)
+      return nullptr;
+    key_view label = current_node->get_label();
+    if (key.compare(position, label.length(), label) != 0)
+      return nullptr;
+    position += label.length();
+  }
+  return current_node;
+}
+
+// Queue entries are either a subtree, ranked by its maximum, or the value
+// of a node, ranked by its own score; a value is taken once nothing left
+// in the queue can beat it.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::top_k_nodes(key_view prefix, std::size_t k,
+                                     score_function score,
+                                     std::vector<value_type *> &out) const {
+  if (score == nullptr)
+    score = _score;
+  if constexpr (std::is_arithmetic_v<_Value>) {
+    if (score == nullptr)
+      score = default_score;
+  }
+  if (score == nullptr)
+    throw std::logic_error("top_k() needs a score function");
+  auto node = find_prefix_node(prefix);
+  if (node == nullptr || k == 0)
+    return;
+  if (score != _score) {
+    std::vector<std::pair<float, value_type *>> scored;
+    auto range = subtree_range<trie<_Value, _Key>::iterator>(node);
+    for (auto it = range.first; it != range.second; ++it)
+      scored.emplace_back(score(*it->get_value()), &*it);
+    k = std::min(k, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + k, scored.end(),
+                      [](const auto &a, const auto &b) {
+                        return a.first > b.first;
+                      });
+    for (std::size_t i = 0; i < k; ++i)
+      out.push_back(scored[i].second);
+    return;
+  }
+
+  struct entry {
+    float score;
+    value_type *node;
+    bool value;
+    bool operator<(const entry &other) const noexcept {
+      return score < other.score;
+    }
+  };
+  std::priority_queue<entry> queue;
+  queue.push({node->get_max_score(), node, false});
+  while (!queue.empty() && out.size() < k) {
+    entry best = queue.top();
+    queue.pop();
+    if (best.value) {
+      out.push_back(best.node);
+      continue;
+    }
+    if (best.node->get_value() != std::nullopt)
+      queue.push({own_score(best.node), best.node, true});
+    best.node->for_each_child([&queue](value_type *child) {
+      queue.push({child->get_max_score(), child, false});
+    });
+  }
+}
+
+// Node whose subtree holds exactly the keys starting with prefix. The
+// prefix may end inside that node's edge.
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::find_prefix_node(key_view prefix) const noexcept {
+  auto current_node = _base_node;
+  std::size_t position = 0;
+  while (position < prefix.length()) {
+    current_node = move_down(prefix[position++], current_node);
+    if (current_node == nullptr)
+      return nullptr;
+    key_view label = current_node->get_label();
+    std::size_t length = std::min(label.length(), prefix.length() - position);
+    if (prefix.compare(position, length, label.substr(0, length)) != 0)
+      return nullptr;
+    position += length;
+  }
+  return current_node;
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::select_node(size_type index) const noexcept {
+  if (index >= _size)
+    return nullptr;
+  auto current_node = _base_node;
+  while (current_node != nullptr) {
+    if (current_node->get_value() != std::nullopt) {
+      if (index == 0)
+        return current_node;
+      --index;
+    }
+    value_type *next_node = nullptr;
+    current_node->for_each_child([&](value_type *child) {
+      if (next_node != nullptr)
+        return;
+      auto count = subtree_count(child);
+      if (index < count)
+        next_node = child;
+      else
+        index -= count;
+    });
+    current_node = next_node;
+  }
+  return nullptr;
+}
+
+// The range ends at the element following the rightmost leaf of the
+// subtree, so walking it never leaves the subtree.
+template <typename _Value, typename _Key>
+template <typename _Iterator>
+std::pair<_Iterator, _Iterator>
+trie<_Value, _Key>::subtree_range(value_type *node) const noexcept {
+  if (node == nullptr)
+    return std::pair<_Iterator, _Iterator>(nullptr, nullptr);
+  _Iterator first(node);
+  if (node->get_value() == std::nullopt)
+    ++first;
+  auto last_node = node;
+  while (last_node->has_children())
+    last_node = last_node->get_last_child();
+  _Iterator last(last_node);
+  ++last;
+  return std::pair<_Iterator, _Iterator>(first, last);
+}
+
+// Without subtree counts enabled this falls back to walking the subtree.
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::subtree_count(const value_type *node) const noexcept {
+  if (_subtree_counts)
+    return node->get_subtree_count();
+  return node->value_count();
+}
+
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::update_counts(value_type *node, int delta) noexcept {
+  if (!_subtree_counts)
+    return;
+  for (; node != nullptr; node = node->get_parent())
+    node->set_subtree_count(node->get_subtree_count() + delta);
+}
+
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::size_type
+trie<_Value, _Key>::recount(value_type *node) noexcept {
+  trie<_Value, _Key>::size_type count =
+      node->get_value() != std::nullopt ? 1 : 0;
+  node->for_each_child(
+      [this, &count](value_type *child) { count += recount(child); });
+  node->set_subtree_count(count);
+  return count;
+}
+
+template <typename _Value, typename _Key>
+float trie<_Value, _Key>::default_score(const _Value &value) noexcept {
+  return static_cast<float>(value);
+}
+
+// -infinity for a node without value, and for every node while max scores
+// are disabled, so that the callers below need no check of their own.
+template <typename _Value, typename _Key>
+float trie<_Value, _Key>::own_score(const value_type *node) const noexcept {
+  if (_score == nullptr || node->get_value() == std::nullopt)
+    return -std::numeric_limits<float>::infinity();
+  return _score(*node->get_value());
+}
+
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::raise_scores(value_type *node) noexcept {
+  float score = own_score(node);
+  for (; node != nullptr && node->get_max_score() < score;
+       node = node->get_parent())
+    node->set_max_score(score);
+}
+
+// A score of removed left the subtree of node. Ancestors whose maximum
+// was higher than that are unaffected, so the walk stops at the first one.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::lower_scores(value_type *node,
+                                      float removed) noexcept {
+  if (_score == nullptr)
+    return;
+  for (; node != nullptr && node->get_max_score() <= removed;
+       node = node->get_parent()) {
+    float score = own_score(node);
+    node->for_each_child([&score](value_type *child) {
+      score = std::max(score, child->get_max_score());
+    });
+    node->set_max_score(score);
+  }
+}
+
+template <typename _Value, typename _Key>
+float trie<_Value, _Key>::rescore(value_type *node) noexcept {
+  float score = own_score(node);
+  node->for_each_child([this, &score](value_type *child) {
+    score = std::max(score, rescore(child));
+  });
+  node->set_max_score(score);
+  return score;
+}
+
+template <typename _Value, typename _Key>
+std::pair<typename trie<_Value, _Key>::value_type *, bool>
+trie<_Value, _Key>::insert_node(value_type *current_node, const symbol_type key,
+                                std::optional<_Value> value) noexcept {
   bool success = false;
-  if (!current_node->has_child(key)) {
-    current_node->insert_child(key, value);
+  auto node_ptr = move_down(key, current_node);
+  if (node_ptr == nullptr) {
+    node_ptr = current_node->insert_child(key, value, &_arena);
     success = true;
   }
-  auto node_ptr = move_down(key, current_node);
-  return std::pair<trie_node<_Value> *, bool>(node_ptr, success);
+  return std::pair<value_type *, bool>(node_ptr, success);
 }
 
-template <typename _Value> void trie<_Value>::erase_at(iterator pos) noexcept {
+// Only the element at pos is removed; keys below it stay in the trie.
+template <typename _Value, typename _Key>
+void trie<_Value, _Key>::erase_at(iterator pos) noexcept {
   auto current_node = &(*pos);
-  char k = current_node->get_node_key();
+  if (current_node->get_value() == std::nullopt)
+    return;
+  --_size;
+  _compiled = false;
+  update_counts(current_node, -1);
+  float removed = own_score(current_node);
+  if (current_node->has_children()) {
+    current_node->erase_value();
+    lower_scores(release_path(current_node), removed);
+    return;
+  }
+  symbol_type k = current_node->get_node_key();
   current_node = move_up(current_node);
-  current_node->erase_child(k);
-  release_path(current_node);
+  current_node->erase_child(k, &_arena);
+  lower_scores(release_path(current_node), removed);
 }
 
-template <typename _Value>
-trie_node<_Value> *
-trie<_Value>::release_path(trie_node<_Value> *current_node) noexcept {
-  while (!current_node->has_children() &&
+template <typename _Value, typename _Key>
+typename trie<_Value, _Key>::value_type *
+trie<_Value, _Key>::release_path(value_type *current_node) noexcept {
+  while (current_node != _base_node && !current_node->has_children() &&
          current_node->get_value() == std::nullopt) {
-    char key = current_node->get_node_key();
+    symbol_type key = current_node->get_node_key();
     current_node = move_up(current_node);
-    current_node->erase_child(key);
+    current_node->erase_child(key, &_arena);
   }
+  if (_compressed && current_node != _base_node &&
+      current_node->get_value() == std::nullopt &&
+      current_node->children_count() == 1)
+    current_node = move_up(current_node)->merge_child(
+        current_node->get_node_key(), &_arena);
   return current_node;
 }
\ No newline at end of file
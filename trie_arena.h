@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Block allocator for trie nodes, child tables and edge labels. Small
+// requests are carved out of large blocks and recycled through per-size free
+// lists; release() hands every block back at once. heap() is a pass-through
+// instance that forwards to operator new/delete and owns nothing.
+class trie_arena {
+public:
+  trie_arena() noexcept;
+  trie_arena(const trie_arena &other) = delete;
+  trie_arena(trie_arena &&other) noexcept;
+  trie_arena &operator=(const trie_arena &other) = delete;
+  trie_arena &operator=(trie_arena &&other) noexcept;
+  ~trie_arena() noexcept;
+
+  static trie_arena *heap() noexcept;
+
+  // ###### allocation ######
+  void *allocate(std::size_t size);
+  void deallocate(void *ptr, std::size_t size) noexcept;
+  void release() noexcept;
+  void adopt(trie_arena &other) noexcept;
+
+  // ###### capacity ######
+  std::size_t capacity() const noexcept;
+
+private:
+  static constexpr std::size_t alignment = 16;
+  static constexpr std::size_t block_size = std::size_t(1) << 16;
+  static constexpr std::size_t max_small_size = 4096;
+  static constexpr std::size_t size_classes = max_small_size / alignment;
+
+  struct block {
+    block *next;
+    block *previous;
+    std::size_t size;
+    std::size_t padding;
+  };
+  struct free_slot {
+    free_slot *next;
+  };
+
+  bool _passthrough;
+  block *_blocks;
+  block *_large_blocks;
+  char *_cursor;
+  char *_end;
+  std::size_t _capacity;
+  free_slot *_free[size_classes];
+
+  explicit trie_arena(bool passthrough) noexcept;
+
+  static std::size_t round_up(std::size_t size) noexcept;
+  void reset() noexcept;
+  void steal(trie_arena &other) noexcept;
+};
+
+inline trie_arena::trie_arena() noexcept : trie_arena(false) {}
+
+inline trie_arena::trie_arena(bool passthrough) noexcept
+    : _passthrough(passthrough) {
+  reset();
+}
+
+inline trie_arena::trie_arena(trie_arena &&other) noexcept
+    : _passthrough(other._passthrough) {
+  reset();
+  steal(other);
+}
+
+inline trie_arena &trie_arena::operator=(trie_arena &&other) noexcept {
+  if (this != &other) {
+    release();
+    steal(other);
+  }
+  return *this;
+}
+
+inline trie_arena::~trie_arena() noexcept { release(); }
+
+inline trie_arena *trie_arena::heap() noexcept {
+  static trie_arena heap_arena(true);
+  return &heap_arena;
+}
+
+// ###### allocation ######
+
+inline void *trie_arena::allocate(std::size_t size) {
+  if (_passthrough)
+    return ::operator new(size);
+
+  size = round_up(size);
+  if (size > max_small_size) {
+    auto large = static_cast<block *>(::operator new(sizeof(block) + size));
+    large->next = _large_blocks;
+    large->previous = nullptr;
+    large->size = sizeof(block) + size;
+    if (_large_blocks != nullptr)
+      _large_blocks->previous = large;
+    _large_blocks = large;
+    _capacity += large->size;
+    return large + 1;
+  }
+
+  free_slot *&slot = _free[size / alignment - 1];
+  if (slot != nullptr) {
+    void *ptr = slot;
+    slot = slot->next;
+    return ptr;
+  }
+
+  if (static_cast<std::size_t>(_end - _cursor) < size) {
+    auto fresh = static_cast<block *>(::operator new(block_size));
+    fresh->next = _blocks;
+    fresh->previous = nullptr;
+    fresh->size = block_size;
+    _blocks = fresh;
+    _capacity += block_size;
+    _cursor = reinterpret_cast<char *>(fresh + 1);
+    _end = reinterpret_cast<char *>(fresh) + block_size;
+  }
+  void *ptr = _cursor;
+  _cursor += size;
+  return ptr;
+}
+
+inline void trie_arena::deallocate(void *ptr, std::size_t size) noexcept {
+  if (ptr == nullptr)
+    return;
+  if (_passthrough) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  size = round_up(size);
+  if (size > max_small_size) {
+    auto large = static_cast<block *>(ptr) - 1;
+    if (large->previous != nullptr)
+      large->previous->next = large->next;
+    else
+      _large_blocks = large->next;
+    if (large->next != nullptr)
+      large->next->previous = large->previous;
+    _capacity -= large->size;
+    ::operator delete(large);
+    return;
+  }
+
+  auto slot = static_cast<free_slot *>(ptr);
+  slot->next = _free[size / alignment - 1];
+  _free[size / alignment - 1] = slot;
+}
+
+inline void trie_arena::release() noexcept {
+  for (block *current = _blocks; current != nullptr;) {
+    block *next = current->next;
+    ::operator delete(current);
+    current = next;
+  }
+  for (block *current = _large_blocks; current != nullptr;) {
+    block *next = current->next;
+    ::operator delete(current);
+    current = next;
+  }
+  reset();
+}
+
+// Takes over other's blocks and free slots so that memory allocated from
+// other can be freed through this arena. The unused tail of other's
+// current block is given up. other is left empty.
+inline void trie_arena::adopt(trie_arena &other) noexcept {
+  if (_passthrough || other._passthrough || this == &other)
+    return;
+
+  if (other._blocks != nullptr) {
+    block *tail = other._blocks;
+    while (tail->next != nullptr)
+      tail = tail->next;
+    tail->next = _blocks;
+    if (_blocks == nullptr) {
+      _cursor = other._cursor;
+      _end = other._end;
+    }
+    _blocks = other._blocks;
+  }
+  if (other._large_blocks != nullptr) {
+    block *tail = other._large_blocks;
+    while (tail->next != nullptr)
+      tail = tail->next;
+    tail->next = _large_blocks;
+    if (_large_blocks != nullptr)
+      _large_blocks->previous = tail;
+    _large_blocks = other._large_blocks;
+  }
+  for (std::size_t i = 0; i < size_classes; ++i) {
+    if (other._free[i] == nullptr)
+      continue;
+    free_slot *tail = other._free[i];
+    while (tail->next != nullptr)
+      tail = tail->next;
+    tail->next = _free[i];
+    _free[i] = other._free[i];
+  }
+  _capacity += other._capacity;
+  other.reset();
+}
+
+// ###### capacity ######
+
+inline std::size_t trie_arena::capacity() const noexcept { return _capacity; }
+
+// ###### utilities ######
+
+inline std::size_t trie_arena::round_up(std::size_t size) noexcept {
+  if (size == 0)
+    return alignment;
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+inline void trie_arena::reset() noexcept {
+  _blocks = nullptr;
+  _large_blocks = nullptr;
+  _cursor = nullptr;
+  _end = nullptr;
+  _capacity = 0;
+  for (auto &slot : _free)
+    slot = nullptr;
+}
+
+inline void trie_arena::steal(trie_arena &other) noexcept {
+  _passthrough = other._passthrough;
+  _blocks = other._blocks;
+  _large_blocks = other._large_blocks;
+  _cursor = other._cursor;
+  _end = other._end;
+  _capacity = other._capacity;
+  for (std::size_t i = 0; i < size_classes; ++i)
+    _free[i] = other._free[i];
+  other.reset();
+}
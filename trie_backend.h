@@ -0,0 +1,27 @@
+#pragma once
+
+#include "double_array_trie.h"
+#include "trie.h"
+
+// Storage policies for basic_trie. node_backend is the trie_node tree with
+// path compression, subtree counts and the rest of trie's interface;
+// double_array_backend keeps the common part on a double array for
+// exact-match lookups. The common part has the same signatures on both:
+// find, count, contains, insert, insert_or_assign and erase, at() and
+// operator[] returning std::optional<_Value> &, and iterators with key()
+// whose elements give the value through get_value().
+struct node_backend {};
+struct double_array_backend {};
+
+template <typename _Value, typename _Backend> struct trie_backend;
+
+template <typename _Value> struct trie_backend<_Value, node_backend> {
+  using type = trie<_Value>;
+};
+
+template <typename _Value> struct trie_backend<_Value, double_array_backend> {
+  using type = double_array_trie<_Value>;
+};
+
+template <typename _Value, typename _Backend = node_backend>
+using basic_trie = typename trie_backend<_Value, _Backend>::type;
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for concurrent_trie. Readers pin the current
+// epoch with a guard for as long as they hold pointers into a trie; memory
+// unlinked by a writer is retired with the epoch it was unlinked in and only
+// freed once every pinned reader has moved past that epoch. All tries share
+// one process-wide epoch and one list of per-thread records. Each thread
+// keeps its own list of retired pointers; whatever is still waiting when a
+// thread exits is handed to a shared list that later reclaims pick up.
+class trie_epoch {
+public:
+  class guard {
+  public:
+    guard() noexcept;
+    guard(const guard &other) = delete;
+    guard &operator=(const guard &other) = delete;
+    ~guard() noexcept;
+  };
+
+  static void retire(void *ptr, void (*deleter)(void *)) noexcept;
+  static void reclaim() noexcept;
+
+  static std::uint64_t current() noexcept;
+  static std::uint64_t advance() noexcept;
+  static std::uint64_t oldest_pinned() noexcept;
+
+private:
+  static constexpr std::uint64_t idle = 0;
+  static constexpr std::size_t batch = 64;
+
+  struct retired {
+    void *ptr;
+    void (*deleter)(void *);
+    std::uint64_t epoch;
+  };
+
+  // Reclaims once entries reach threshold; the threshold follows what a
+  // reclaim had to keep, so readers pinned for long do not turn every
+  // retire into a scan.
+  struct retire_list {
+    std::vector<retired> entries;
+    std::size_t threshold = batch;
+    ~retire_list() noexcept;
+  };
+
+  // Freed unconditionally at exit, when no reader can be left.
+  struct orphanage {
+    std::mutex lock;
+    std::vector<retired> entries;
+    ~orphanage() noexcept;
+  };
+
+  struct alignas(64) record {
+    std::atomic<std::uint64_t> epoch;
+    std::atomic<bool> in_use;
+    record *next;
+    unsigned int depth;
+  };
+
+  // Releases the thread's record when the thread exits.
+  struct registration {
+    record *owned;
+    registration() noexcept;
+    ~registration() noexcept;
+  };
+
+  static std::atomic<std::uint64_t> _epoch;
+  static std::atomic<record *> _records;
+
+  static record *local() noexcept;
+  static retire_list &local_retired() noexcept;
+  static orphanage &orphans() noexcept;
+  static void collect(std::vector<retired> &entries,
+                      std::uint64_t oldest) noexcept;
+};
+
+inline std::atomic<std::uint64_t> trie_epoch::_epoch{1};
+inline std::atomic<trie_epoch::record *> trie_epoch::_records{nullptr};
+
+// ###### guard ######
+
+inline trie_epoch::guard::guard() noexcept {
+  record *self = local();
+  if (self->depth++ == 0) {
+    self->epoch.store(_epoch.load(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+inline trie_epoch::guard::~guard() noexcept {
+  record *self = local();
+  if (--self->depth == 0)
+    self->epoch.store(idle, std::memory_order_release);
+}
+
+// ###### retirement ######
+
+inline void trie_epoch::retire(void *ptr, void (*deleter)(void *)) noexcept {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto &list = local_retired();
+  list.entries.push_back({ptr, deleter, _epoch.load()});
+  if (list.entries.size() >= list.threshold)
+    reclaim();
+}
+
+// Frees whatever no pinned reader can still reach.
+inline void trie_epoch::reclaim() noexcept {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  advance();
+  std::uint64_t oldest = oldest_pinned();
+  auto &list = local_retired();
+  collect(list.entries, oldest);
+  list.threshold = std::max(batch, 2 * list.entries.size());
+  auto &shared = orphans();
+  std::unique_lock<std::mutex> guard(shared.lock, std::try_to_lock);
+  if (guard.owns_lock())
+    collect(shared.entries, oldest);
+}
+
+inline void trie_epoch::collect(std::vector<retired> &entries,
+                                std::uint64_t oldest) noexcept {
+  std::size_t kept = 0;
+  for (auto &entry : entries) {
+    if (entry.epoch < oldest)
+      entry.deleter(entry.ptr);
+    else
+      entries[kept++] = entry;
+  }
+  entries.resize(kept);
+}
+
+inline trie_epoch::retire_list::~retire_list() noexcept {
+  if (entries.empty())
+    return;
+  auto &shared = orphans();
+  std::lock_guard<std::mutex> guard(shared.lock);
+  shared.entries.insert(shared.entries.end(), entries.begin(), entries.end());
+}
+
+inline trie_epoch::orphanage::~orphanage() noexcept {
+  for (auto &entry : entries)
+    entry.deleter(entry.ptr);
+}
+
+inline trie_epoch::retire_list &trie_epoch::local_retired() noexcept {
+  thread_local retire_list list;
+  return list;
+}
+
+inline trie_epoch::orphanage &trie_epoch::orphans() noexcept {
+  static orphanage shared;
+  return shared;
+}
+
+// ###### epochs ######
+
+inline std::uint64_t trie_epoch::current() noexcept { return _epoch.load(); }
+
+inline std::uint64_t trie_epoch::advance() noexcept {
+  return _epoch.fetch_add(1) + 1;
+}
+
+inline std::uint64_t trie_epoch::oldest_pinned() noexcept {
+  std::uint64_t oldest = _epoch.load();
+  for (record *r = _records.load(std::memory_order_acquire); r != nullptr;
+       r = r->next) {
+    std::uint64_t pinned = r->epoch.load();
+    if (pinned != idle && pinned < oldest)
+      oldest = pinned;
+  }
+  return oldest;
+}
+
+// ###### records ######
+
+// Records are never freed; a thread takes over an unused one or pushes a
+// fresh record onto the list.
+inline trie_epoch::registration::registration() noexcept {
+  for (record *r = _records.load(std::memory_order_acquire); r != nullptr;
+       r = r->next) {
+    bool expected = false;
+    if (!r->in_use.load(std::memory_order_relaxed) &&
+        r->in_use.compare_exchange_strong(expected, true)) {
+      owned = r;
+      return;
+    }
+  }
+  owned = new record();
+  owned->epoch.store(idle, std::memory_order_relaxed);
+  owned->in_use.store(true, std::memory_order_relaxed);
+  owned->depth = 0;
+  owned->next = _records.load(std::memory_order_relaxed);
+  while (!_records.compare_exchange_weak(owned->next, owned,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed))
+    ;
+}
+
+inline trie_epoch::registration::~registration() noexcept {
+  owned->epoch.store(idle, std::memory_order_release);
+  owned->in_use.store(false, std::memory_order_release);
+}
+
+inline trie_epoch::record *trie_epoch::local() noexcept {
+  thread_local registration self;
+  return self.owned;
+}
@@ -1,33 +1,64 @@
 #pragma once
 
+#include "trie_arena.h"
+#include "trie_node_children.h"
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <ostream>
-#include <set>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
-template <typename _Value> class trie_node {
+template <typename _Value, typename _Symbol = char> class trie_node {
 public:
-  using key_type = char;
+  using key_type = _Symbol;
+  using string_type = trie_string<_Symbol>;
+  using label_type = trie_string_view<_Symbol>;
   using value_type = _Value;
 
-  trie_node(char key, std::optional<_Value> value = std::nullopt,
+  // Aho-Corasick links set up by trie::compile(): fail is the node of the
+  // longest proper suffix of this node's key that is also in the trie,
+  // output the nearest node with a value along the fail chain, depth the
+  // key length.
+  struct links {
+    trie_node *fail;
+    trie_node *output;
+    std::size_t depth;
+  };
+
+  trie_node(_Symbol key, std::optional<_Value> value = std::nullopt,
             trie_node *parent = nullptr) noexcept;
   trie_node(const trie_node &other_node) noexcept;
   ~trie_node() noexcept;
 
-  static std::pair<trie_node<_Value> *, bool>
-  make_trie_node(trie_node<_Value> *base, std::string full_key,
+  static trie_node<_Value, _Symbol> *
+  create(_Symbol key, std::optional<_Value> value = std::nullopt,
+         trie_arena *arena = trie_arena::heap()) noexcept;
+  static void destroy(trie_node<_Value, _Symbol> *node,
+                      trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  clone(trie_arena *arena = trie_arena::heap()) const noexcept;
+
+  static std::pair<trie_node<_Value, _Symbol> *, bool>
+  make_trie_node(trie_node<_Value, _Symbol> *base, string_type full_key,
                  std::optional<_Value> value = std::nullopt);
 
   // ###### path ######
-  trie_node<_Value> *get_parent() const noexcept;
-  trie_node<_Value> *get_child(const char key) const noexcept;
+  trie_node<_Value, _Symbol> *get_parent() const noexcept;
+  trie_node<_Value, _Symbol> *get_child(const _Symbol key) const noexcept;
+  trie_node<_Value, _Symbol> *get_first_child() const noexcept;
+  trie_node<_Value, _Symbol> *get_last_child() const noexcept;
+  trie_node<_Value, _Symbol> *get_next_child(const _Symbol key) const
+      noexcept;
+  trie_node<_Value, _Symbol> *get_previous_child(const _Symbol key) const
+      noexcept;
+  void prefetch_child(const _Symbol key) const noexcept;
+  template <typename _Function> void for_each_child(_Function function) const;
 
   // ###### print ######
   void print_tree_from_this(const int level = 0) const noexcept;
@@ -35,22 +66,50 @@ public:
   // ###### get ######
   std::optional<_Value> &get_value() noexcept;
   const std::optional<_Value> &get_value() const noexcept;
-  std::string get_key() const noexcept;
-  char get_node_key() const noexcept;
-  std::vector<char> get_children_keys() const noexcept;
-  bool has_child(char child_key) const noexcept;
-  bool has_previous_child(char child_key) const noexcept;
+  string_type get_key() const noexcept;
+  _Symbol get_node_key() const noexcept;
+  label_type get_label() const noexcept;
+  std::vector<_Symbol> get_children_keys() const noexcept;
+  bool has_child(_Symbol child_key) const noexcept;
+  bool has_previous_child(_Symbol child_key) const noexcept;
   bool has_children() const noexcept;
+  unsigned int children_count() const noexcept;
+  unsigned int get_subtree_count() const noexcept;
+  const links *get_links() const noexcept;
+  float get_max_score() const noexcept;
+  std::size_t node_count() const noexcept;
+  std::size_t value_count() const noexcept;
+  std::size_t memory_usage() const noexcept;
 
   // ###### Modifiers ######
-  void set_parent(trie_node<_Value> *new_parent) noexcept;
-  void assign_value(const _Value value) noexcept;
+  void set_parent(trie_node<_Value, _Symbol> *new_parent) noexcept;
+  void set_subtree_count(unsigned int count) noexcept;
+  void set_max_score(float score) noexcept;
+  links *make_links(trie_arena *arena = trie_arena::heap()) noexcept;
+  void assign_value(const _Value &value) noexcept;
+  void assign_value(_Value &&value) noexcept;
+  template <typename... _Args> void emplace_value(_Args &&...args) noexcept;
   void erase_value() noexcept;
-  void erase_child(char key) noexcept;
-  void clear_children() noexcept;
-  trie_node<_Value> *
-  insert_child(const char key,
-               std::optional<_Value> value = std::nullopt) noexcept;
+  void erase_child(_Symbol key,
+                   trie_arena *arena = trie_arena::heap()) noexcept;
+  void clear_children(trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  insert_child(const _Symbol key, std::optional<_Value> value = std::nullopt,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  insert_child(const _Symbol key, label_type label,
+               std::optional<_Value> value,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  insert_child(trie_node<_Value, _Symbol> *child,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  detach_child(_Symbol key, trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  split_label(std::size_t length,
+              trie_arena *arena = trie_arena::heap()) noexcept;
+  trie_node<_Value, _Symbol> *
+  merge_child(_Symbol key, trie_arena *arena = trie_arena::heap()) noexcept;
 
   // ###### operators ######
   friend bool operator<(const trie_node &node1, const trie_node &node2) {
@@ -63,205 +122,467 @@ public:
               << "none";
   }
 
-  struct compare {
-    bool operator()(const trie_node *a, const trie_node *b) const {
-      return a->_key < b->_key;
-    }
-  };
-
 private:
-  char _key;
+  _Symbol _key;
+  std::uint32_t _label_length;
+  std::uint32_t _subtree_count;
+  float _max_score;
+  _Symbol *_label;
   std::optional<_Value> _value;
-  trie_node<_Value> *_parent;
-  std::set<trie_node<_Value> *, compare> _children;
+  trie_node<_Value, _Symbol> *_parent;
+  links *_links;
+  trie_children_t<trie_node<_Value, _Symbol>, _Symbol> _children;
 
-  trie_node(trie_node<_Value> *base, std::string full_key,
+  trie_node(trie_node<_Value, _Symbol> *base, string_type full_key,
             std::optional<_Value> value = std::nullopt) noexcept;
 
-  trie_node<_Value> *insert_child(trie_node<_Value> *child) noexcept;
+  void assign_label(label_type label, trie_arena *arena) noexcept;
 };
 
-template <typename _Value>
-trie_node<_Value>::trie_node(char key, std::optional<_Value> value,
-                             trie_node<_Value> *parent) noexcept {
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol>::trie_node(
+    _Symbol key, std::optional<_Value> value,
+    trie_node<_Value, _Symbol> *parent) noexcept {
   _key = key;
-  _value = value;
+  _label_length = 0;
+  _subtree_count = 0;
+  _max_score = -std::numeric_limits<float>::infinity();
+  _label = nullptr;
+  _value = std::move(value);
   _parent = parent;
+  _links = nullptr;
 }
 
-template <typename _Value>
-trie_node<_Value>::trie_node(trie_node<_Value> *base, std::string full_key,
-                             std::optional<_Value> value) noexcept {
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol>::trie_node(trie_node<_Value, _Symbol> *base,
+                                      string_type full_key,
+                                      std::optional<_Value> value) noexcept {
 
   _key = full_key.back();
-  _value = value;
+  _label_length = 0;
+  _subtree_count = 0;
+  _max_score = -std::numeric_limits<float>::infinity();
+  _label = nullptr;
+  _value = std::move(value);
+  _links = nullptr;
   base->insert_child(this);
 }
 
-template <typename _Value>
-trie_node<_Value>::trie_node(const trie_node<_Value> &other_node) noexcept {
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol>::trie_node(
+    const trie_node<_Value, _Symbol> &other_node) noexcept {
   _key = other_node._key;
+  _label_length = 0;
+  _subtree_count = other_node._subtree_count;
+  _max_score = other_node._max_score;
+  _label = nullptr;
+  assign_label(other_node.get_label(), trie_arena::heap());
   _value = std::nullopt;
   _parent = nullptr;
+  _links = nullptr;
   if (other_node.get_value() != std::nullopt)
     _value = std::optional<_Value>(other_node._value.value());
-  for (auto it = other_node._children.begin(); it != other_node._children.end();
-       ++it) {
-    _children.insert(new trie_node<_Value>(*(*it)));
-    (*_children.find((*it)))->set_parent(this);
-  }
+  other_node._children.for_each([this](_Symbol, trie_node *child) {
+    insert_child(child->clone());
+  });
 }
 
-template <typename _Value> trie_node<_Value>::~trie_node() noexcept {
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol>::~trie_node() noexcept {
   clear_children();
+  assign_label(label_type(), trie_arena::heap());
+  if (_links != nullptr)
+    trie_arena::heap()->deallocate(_links, sizeof(links));
+}
+
+// Nodes allocated from an arena must be released through destroy() with the
+// same arena; the destructor alone frees children and labels with the heap.
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::create(_Symbol key, std::optional<_Value> value,
+                                   trie_arena *arena) noexcept {
+  return new (arena->allocate(sizeof(trie_node<_Value, _Symbol>)))
+      trie_node<_Value, _Symbol>(key, std::move(value));
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::destroy(trie_node<_Value, _Symbol> *node,
+                                         trie_arena *arena) noexcept {
+  node->clear_children(arena);
+  node->assign_label(label_type(), arena);
+  if (node->_links != nullptr)
+    arena->deallocate(node->_links, sizeof(links));
+  node->_links = nullptr;
+  node->~trie_node();
+  arena->deallocate(node, sizeof(trie_node<_Value, _Symbol>));
+}
+
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::clone(trie_arena *arena) const noexcept {
+  auto copy = create(_key, std::nullopt, arena);
+  copy->_value = _value;
+  copy->assign_label(get_label(), arena);
+  copy->_subtree_count = _subtree_count;
+  copy->_max_score = _max_score;
+  _children.for_each([copy, arena](_Symbol, const trie_node *child) {
+    copy->insert_child(child->clone(arena), arena);
+  });
+  return copy;
 }
 
 // ###### path ######
-template <typename _Value>
-trie_node<_Value> *trie_node<_Value>::get_parent() const noexcept {
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_parent() const noexcept {
   return _parent;
 }
 
-template <typename _Value>
-trie_node<_Value> *trie_node<_Value>::get_child(const char key) const noexcept {
-  auto item =
-      std::find_if(_children.begin(), _children.end(),
-                   [&key](const trie_node *node) { return node->_key == key; });
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_child(const _Symbol key) const noexcept {
+  return _children.find(key);
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::prefetch_child(const _Symbol key) const
+    noexcept {
+  _children.prefetch(key);
+}
 
-  if (item != _children.end())
-    return (*item);
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_first_child() const noexcept {
+  return _children.first();
+}
 
-  return nullptr;
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_last_child() const noexcept {
+  return _children.last();
+}
+
+// Sibling that follows / precedes the child under key.
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_next_child(const _Symbol key) const noexcept {
+  return _children.next(key);
+}
+
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::get_previous_child(const _Symbol key) const
+    noexcept {
+  return _children.previous(key);
+}
+
+template <typename _Value, typename _Symbol>
+template <typename _Function>
+void trie_node<_Value, _Symbol>::for_each_child(_Function function) const {
+  _children.for_each(
+      [&function](_Symbol, trie_node *child) { function(child); });
 }
 
 // ###### print ######
-template <typename _Value>
-void trie_node<_Value>::print_tree_from_this(const int level) const noexcept {
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::print_tree_from_this(const int level) const
+    noexcept {
   if (level == 0)
     std::cout << " " << this->_key << std::endl;
   std::string level_marker = "";
   for (int l = 0; l < level; ++l)
     level_marker += " │ ";
 
-  for (auto iterator = _children.begin(); iterator != _children.end();
-       ++iterator) {
+  _children.for_each([&level, &level_marker](_Symbol, trie_node *child) {
     std::cout << level_marker;
-    if ((*(*iterator)).get_value().has_value())
-      std::cout << " ├─ " << (*(*iterator)).get_node_key()
-                << " :: " << (*(*iterator)).get_value().value();
+    std::cout << " ├─ " << child->get_node_key() << child->get_label();
+    if (child->get_value().has_value())
+      std::cout << " :: " << child->get_value().value();
     else
-      std::cout << " ├─ " << (*(*iterator)).get_node_key()
-                << " :: none";
-    if ((*iterator)->has_children()) {
+      std::cout << " :: none";
+    if (child->has_children()) {
       std::cout << std::endl;
-      (*iterator)->print_tree_from_this(level + 1);
+      child->print_tree_from_this(level + 1);
     }
     std::cout << std::endl;
-  }
+  });
   std::cout << level_marker;
 }
 
 // ###### get ######
 
-template <typename _Value>
-const std::optional<_Value> &trie_node<_Value>::get_value() const noexcept {
+template <typename _Value, typename _Symbol>
+const std::optional<_Value> &
+trie_node<_Value, _Symbol>::get_value() const noexcept {
   return _value;
 }
 
-template <typename _Value>
-std::optional<_Value> &trie_node<_Value>::get_value() noexcept {
+template <typename _Value, typename _Symbol>
+std::optional<_Value> &trie_node<_Value, _Symbol>::get_value() noexcept {
   return _value;
 }
 
-template <typename _Value>
-std::string trie_node<_Value>::get_key() const noexcept {
-  std::string key = "";
+template <typename _Value, typename _Symbol>
+typename trie_node<_Value, _Symbol>::string_type
+trie_node<_Value, _Symbol>::get_key() const noexcept {
+  string_type key;
   auto current_node = this;
   while (current_node != nullptr) {
-    key = current_node->get_node_key() + key;
+    key = current_node->get_node_key() +
+          string_type(current_node->get_label()) + key;
     current_node = current_node->get_parent();
   }
   return key;
 }
 
-template <typename _Value>
-char trie_node<_Value>::get_node_key() const noexcept {
+template <typename _Value, typename _Symbol>
+_Symbol trie_node<_Value, _Symbol>::get_node_key() const noexcept {
   return _key;
 }
 
-template <typename _Value>
-std::vector<char> trie_node<_Value>::get_children_keys() const noexcept {
-  std::vector<char> keys;
-  for (auto iterator = _children.begin(); iterator != _children.end();
-       ++iterator) {
-    keys.push_back((*iterator)->get_node_key());
-  }
+// Characters of the edge that follow get_node_key(); only path-compressed
+// nodes carry more than one character.
+template <typename _Value, typename _Symbol>
+typename trie_node<_Value, _Symbol>::label_type
+trie_node<_Value, _Symbol>::get_label() const noexcept {
+  // Never null: some char_traits pass even empty ranges to memcpy.
+  return label_type(_label_length ? _label : &_key, _label_length);
+}
+
+template <typename _Value, typename _Symbol>
+std::vector<_Symbol>
+trie_node<_Value, _Symbol>::get_children_keys() const noexcept {
+  std::vector<_Symbol> keys;
+  keys.reserve(_children.size());
+  _children.for_each([&keys](_Symbol key, trie_node *) {
+    keys.push_back(key);
+  });
   return keys;
 }
 
-template <typename _Value>
-bool trie_node<_Value>::has_child(char child_key) const noexcept {
+template <typename _Value, typename _Symbol>
+bool trie_node<_Value, _Symbol>::has_child(_Symbol child_key) const noexcept {
   return get_child(child_key) != nullptr;
 }
 
-template <typename _Value>
-bool trie_node<_Value>::has_previous_child(char child_key) const noexcept {
-  if (!has_children())
-    return false;
-  std::vector<char> keys = get_children_keys();
-  auto ckey = std::find(keys.rbegin(), keys.rend(), child_key);
-  ckey++;
-  return ckey != keys.rend();
+template <typename _Value, typename _Symbol>
+bool trie_node<_Value, _Symbol>::has_previous_child(_Symbol child_key) const
+    noexcept {
+  return _children.previous(child_key) != nullptr;
+}
+
+template <typename _Value, typename _Symbol>
+bool trie_node<_Value, _Symbol>::has_children() const noexcept {
+  return !_children.empty();
+}
+
+template <typename _Value, typename _Symbol>
+unsigned int trie_node<_Value, _Symbol>::children_count() const noexcept {
+  return _children.size();
+}
+
+// Number of values stored in this node and below it. Only kept up to date by
+// a trie with subtree counts enabled.
+template <typename _Value, typename _Symbol>
+unsigned int trie_node<_Value, _Symbol>::get_subtree_count() const noexcept {
+  return _subtree_count;
+}
+
+// nullptr until the node is compiled (see trie::compile()).
+template <typename _Value, typename _Symbol>
+const typename trie_node<_Value, _Symbol>::links *
+trie_node<_Value, _Symbol>::get_links() const noexcept {
+  return _links;
+}
+
+// Highest score stored in this node and below it, -infinity for none. Only
+// kept up to date by a trie with max scores enabled.
+template <typename _Value, typename _Symbol>
+float trie_node<_Value, _Symbol>::get_max_score() const noexcept {
+  return _max_score;
+}
+
+template <typename _Value, typename _Symbol>
+std::size_t trie_node<_Value, _Symbol>::node_count() const noexcept {
+  std::size_t count = 1;
+  _children.for_each([&count](_Symbol, const trie_node *child) {
+    count += child->node_count();
+  });
+  return count;
+}
+
+template <typename _Value, typename _Symbol>
+std::size_t trie_node<_Value, _Symbol>::value_count() const noexcept {
+  std::size_t count = _value.has_value() ? 1 : 0;
+  _children.for_each([&count](_Symbol, const trie_node *child) {
+    count += child->value_count();
+  });
+  return count;
 }
 
-template <typename _Value>
-bool trie_node<_Value>::has_children() const noexcept {
-  return _children.size() != 0;
+template <typename _Value, typename _Symbol>
+std::size_t trie_node<_Value, _Symbol>::memory_usage() const noexcept {
+  std::size_t bytes =
+      sizeof(trie_node<_Value, _Symbol>) + _label_length * sizeof(_Symbol) +
+      _children.memory_usage();
+  if (_links != nullptr)
+    bytes += sizeof(links);
+  _children.for_each([&bytes](_Symbol, const trie_node *child) {
+    bytes += child->memory_usage();
+  });
+  return bytes;
 }
 
 // ###### set ######
-template <typename _Value>
-void trie_node<_Value>::set_parent(trie_node<_Value> *new_parent) noexcept {
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::set_parent(
+    trie_node<_Value, _Symbol> *new_parent) noexcept {
   _parent = new_parent;
 }
 
-template <typename _Value>
-void trie_node<_Value>::assign_value(const _Value value) noexcept {
-  _value = std::optional<_Value>(value);
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::set_subtree_count(
+    unsigned int count) noexcept {
+  _subtree_count = count;
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::set_max_score(float score) noexcept {
+  _max_score = score;
+}
+
+// Links are allocated on first use and then reused by later compiles.
+template <typename _Value, typename _Symbol>
+typename trie_node<_Value, _Symbol>::links *
+trie_node<_Value, _Symbol>::make_links(trie_arena *arena) noexcept {
+  if (_links == nullptr)
+    _links = new (arena->allocate(sizeof(links))) links();
+  return _links;
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::assign_value(const _Value &value) noexcept {
+  _value = value;
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::assign_value(_Value &&value) noexcept {
+  _value = std::move(value);
+}
+
+// Constructs the value in place, replacing any previous one.
+template <typename _Value, typename _Symbol>
+template <typename... _Args>
+void trie_node<_Value, _Symbol>::emplace_value(_Args &&...args) noexcept {
+  _value.emplace(std::forward<_Args>(args)...);
 }
 
-template <typename _Value> void trie_node<_Value>::erase_value() noexcept {
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::erase_value() noexcept {
   _value = std::nullopt;
 }
 
-template <typename _Value>
-void trie_node<_Value>::erase_child(char key) noexcept {
-  if (has_child(key)) {
-    auto it = _children.find(get_child(key));
-    delete get_child(key);
-    _children.erase(it);
-  }
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::erase_child(_Symbol key,
+                                             trie_arena *arena) noexcept {
+  auto child = _children.erase(key, arena);
+  if (child != nullptr)
+    destroy(child, arena);
 }
 
-template <typename _Value> void trie_node<_Value>::clear_children() noexcept {
-  for (auto iterator = _children.begin(); iterator != _children.end();
-       ++iterator) {
-    delete (*iterator);
-  }
-  _children.clear();
+// Unlinks the child without freeing it; the caller takes over the subtree.
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::detach_child(_Symbol key,
+                                         trie_arena *arena) noexcept {
+  auto child = _children.erase(key, arena);
+  if (child != nullptr)
+    child->_parent = nullptr;
+  return child;
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::clear_children(trie_arena *arena) noexcept {
+  _children.for_each(
+      [arena](_Symbol, trie_node *child) { destroy(child, arena); });
+  _children.clear(arena);
+}
+
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::insert_child(const _Symbol key,
+                                         std::optional<_Value> value,
+                                         trie_arena *arena) noexcept {
+  return insert_child(create(key, std::move(value), arena), arena);
 }
 
-template <typename _Value>
-trie_node<_Value> *
-trie_node<_Value>::insert_child(const char key,
-                                std::optional<_Value> value) noexcept {
-  return insert_child(new trie_node(key, value));
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::insert_child(const _Symbol key, label_type label,
+                                         std::optional<_Value> value,
+                                         trie_arena *arena) noexcept {
+  auto child = insert_child(key, std::move(value), arena);
+  child->assign_label(label, arena);
+  return child;
 }
 
-template <typename _Value>
-trie_node<_Value> *
-trie_node<_Value>::insert_child(trie_node<_Value> *child) noexcept {
+// Cuts this node's edge after `length` label characters. A new valueless
+// node takes over the upper part of the edge and this node, with its value
+// and children, hangs below it.
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::split_label(std::size_t length,
+                                        trie_arena *arena) noexcept {
+  auto upper = create(_key, std::nullopt, arena);
+  upper->assign_label(get_label().substr(0, length), arena);
+  upper->_subtree_count = _subtree_count;
+  upper->_max_score = _max_score;
+  _parent->_children.erase(_key, arena);
+  _parent->insert_child(upper, arena);
+  _key = _label[length];
+  assign_label(get_label().substr(length + 1), arena);
+  upper->insert_child(this, arena);
+  return upper;
+}
+
+// Folds the valueless single-child node under `key` into its child, which
+// takes over the joined edge. Returns the surviving child.
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::merge_child(_Symbol key,
+                                        trie_arena *arena) noexcept {
+  auto middle = _children.erase(key, arena);
+  auto child = middle->_children.first();
+  middle->_children.clear(arena);
+  string_type label(middle->get_label());
+  label += child->_key;
+  label += child->get_label();
+  child->assign_label(label, arena);
+  child->_key = middle->_key;
+  destroy(middle, arena);
+  return insert_child(child, arena);
+}
+
+template <typename _Value, typename _Symbol>
+trie_node<_Value, _Symbol> *
+trie_node<_Value, _Symbol>::insert_child(trie_node<_Value, _Symbol> *child,
+                                         trie_arena *arena) noexcept {
   child->_parent = this;
-  _children.insert(child);
+  _children.insert(child->_key, child, arena);
   return (child);
-}
\ No newline at end of file
+}
+
+template <typename _Value, typename _Symbol>
+void trie_node<_Value, _Symbol>::assign_label(label_type label,
+                                              trie_arena *arena) noexcept {
+  _Symbol *copy = nullptr;
+  if (!label.empty()) {
+    copy = static_cast<_Symbol *>(
+        arena->allocate(label.length() * sizeof(_Symbol)));
+    std::memcpy(copy, label.data(), label.length() * sizeof(_Symbol));
+  }
+  if (_label != nullptr)
+    arena->deallocate(_label, _label_length * sizeof(_Symbol));
+  _label = copy;
+  _label_length = static_cast<std::uint32_t>(label.length());
+}
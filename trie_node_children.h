@@ -0,0 +1,1033 @@
+#pragma once
+
+#include "trie_arena.h"
+#include "trie_symbol.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Adaptive child container (Node4/16/48/256) for one-byte symbols. Sparse
+// nodes keep sorted key and pointer arrays, dense nodes switch to an index
+// table or a direct 256-slot table. Children are ordered as in
+// trie_symbol_traits, which for char is signed char order. Tables are
+// allocated from the arena passed to the modifiers; the destructor assumes
+// trie_arena::heap().
+template <typename _Node, typename _Symbol = char> class trie_node_children {
+  static_assert(trie_symbol_traits<_Symbol>::alphabet_size == 256,
+                "trie_node_children needs a one-byte symbol");
+
+public:
+  using key_type = _Symbol;
+  using size_type = unsigned int;
+
+  trie_node_children() noexcept;
+  trie_node_children(const trie_node_children &other) = delete;
+  trie_node_children &operator=(const trie_node_children &other) = delete;
+  ~trie_node_children() noexcept;
+
+  // ###### lookup ######
+  _Node *find(const _Symbol key) const noexcept;
+  _Node *first() const noexcept;
+  _Node *last() const noexcept;
+  _Node *next(const _Symbol key) const noexcept;
+  _Node *previous(const _Symbol key) const noexcept;
+  void prefetch(const _Symbol key) const noexcept;
+
+  // ###### capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+  // ###### modifiers ######
+  void insert(const _Symbol key, _Node *child,
+              trie_arena *arena = trie_arena::heap()) noexcept;
+  _Node *erase(const _Symbol key,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  void clear(trie_arena *arena = trie_arena::heap()) noexcept;
+
+  // ###### traversal ######
+  template <typename _Function> void for_each(_Function function) const;
+
+private:
+  enum layout : std::uint8_t { none, node4, node16, node48, node256 };
+
+  template <std::size_t _Capacity> struct sorted_node {
+    _Symbol keys[_Capacity];
+    _Node *children[_Capacity];
+  };
+  using sorted4 = sorted_node<4>;
+  using sorted16 = sorted_node<16>;
+
+  struct indexed48 {
+    std::uint8_t index[256];
+    _Node *children[48];
+  };
+
+  struct direct256 {
+    _Node *children[256];
+  };
+
+  layout _layout;
+  std::uint16_t _size;
+  union {
+    void *any;
+    sorted4 *n4;
+    sorted16 *n16;
+    indexed48 *n48;
+    direct256 *n256;
+  } _body;
+
+  static std::uint8_t slot(const _Symbol key) noexcept;
+  static _Symbol key_of(const std::uint8_t slot) noexcept;
+
+  template <typename _Sorted>
+  static _Node *sorted_find(const _Sorted *body, std::uint16_t size,
+                            const _Symbol key) noexcept;
+  static _Node *packed_find(const sorted16 *body, std::uint16_t size,
+                            const _Symbol key) noexcept;
+  template <typename _Sorted>
+  static void sorted_insert(_Sorted *body, std::uint16_t size,
+                            const _Symbol key, _Node *child) noexcept;
+  template <typename _Sorted>
+  static _Node *sorted_erase(_Sorted *body, std::uint16_t size,
+                             const _Symbol key) noexcept;
+
+  template <typename _Body> static _Body *make_body(trie_arena *arena) noexcept;
+  template <typename _Body>
+  static void free_body(_Body *body, trie_arena *arena) noexcept;
+
+  void grow(trie_arena *arena) noexcept;
+  void shrink(trie_arena *arena) noexcept;
+  void release_body(trie_arena *arena) noexcept;
+};
+
+template <typename _Node, typename _Symbol>
+trie_node_children<_Node, _Symbol>::trie_node_children() noexcept
+    : _layout(none), _size(0) {
+  _body.any = nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+trie_node_children<_Node, _Symbol>::~trie_node_children() noexcept {
+  release_body(trie_arena::heap());
+}
+
+// ###### lookup ######
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::find(const _Symbol key) const
+    noexcept {
+  switch (_layout) {
+  case node4:
+    return sorted_find(_body.n4, _size, key);
+  case node16:
+    return packed_find(_body.n16, _size, key);
+  case node48: {
+    std::uint8_t position = _body.n48->index[slot(key)];
+    return position ? _body.n48->children[position - 1] : nullptr;
+  }
+  case node256:
+    return _body.n256->children[slot(key)];
+  default:
+    return nullptr;
+  }
+}
+
+// Asks for the part of the table that find(key) reads first.
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::prefetch(const _Symbol key) const
+    noexcept {
+  switch (_layout) {
+  case node4:
+  case node16:
+    __builtin_prefetch(_body.any);
+    __builtin_prefetch(static_cast<const char *>(_body.any) + 64);
+    break;
+  case node48:
+    __builtin_prefetch(&_body.n48->index[slot(key)]);
+    break;
+  case node256:
+    __builtin_prefetch(&_body.n256->children[slot(key)]);
+    break;
+  default:
+    break;
+  }
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::first() const noexcept {
+  switch (_layout) {
+  case node4:
+    return _body.n4->children[0];
+  case node16:
+    return _body.n16->children[0];
+  case node48:
+    for (int s = 0; s < 256; ++s)
+      if (_body.n48->index[s])
+        return _body.n48->children[_body.n48->index[s] - 1];
+    return nullptr;
+  case node256:
+    for (int s = 0; s < 256; ++s)
+      if (_body.n256->children[s])
+        return _body.n256->children[s];
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::last() const noexcept {
+  switch (_layout) {
+  case node4:
+    return _body.n4->children[_size - 1];
+  case node16:
+    return _body.n16->children[_size - 1];
+  case node48:
+    for (int s = 255; s >= 0; --s)
+      if (_body.n48->index[s])
+        return _body.n48->children[_body.n48->index[s] - 1];
+    return nullptr;
+  case node256:
+    for (int s = 255; s >= 0; --s)
+      if (_body.n256->children[s])
+        return _body.n256->children[s];
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::next(const _Symbol key) const
+    noexcept {
+  switch (_layout) {
+  case node4: {
+    auto position =
+        std::upper_bound(_body.n4->keys, _body.n4->keys + _size, key);
+    if (position == _body.n4->keys + _size)
+      return nullptr;
+    return _body.n4->children[position - _body.n4->keys];
+  }
+  case node16: {
+    auto position =
+        std::upper_bound(_body.n16->keys, _body.n16->keys + _size, key);
+    if (position == _body.n16->keys + _size)
+      return nullptr;
+    return _body.n16->children[position - _body.n16->keys];
+  }
+  case node48:
+    for (int s = slot(key) + 1; s < 256; ++s)
+      if (_body.n48->index[s])
+        return _body.n48->children[_body.n48->index[s] - 1];
+    return nullptr;
+  case node256:
+    for (int s = slot(key) + 1; s < 256; ++s)
+      if (_body.n256->children[s])
+        return _body.n256->children[s];
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::previous(const _Symbol key) const
+    noexcept {
+  switch (_layout) {
+  case node4: {
+    auto position =
+        std::lower_bound(_body.n4->keys, _body.n4->keys + _size, key);
+    if (position == _body.n4->keys)
+      return nullptr;
+    return _body.n4->children[position - _body.n4->keys - 1];
+  }
+  case node16: {
+    auto position =
+        std::lower_bound(_body.n16->keys, _body.n16->keys + _size, key);
+    if (position == _body.n16->keys)
+      return nullptr;
+    return _body.n16->children[position - _body.n16->keys - 1];
+  }
+  case node48:
+    for (int s = slot(key) - 1; s >= 0; --s)
+      if (_body.n48->index[s])
+        return _body.n48->children[_body.n48->index[s] - 1];
+    return nullptr;
+  case node256:
+    for (int s = slot(key) - 1; s >= 0; --s)
+      if (_body.n256->children[s])
+        return _body.n256->children[s];
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+// ###### capacity ######
+
+template <typename _Node, typename _Symbol>
+bool trie_node_children<_Node, _Symbol>::empty() const noexcept {
+  return _size == 0;
+}
+
+template <typename _Node, typename _Symbol>
+typename trie_node_children<_Node, _Symbol>::size_type
+trie_node_children<_Node, _Symbol>::size() const noexcept {
+  return _size;
+}
+
+template <typename _Node, typename _Symbol>
+std::size_t trie_node_children<_Node, _Symbol>::memory_usage() const noexcept {
+  switch (_layout) {
+  case node4:
+    return sizeof(sorted4);
+  case node16:
+    return sizeof(sorted16);
+  case node48:
+    return sizeof(indexed48);
+  case node256:
+    return sizeof(direct256);
+  default:
+    return 0;
+  }
+}
+
+// ###### modifiers ######
+
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::insert(const _Symbol key, _Node *child,
+                                                trie_arena *arena) noexcept {
+  if (_layout == none) {
+    _body.n4 = make_body<sorted4>(arena);
+    _layout = node4;
+  } else if ((_layout == node4 && _size == 4) ||
+             (_layout == node16 && _size == 16) ||
+             (_layout == node48 && _size == 48)) {
+    grow(arena);
+  }
+
+  switch (_layout) {
+  case node4:
+    sorted_insert(_body.n4, _size, key, child);
+    break;
+  case node16:
+    sorted_insert(_body.n16, _size, key, child);
+    break;
+  case node48: {
+    std::uint8_t position = 0;
+    while (_body.n48->children[position] != nullptr)
+      ++position;
+    _body.n48->children[position] = child;
+    _body.n48->index[slot(key)] = position + 1;
+    break;
+  }
+  case node256:
+    _body.n256->children[slot(key)] = child;
+    break;
+  default:
+    break;
+  }
+  ++_size;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::erase(const _Symbol key,
+                                                 trie_arena *arena) noexcept {
+  _Node *child = nullptr;
+  switch (_layout) {
+  case node4:
+    child = sorted_erase(_body.n4, _size, key);
+    break;
+  case node16:
+    child = sorted_erase(_body.n16, _size, key);
+    break;
+  case node48: {
+    std::uint8_t position = _body.n48->index[slot(key)];
+    if (position) {
+      child = _body.n48->children[position - 1];
+      _body.n48->children[position - 1] = nullptr;
+      _body.n48->index[slot(key)] = 0;
+    }
+    break;
+  }
+  case node256:
+    child = _body.n256->children[slot(key)];
+    _body.n256->children[slot(key)] = nullptr;
+    break;
+  default:
+    break;
+  }
+  if (child != nullptr) {
+    --_size;
+    shrink(arena);
+  }
+  return child;
+}
+
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::clear(trie_arena *arena) noexcept {
+  release_body(arena);
+  _layout = none;
+  _size = 0;
+}
+
+// ###### traversal ######
+
+template <typename _Node, typename _Symbol>
+template <typename _Function>
+void trie_node_children<_Node, _Symbol>::for_each(_Function function) const {
+  switch (_layout) {
+  case node4:
+    for (std::uint16_t i = 0; i < _size; ++i)
+      function(_body.n4->keys[i], _body.n4->children[i]);
+    break;
+  case node16:
+    for (std::uint16_t i = 0; i < _size; ++i)
+      function(_body.n16->keys[i], _body.n16->children[i]);
+    break;
+  case node48:
+    for (int s = 0; s < 256; ++s)
+      if (_body.n48->index[s])
+        function(key_of(s), _body.n48->children[_body.n48->index[s] - 1]);
+    break;
+  case node256:
+    for (int s = 0; s < 256; ++s)
+      if (_body.n256->children[s])
+        function(key_of(s), _body.n256->children[s]);
+    break;
+  default:
+    break;
+  }
+}
+
+// ###### utilities ######
+
+// For char, flipping the sign bit maps signed char order onto 0..255.
+template <typename _Node, typename _Symbol>
+std::uint8_t
+trie_node_children<_Node, _Symbol>::slot(const _Symbol key) noexcept {
+  return static_cast<std::uint8_t>(trie_symbol_traits<_Symbol>::index(key));
+}
+
+template <typename _Node, typename _Symbol>
+_Symbol
+trie_node_children<_Node, _Symbol>::key_of(const std::uint8_t slot) noexcept {
+  return trie_symbol_traits<_Symbol>::symbol(slot);
+}
+
+template <typename _Node, typename _Symbol>
+template <typename _Sorted>
+_Node *trie_node_children<_Node, _Symbol>::sorted_find(
+    const _Sorted *body, std::uint16_t size, const _Symbol key) noexcept {
+  for (std::uint16_t i = 0; i < size; ++i)
+    if (body->keys[i] == key)
+      return body->children[i];
+  return nullptr;
+}
+
+// Compares all sixteen keys at once where SSE2 is available.
+template <typename _Node, typename _Symbol>
+_Node *trie_node_children<_Node, _Symbol>::packed_find(
+    const sorted16 *body, std::uint16_t size, const _Symbol key) noexcept {
+#if defined(__SSE2__)
+  __m128i keys =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(body->keys));
+  __m128i needle = _mm_set1_epi8(static_cast<char>(key));
+  int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, needle)) &
+             ((1 << size) - 1);
+  return mask ? body->children[__builtin_ctz(mask)] : nullptr;
+#else
+  return sorted_find(body, size, key);
+#endif
+}
+
+template <typename _Node, typename _Symbol>
+template <typename _Sorted>
+void trie_node_children<_Node, _Symbol>::sorted_insert(_Sorted *body,
+                                                       std::uint16_t size,
+                                                       const _Symbol key,
+                                                       _Node *child) noexcept {
+  std::uint16_t position = 0;
+  while (position < size && body->keys[position] < key)
+    ++position;
+  std::memmove(body->keys + position + 1, body->keys + position,
+               size - position);
+  std::memmove(body->children + position + 1, body->children + position,
+               (size - position) * sizeof(_Node *));
+  body->keys[position] = key;
+  body->children[position] = child;
+}
+
+template <typename _Node, typename _Symbol>
+template <typename _Sorted>
+_Node *trie_node_children<_Node, _Symbol>::sorted_erase(
+    _Sorted *body, std::uint16_t size, const _Symbol key) noexcept {
+  for (std::uint16_t i = 0; i < size; ++i) {
+    if (body->keys[i] == key) {
+      _Node *child = body->children[i];
+      std::memmove(body->keys + i, body->keys + i + 1, size - i - 1);
+      std::memmove(body->children + i, body->children + i + 1,
+                   (size - i - 1) * sizeof(_Node *));
+      return child;
+    }
+  }
+  return nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+template <typename _Body>
+_Body *
+trie_node_children<_Node, _Symbol>::make_body(trie_arena *arena) noexcept {
+  return new (arena->allocate(sizeof(_Body))) _Body();
+}
+
+template <typename _Node, typename _Symbol>
+template <typename _Body>
+void trie_node_children<_Node, _Symbol>::free_body(_Body *body,
+                                                   trie_arena *arena) noexcept {
+  arena->deallocate(body, sizeof(_Body));
+}
+
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::grow(trie_arena *arena) noexcept {
+  switch (_layout) {
+  case node4: {
+    sorted16 *body = make_body<sorted16>(arena);
+    std::memcpy(body->keys, _body.n4->keys, _size);
+    std::memcpy(body->children, _body.n4->children, _size * sizeof(_Node *));
+    free_body(_body.n4, arena);
+    _body.n16 = body;
+    _layout = node16;
+    break;
+  }
+  case node16: {
+    indexed48 *body = make_body<indexed48>(arena);
+    for (std::uint16_t i = 0; i < _size; ++i) {
+      body->index[slot(_body.n16->keys[i])] = i + 1;
+      body->children[i] = _body.n16->children[i];
+    }
+    free_body(_body.n16, arena);
+    _body.n48 = body;
+    _layout = node48;
+    break;
+  }
+  case node48: {
+    direct256 *body = make_body<direct256>(arena);
+    for (int s = 0; s < 256; ++s)
+      if (_body.n48->index[s])
+        body->children[s] = _body.n48->children[_body.n48->index[s] - 1];
+    free_body(_body.n48, arena);
+    _body.n256 = body;
+    _layout = node256;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Shrinking lags growing by a few children so that a node sitting on a
+// boundary does not reallocate on every insert/erase pair.
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::shrink(trie_arena *arena) noexcept {
+  switch (_layout) {
+  case node4:
+    if (_size == 0)
+      clear(arena);
+    break;
+  case node16:
+    if (_size <= 3) {
+      sorted4 *body = make_body<sorted4>(arena);
+      std::memcpy(body->keys, _body.n16->keys, _size);
+      std::memcpy(body->children, _body.n16->children,
+                  _size * sizeof(_Node *));
+      free_body(_body.n16, arena);
+      _body.n4 = body;
+      _layout = node4;
+    }
+    break;
+  case node48:
+    if (_size <= 12) {
+      sorted16 *body = make_body<sorted16>(arena);
+      std::uint16_t position = 0;
+      for (int s = 0; s < 256; ++s) {
+        if (_body.n48->index[s]) {
+          body->keys[position] = key_of(s);
+          body->children[position] =
+              _body.n48->children[_body.n48->index[s] - 1];
+          ++position;
+        }
+      }
+      free_body(_body.n48, arena);
+      _body.n16 = body;
+      _layout = node16;
+    }
+    break;
+  case node256:
+    if (_size <= 36) {
+      indexed48 *body = make_body<indexed48>(arena);
+      std::uint8_t position = 0;
+      for (int s = 0; s < 256; ++s) {
+        if (_body.n256->children[s]) {
+          body->index[s] = position + 1;
+          body->children[position] = _body.n256->children[s];
+          ++position;
+        }
+      }
+      free_body(_body.n256, arena);
+      _body.n48 = body;
+      _layout = node48;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+template <typename _Node, typename _Symbol>
+void trie_node_children<_Node, _Symbol>::release_body(
+    trie_arena *arena) noexcept {
+  switch (_layout) {
+  case node4:
+    free_body(_body.n4, arena);
+    break;
+  case node16:
+    free_body(_body.n16, arena);
+    break;
+  case node48:
+    free_body(_body.n48, arena);
+    break;
+  case node256:
+    free_body(_body.n256, arena);
+    break;
+  default:
+    break;
+  }
+  _body.any = nullptr;
+}
+
+// Child container for alphabets of up to 64 symbols (trie_bit,
+// trie_nibble): a bitmap of the symbols present and a dense array holding
+// the children in symbol order, indexed by the number of bits set below a
+// symbol. The array is reallocated at its exact size on every change.
+template <typename _Node, typename _Symbol> class trie_bitmap_children {
+  static_assert(trie_symbol_traits<_Symbol>::alphabet_size <= 64,
+                "trie_bitmap_children needs at most 64 symbols");
+
+public:
+  using key_type = _Symbol;
+  using size_type = unsigned int;
+
+  trie_bitmap_children() noexcept;
+  trie_bitmap_children(const trie_bitmap_children &other) = delete;
+  trie_bitmap_children &operator=(const trie_bitmap_children &other) = delete;
+  ~trie_bitmap_children() noexcept;
+
+  // ###### lookup ######
+  _Node *find(const _Symbol key) const noexcept;
+  _Node *first() const noexcept;
+  _Node *last() const noexcept;
+  _Node *next(const _Symbol key) const noexcept;
+  _Node *previous(const _Symbol key) const noexcept;
+  void prefetch(const _Symbol key) const noexcept;
+
+  // ###### capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+  // ###### modifiers ######
+  void insert(const _Symbol key, _Node *child,
+              trie_arena *arena = trie_arena::heap()) noexcept;
+  _Node *erase(const _Symbol key,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  void clear(trie_arena *arena = trie_arena::heap()) noexcept;
+
+  // ###### traversal ######
+  template <typename _Function> void for_each(_Function function) const;
+
+private:
+  std::uint64_t _bitmap;
+  _Node **_children;
+
+  static std::uint64_t bit(const _Symbol key) noexcept;
+  size_type position(std::uint64_t bit) const noexcept;
+  void replace_children(_Node **children, trie_arena *arena) noexcept;
+};
+
+template <typename _Node, typename _Symbol>
+trie_bitmap_children<_Node, _Symbol>::trie_bitmap_children() noexcept
+    : _bitmap(0), _children(nullptr) {}
+
+template <typename _Node, typename _Symbol>
+trie_bitmap_children<_Node, _Symbol>::~trie_bitmap_children() noexcept {
+  clear(trie_arena::heap());
+}
+
+// ###### lookup ######
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::find(const _Symbol key) const
+    noexcept {
+  std::uint64_t b = bit(key);
+  return (_bitmap & b) ? _children[position(b)] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::first() const noexcept {
+  return _bitmap ? _children[0] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::last() const noexcept {
+  return _bitmap ? _children[size() - 1] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::next(const _Symbol key) const
+    noexcept {
+  std::uint64_t above = _bitmap & ~(bit(key) | (bit(key) - 1));
+  return above ? _children[position(above & -above)] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::previous(const _Symbol key) const
+    noexcept {
+  std::uint64_t below = _bitmap & (bit(key) - 1);
+  return below ? _children[__builtin_popcountll(below) - 1] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+void trie_bitmap_children<_Node, _Symbol>::prefetch(const _Symbol) const
+    noexcept {
+  __builtin_prefetch(_children);
+}
+
+// ###### capacity ######
+
+template <typename _Node, typename _Symbol>
+bool trie_bitmap_children<_Node, _Symbol>::empty() const noexcept {
+  return _bitmap == 0;
+}
+
+template <typename _Node, typename _Symbol>
+typename trie_bitmap_children<_Node, _Symbol>::size_type
+trie_bitmap_children<_Node, _Symbol>::size() const noexcept {
+  return __builtin_popcountll(_bitmap);
+}
+
+template <typename _Node, typename _Symbol>
+std::size_t trie_bitmap_children<_Node, _Symbol>::memory_usage() const
+    noexcept {
+  return size() * sizeof(_Node *);
+}
+
+// ###### modifiers ######
+
+template <typename _Node, typename _Symbol>
+void trie_bitmap_children<_Node, _Symbol>::insert(const _Symbol key,
+                                                  _Node *child,
+                                                  trie_arena *arena) noexcept {
+  size_type count = size();
+  size_type at = position(bit(key));
+  auto children =
+      static_cast<_Node **>(arena->allocate((count + 1) * sizeof(_Node *)));
+  std::copy(_children, _children + at, children);
+  children[at] = child;
+  std::copy(_children + at, _children + count, children + at + 1);
+  replace_children(children, arena);
+  _bitmap |= bit(key);
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_bitmap_children<_Node, _Symbol>::erase(const _Symbol key,
+                                                   trie_arena *arena) noexcept {
+  if (!(_bitmap & bit(key)))
+    return nullptr;
+  size_type count = size();
+  size_type at = position(bit(key));
+  _Node *child = _children[at];
+  _Node **children = nullptr;
+  if (count > 1) {
+    children =
+        static_cast<_Node **>(arena->allocate((count - 1) * sizeof(_Node *)));
+    std::copy(_children, _children + at, children);
+    std::copy(_children + at + 1, _children + count, children + at);
+  }
+  replace_children(children, arena);
+  _bitmap &= ~bit(key);
+  return child;
+}
+
+template <typename _Node, typename _Symbol>
+void trie_bitmap_children<_Node, _Symbol>::clear(trie_arena *arena) noexcept {
+  replace_children(nullptr, arena);
+  _bitmap = 0;
+}
+
+// ###### traversal ######
+
+template <typename _Node, typename _Symbol>
+template <typename _Function>
+void trie_bitmap_children<_Node, _Symbol>::for_each(
+    _Function function) const {
+  size_type i = 0;
+  for (std::uint64_t bits = _bitmap; bits != 0; bits &= bits - 1)
+    function(trie_symbol_traits<_Symbol>::symbol(__builtin_ctzll(bits)),
+             _children[i++]);
+}
+
+// ###### utilities ######
+
+template <typename _Node, typename _Symbol>
+std::uint64_t
+trie_bitmap_children<_Node, _Symbol>::bit(const _Symbol key) noexcept {
+  return std::uint64_t(1) << trie_symbol_traits<_Symbol>::index(key);
+}
+
+// Number of children whose symbols sort below bit.
+template <typename _Node, typename _Symbol>
+typename trie_bitmap_children<_Node, _Symbol>::size_type
+trie_bitmap_children<_Node, _Symbol>::position(std::uint64_t bit) const
+    noexcept {
+  return __builtin_popcountll(_bitmap & (bit - 1));
+}
+
+template <typename _Node, typename _Symbol>
+void trie_bitmap_children<_Node, _Symbol>::replace_children(
+    _Node **children, trie_arena *arena) noexcept {
+  if (_children != nullptr)
+    arena->deallocate(_children, size() * sizeof(_Node *));
+  _children = children;
+}
+
+// Child container for large alphabets (uint16_t, uint32_t token IDs): the
+// children and their symbols in two sorted arrays sharing one allocation,
+// searched by bisection. Capacity doubles on growth and halves once the
+// children fit in a quarter of it.
+template <typename _Node, typename _Symbol> class trie_sorted_children {
+public:
+  using key_type = _Symbol;
+  using size_type = unsigned int;
+
+  trie_sorted_children() noexcept;
+  trie_sorted_children(const trie_sorted_children &other) = delete;
+  trie_sorted_children &operator=(const trie_sorted_children &other) = delete;
+  ~trie_sorted_children() noexcept;
+
+  // ###### lookup ######
+  _Node *find(const _Symbol key) const noexcept;
+  _Node *first() const noexcept;
+  _Node *last() const noexcept;
+  _Node *next(const _Symbol key) const noexcept;
+  _Node *previous(const _Symbol key) const noexcept;
+  void prefetch(const _Symbol key) const noexcept;
+
+  // ###### capacity ######
+  bool empty() const noexcept;
+  size_type size() const noexcept;
+  std::size_t memory_usage() const noexcept;
+
+  // ###### modifiers ######
+  void insert(const _Symbol key, _Node *child,
+              trie_arena *arena = trie_arena::heap()) noexcept;
+  _Node *erase(const _Symbol key,
+               trie_arena *arena = trie_arena::heap()) noexcept;
+  void clear(trie_arena *arena = trie_arena::heap()) noexcept;
+
+  // ###### traversal ######
+  template <typename _Function> void for_each(_Function function) const;
+
+private:
+  // Holds _capacity child pointers followed by _capacity symbols.
+  _Node **_children;
+  std::uint32_t _size;
+  std::uint32_t _capacity;
+
+  _Symbol *keys() const noexcept;
+  size_type lower_bound(const _Symbol key) const noexcept;
+  void reallocate(std::uint32_t capacity, trie_arena *arena) noexcept;
+  static std::size_t bytes(std::uint32_t capacity) noexcept;
+  static bool less(const _Symbol a, const _Symbol b) noexcept;
+};
+
+template <typename _Node, typename _Symbol>
+trie_sorted_children<_Node, _Symbol>::trie_sorted_children() noexcept
+    : _children(nullptr), _size(0), _capacity(0) {}
+
+template <typename _Node, typename _Symbol>
+trie_sorted_children<_Node, _Symbol>::~trie_sorted_children() noexcept {
+  clear(trie_arena::heap());
+}
+
+// ###### lookup ######
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::find(const _Symbol key) const
+    noexcept {
+  size_type at = lower_bound(key);
+  return at < _size && keys()[at] == key ? _children[at] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::first() const noexcept {
+  return _size ? _children[0] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::last() const noexcept {
+  return _size ? _children[_size - 1] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::next(const _Symbol key) const
+    noexcept {
+  size_type at = lower_bound(key);
+  if (at < _size && keys()[at] == key)
+    ++at;
+  return at < _size ? _children[at] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::previous(const _Symbol key) const
+    noexcept {
+  size_type at = lower_bound(key);
+  return at > 0 ? _children[at - 1] : nullptr;
+}
+
+template <typename _Node, typename _Symbol>
+void trie_sorted_children<_Node, _Symbol>::prefetch(const _Symbol) const
+    noexcept {
+  if (_size)
+    __builtin_prefetch(keys() + _size / 2);
+}
+
+// ###### capacity ######
+
+template <typename _Node, typename _Symbol>
+bool trie_sorted_children<_Node, _Symbol>::empty() const noexcept {
+  return _size == 0;
+}
+
+template <typename _Node, typename _Symbol>
+typename trie_sorted_children<_Node, _Symbol>::size_type
+trie_sorted_children<_Node, _Symbol>::size() const noexcept {
+  return _size;
+}
+
+template <typename _Node, typename _Symbol>
+std::size_t trie_sorted_children<_Node, _Symbol>::memory_usage() const
+    noexcept {
+  return _capacity ? bytes(_capacity) : 0;
+}
+
+// ###### modifiers ######
+
+template <typename _Node, typename _Symbol>
+void trie_sorted_children<_Node, _Symbol>::insert(const _Symbol key,
+                                                  _Node *child,
+                                                  trie_arena *arena) noexcept {
+  if (_size == _capacity)
+    reallocate(_capacity ? 2 * _capacity : 2, arena);
+  size_type at = lower_bound(key);
+  std::copy_backward(_children + at, _children + _size, _children + _size + 1);
+  std::copy_backward(keys() + at, keys() + _size, keys() + _size + 1);
+  _children[at] = child;
+  keys()[at] = key;
+  ++_size;
+}
+
+template <typename _Node, typename _Symbol>
+_Node *trie_sorted_children<_Node, _Symbol>::erase(const _Symbol key,
+                                                   trie_arena *arena) noexcept {
+  size_type at = lower_bound(key);
+  if (at == _size || keys()[at] != key)
+    return nullptr;
+  _Node *child = _children[at];
+  std::copy(_children + at + 1, _children + _size, _children + at);
+  std::copy(keys() + at + 1, keys() + _size, keys() + at);
+  --_size;
+  if (_size == 0)
+    clear(arena);
+  else if (_capacity > 2 && _size * 4 <= _capacity)
+    reallocate(_capacity / 2, arena);
+  return child;
+}
+
+template <typename _Node, typename _Symbol>
+void trie_sorted_children<_Node, _Symbol>::clear(trie_arena *arena) noexcept {
+  if (_children != nullptr)
+    arena->deallocate(_children, bytes(_capacity));
+  _children = nullptr;
+  _size = 0;
+  _capacity = 0;
+}
+
+// ###### traversal ######
+
+template <typename _Node, typename _Symbol>
+template <typename _Function>
+void trie_sorted_children<_Node, _Symbol>::for_each(
+    _Function function) const {
+  for (size_type i = 0; i < _size; ++i)
+    function(keys()[i], _children[i]);
+}
+
+// ###### utilities ######
+
+template <typename _Node, typename _Symbol>
+_Symbol *trie_sorted_children<_Node, _Symbol>::keys() const noexcept {
+  return reinterpret_cast<_Symbol *>(_children + _capacity);
+}
+
+template <typename _Node, typename _Symbol>
+typename trie_sorted_children<_Node, _Symbol>::size_type
+trie_sorted_children<_Node, _Symbol>::lower_bound(const _Symbol key) const
+    noexcept {
+  return std::lower_bound(keys(), keys() + _size, key, less) - keys();
+}
+
+template <typename _Node, typename _Symbol>
+void trie_sorted_children<_Node, _Symbol>::reallocate(
+    std::uint32_t capacity, trie_arena *arena) noexcept {
+  auto children = static_cast<_Node **>(arena->allocate(bytes(capacity)));
+  auto symbols = reinterpret_cast<_Symbol *>(children + capacity);
+  if (_children != nullptr) {
+    std::copy(_children, _children + _size, children);
+    std::copy(keys(), keys() + _size, symbols);
+    arena->deallocate(_children, bytes(_capacity));
+  }
+  _children = children;
+  _capacity = capacity;
+}
+
+template <typename _Node, typename _Symbol>
+std::size_t
+trie_sorted_children<_Node, _Symbol>::bytes(std::uint32_t capacity) noexcept {
+  return capacity * (sizeof(_Node *) + sizeof(_Symbol));
+}
+
+template <typename _Node, typename _Symbol>
+bool trie_sorted_children<_Node, _Symbol>::less(const _Symbol a,
+                                                const _Symbol b) noexcept {
+  return trie_symbol_traits<_Symbol>::index(a) <
+         trie_symbol_traits<_Symbol>::index(b);
+}
+
+// Child container of a node over _Symbol, picked at compile time from the
+// size of the alphabet.
+template <typename _Node, typename _Symbol>
+using trie_children_t = std::conditional_t<
+    (trie_symbol_traits<_Symbol>::alphabet_size <= 64),
+    trie_bitmap_children<_Node, _Symbol>,
+    std::conditional_t<trie_symbol_traits<_Symbol>::alphabet_size == 256,
+                       trie_node_children<_Node, _Symbol>,
+                       trie_sorted_children<_Node, _Symbol>>>;
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Glob pattern compiled to a position automaton for trie::match(). '?'
+// matches any one character, '*' any run of characters, "[abc]", "[a-z]"
+// and "[!a-z]" (or "[^a-z]") one character of a class, and a backslash
+// makes the next character literal. An unterminated '[' is literal.
+//
+// A state set is a bitset over pattern positions, position i meaning that
+// token i is the next to match and the last position meaning the whole
+// pattern matched. Sets are arrays of words() 64-bit words owned by the
+// caller, so a traversal can keep one per level of the trie.
+class trie_pattern {
+public:
+  explicit trie_pattern(std::string_view pattern);
+
+  std::size_t words() const noexcept;
+  void start(std::uint64_t *set) const noexcept;
+  bool step(const std::uint64_t *from, char key, std::uint64_t *to) const
+      noexcept;
+  bool accepts(const std::uint64_t *set) const noexcept;
+
+private:
+  enum kind : std::uint8_t { literal, any, star, character_class };
+
+  struct token {
+    kind type;
+    char character;
+    std::uint32_t class_index;
+  };
+
+  std::vector<token> _tokens;
+  std::vector<std::bitset<256>> _classes;
+  std::size_t _words;
+
+  bool matches(const token &t, char key) const noexcept;
+  static std::size_t class_end(std::string_view pattern,
+                               std::size_t open) noexcept;
+  void close(std::uint64_t *set) const noexcept;
+  static bool test(const std::uint64_t *set, std::size_t position) noexcept;
+  static void mark(std::uint64_t *set, std::size_t position) noexcept;
+};
+
+inline trie_pattern::trie_pattern(std::string_view pattern) {
+  for (std::size_t i = 0; i < pattern.length(); ++i) {
+    char c = pattern[i];
+    std::size_t end =
+        c == '[' ? class_end(pattern, i) : std::string_view::npos;
+    if (c == '?') {
+      _tokens.push_back({any, '\0', 0});
+    } else if (c == '*') {
+      if (_tokens.empty() || _tokens.back().type != star)
+        _tokens.push_back({star, '\0', 0});
+    } else if (c == '\\' && i + 1 < pattern.length()) {
+      _tokens.push_back({literal, pattern[++i], 0});
+    } else if (end != std::string_view::npos) {
+      std::size_t position = i + 1;
+      bool negated = pattern[position] == '!' || pattern[position] == '^';
+      if (negated)
+        ++position;
+      std::bitset<256> chars;
+      for (; position < end; ++position) {
+        unsigned char low = pattern[position];
+        unsigned char high = low;
+        if (position + 2 < end && pattern[position + 1] == '-') {
+          high = pattern[position + 2];
+          position += 2;
+        }
+        for (unsigned int k = low; k <= high; ++k)
+          chars.set(k);
+      }
+      if (negated)
+        chars.flip();
+      _tokens.push_back(
+          {character_class, '\0', static_cast<std::uint32_t>(_classes.size())});
+      _classes.push_back(chars);
+      i = end;
+    } else {
+      _tokens.push_back({literal, c, 0});
+    }
+  }
+  _words = _tokens.size() / 64 + 1;
+}
+
+inline std::size_t trie_pattern::words() const noexcept { return _words; }
+
+inline void trie_pattern::start(std::uint64_t *set) const noexcept {
+  for (std::size_t w = 0; w < _words; ++w)
+    set[w] = 0;
+  mark(set, 0);
+  close(set);
+}
+
+// Moves every position in from over key into to; false if none survives.
+inline bool trie_pattern::step(const std::uint64_t *from, char key,
+                               std::uint64_t *to) const noexcept {
+  for (std::size_t w = 0; w < _words; ++w)
+    to[w] = 0;
+  bool alive = false;
+  for (std::size_t w = 0; w < _words; ++w) {
+    for (std::uint64_t bits = from[w]; bits != 0; bits &= bits - 1) {
+      std::size_t position = w * 64 + __builtin_ctzll(bits);
+      if (position == _tokens.size())
+        continue;
+      const token &t = _tokens[position];
+      if (t.type == star) {
+        mark(to, position);
+        alive = true;
+      } else if (matches(t, key)) {
+        mark(to, position + 1);
+        alive = true;
+      }
+    }
+  }
+  if (alive)
+    close(to);
+  return alive;
+}
+
+inline bool trie_pattern::accepts(const std::uint64_t *set) const noexcept {
+  return test(set, _tokens.size());
+}
+
+inline bool trie_pattern::matches(const token &t, char key) const noexcept {
+  switch (t.type) {
+  case literal:
+    return t.character == key;
+  case any:
+    return true;
+  case character_class:
+    return _classes[t.class_index].test(static_cast<unsigned char>(key));
+  default:
+    return false;
+  }
+}
+
+// Position of the ']' closing the class opened at open, or npos. A ']'
+// right after the opening bracket (and after '!' or '^') belongs to the
+// class.
+inline std::size_t trie_pattern::class_end(std::string_view pattern,
+                                           std::size_t open) noexcept {
+  std::size_t first = open + 1;
+  if (first < pattern.length() &&
+      (pattern[first] == '!' || pattern[first] == '^'))
+    ++first;
+  return pattern.find(']', first + 1);
+}
+
+// A star may match nothing, so the position after it is live too.
+inline void trie_pattern::close(std::uint64_t *set) const noexcept {
+  for (std::size_t position = 0; position < _tokens.size(); ++position)
+    if (_tokens[position].type == star && test(set, position))
+      mark(set, position + 1);
+}
+
+inline bool trie_pattern::test(const std::uint64_t *set,
+                               std::size_t position) noexcept {
+  return (set[position / 64] >> (position % 64)) & 1;
+}
+
+inline void trie_pattern::mark(std::uint64_t *set,
+                               std::size_t position) noexcept {
+  set[position / 64] |= std::uint64_t(1) << (position % 64);
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <ios>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Symbols for tries over bit strings (e.g. IP prefixes) and nibble strings
+// (e.g. IPv6 addresses or hashes, one hex digit per symbol). Keys over them
+// are trie_string<trie_bit> and trie_string<trie_nibble>.
+enum class trie_bit : std::uint8_t {};
+enum class trie_nibble : std::uint8_t {};
+
+// What a trie needs to know about its key symbols: how many there are and
+// where each one sits in key order. index() maps a symbol onto 0 ..
+// alphabet_size - 1 and symbol() maps it back. Integral and enum symbols
+// order by value, signed ones (char included) as signed values, so a trie
+// of std::string keeps its historical signed char order; byte strings that
+// need unsigned order use unsigned char. The child container of a node is
+// chosen from alphabet_size (see trie_children_t).
+template <typename _Symbol, typename = void> struct trie_symbol_traits {
+  static_assert(std::is_integral_v<_Symbol> || std::is_enum_v<_Symbol>,
+                "trie symbols must be integral or enum types");
+};
+
+template <typename _Symbol>
+struct trie_symbol_traits<
+    _Symbol, std::enable_if_t<std::is_integral_v<_Symbol> ||
+                              std::is_enum_v<_Symbol>>> {
+private:
+  using underlying_type =
+      typename std::conditional_t<std::is_enum_v<_Symbol>,
+                                  std::underlying_type<_Symbol>,
+                                  std::common_type<_Symbol>>::type;
+  using unsigned_type = std::make_unsigned_t<underlying_type>;
+  static constexpr unsigned_type sign_bit =
+      std::is_signed_v<underlying_type>
+          ? unsigned_type(1) << (8 * sizeof(underlying_type) - 1)
+          : 0;
+
+public:
+  static constexpr std::size_t alphabet_size =
+      sizeof(_Symbol) < sizeof(std::size_t)
+          ? std::size_t(1) << (8 * sizeof(_Symbol))
+          : std::numeric_limits<std::size_t>::max();
+
+  static constexpr std::size_t index(_Symbol symbol) noexcept {
+    return static_cast<unsigned_type>(symbol) ^ sign_bit;
+  }
+  static constexpr _Symbol symbol(std::size_t index) noexcept {
+    return static_cast<_Symbol>(static_cast<unsigned_type>(index) ^ sign_bit);
+  }
+};
+
+template <> struct trie_symbol_traits<trie_bit> {
+  static constexpr std::size_t alphabet_size = 2;
+
+  static constexpr std::size_t index(trie_bit symbol) noexcept {
+    return static_cast<std::size_t>(symbol);
+  }
+  static constexpr trie_bit symbol(std::size_t index) noexcept {
+    return static_cast<trie_bit>(index);
+  }
+};
+
+template <> struct trie_symbol_traits<trie_nibble> {
+  static constexpr std::size_t alphabet_size = 16;
+
+  static constexpr std::size_t index(trie_nibble symbol) noexcept {
+    return static_cast<std::size_t>(symbol);
+  }
+  static constexpr trie_nibble symbol(std::size_t index) noexcept {
+    return static_cast<trie_nibble>(index);
+  }
+};
+
+// Character traits for strings of symbols that are not character types.
+// std::char_traits is only specified for those, and libc++ 18 removed the
+// generic fallback. lt() follows trie order, so sorted keys come out in
+// the order a trie iterates them.
+template <typename _Symbol> struct trie_char_traits {
+  using char_type = _Symbol;
+  using int_type = long long;
+  using off_type = std::streamoff;
+  using pos_type = std::streampos;
+  using state_type = std::mbstate_t;
+
+  static constexpr void assign(char_type &c1, const char_type &c2) noexcept {
+    c1 = c2;
+  }
+  static constexpr bool eq(char_type c1, char_type c2) noexcept {
+    return c1 == c2;
+  }
+  static constexpr bool lt(char_type c1, char_type c2) noexcept {
+    return trie_symbol_traits<_Symbol>::index(c1) <
+           trie_symbol_traits<_Symbol>::index(c2);
+  }
+
+  static constexpr int compare(const char_type *s1, const char_type *s2,
+                               std::size_t n) noexcept {
+    for (std::size_t i = 0; i < n; ++i) {
+      if (lt(s1[i], s2[i]))
+        return -1;
+      if (lt(s2[i], s1[i]))
+        return 1;
+    }
+    return 0;
+  }
+  static constexpr std::size_t length(const char_type *s) noexcept {
+    std::size_t n = 0;
+    while (!eq(s[n], char_type()))
+      ++n;
+    return n;
+  }
+  static constexpr const char_type *find(const char_type *s, std::size_t n,
+                                         const char_type &c) noexcept {
+    for (std::size_t i = 0; i < n; ++i)
+      if (eq(s[i], c))
+        return s + i;
+    return nullptr;
+  }
+
+  // Empty ranges may come with null pointers, which memmove must not see.
+  static char_type *move(char_type *s1, const char_type *s2,
+                         std::size_t n) noexcept {
+    if (n != 0)
+      std::memmove(s1, s2, n * sizeof(char_type));
+    return s1;
+  }
+  static char_type *copy(char_type *s1, const char_type *s2,
+                         std::size_t n) noexcept {
+    if (n != 0)
+      std::memcpy(s1, s2, n * sizeof(char_type));
+    return s1;
+  }
+  static char_type *assign(char_type *s, std::size_t n, char_type c) noexcept {
+    for (std::size_t i = 0; i < n; ++i)
+      s[i] = c;
+    return s;
+  }
+
+  static constexpr int_type eof() noexcept { return -1; }
+  static constexpr int_type not_eof(int_type i) noexcept {
+    return i == eof() ? 0 : i;
+  }
+  static constexpr char_type to_char_type(int_type i) noexcept {
+    return trie_symbol_traits<_Symbol>::symbol(static_cast<std::size_t>(i));
+  }
+  static constexpr int_type to_int_type(char_type c) noexcept {
+    return static_cast<int_type>(trie_symbol_traits<_Symbol>::index(c));
+  }
+  static constexpr bool eq_int_type(int_type i1, int_type i2) noexcept {
+    return i1 == i2;
+  }
+};
+
+// The character types keep std::char_traits, so trie_string<char> is
+// std::string; every other symbol type gets trie_char_traits.
+template <typename _Symbol> struct trie_is_character : std::false_type {};
+template <> struct trie_is_character<char> : std::true_type {};
+template <> struct trie_is_character<wchar_t> : std::true_type {};
+template <> struct trie_is_character<char16_t> : std::true_type {};
+template <> struct trie_is_character<char32_t> : std::true_type {};
+#ifdef __cpp_char8_t
+template <> struct trie_is_character<char8_t> : std::true_type {};
+#endif
+
+template <typename _Symbol>
+using trie_traits_t =
+    std::conditional_t<trie_is_character<_Symbol>::value,
+                       std::char_traits<_Symbol>, trie_char_traits<_Symbol>>;
+
+template <typename _Symbol>
+using trie_string = std::basic_string<_Symbol, trie_traits_t<_Symbol>>;
+template <typename _Symbol>
+using trie_string_view =
+    std::basic_string_view<_Symbol, trie_traits_t<_Symbol>>;